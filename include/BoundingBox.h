@@ -80,6 +80,15 @@ public:
         }
     }
 
+    // Axes straight from a rotation matrix, rather than turning the current
+    // axes further as updateRotation does.
+    void setRotation(const glm::mat3 &matrix) {
+        rotation = glm::mat4(matrix);
+        for (int i = 0; i < 3; ++i) {
+            axis[i] = glm::normalize(matrix[i]);
+        }
+    }
+
     void transform(glm::mat4 mat) {
         position = glm::vec3(mat * glm::vec4(position, 1.0f));
         for (int i = 0; i < 3; ++i) {
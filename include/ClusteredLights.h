@@ -0,0 +1,123 @@
+#ifndef INCLUDE_CLUSTEREDLIGHTS_H_
+#define INCLUDE_CLUSTEREDLIGHTS_H_
+
+#include "ShadowCascades.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Froxel grid for point lights: the screen is cut into CLUSTER_X by
+// CLUSTER_Y tiles and the view depth into CLUSTER_Z slices. Slice 0 runs
+// from the eye to CLUSTER_NEAR, the rest grow exponentially out to
+// CLUSTER_FAR; nothing past that gets point lights. modelLoading.frag.glsl
+// repeats these numbers.
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+const float CLUSTER_NEAR = 2.0f;
+const float CLUSTER_FAR = 400.0f;
+// light data, cluster ranges and light indices, on consecutive units above
+// the shadow maps
+const unsigned int CLUSTER_TEXTURE_UNIT = SHADOW_TEXTURE_UNIT + 1;
+// indices are 16 bit
+const size_t CLUSTER_MAX_LIGHTS = 65535;
+
+static_assert(CLUSTER_X % 4 == 0, "cluster rows are tested four at a time");
+
+struct PointLight {
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 colour = glm::vec3(1.0f);
+    float ambient = 0.6f;
+    float diffuse = 0.8f;
+    float specular = 1.0f;
+    float linear = 0.009f;
+    float quadratic = 0.0032f;
+};
+
+// Distance at which the attenuation falls below 1/256. The shader fades
+// the light to nothing there, so the sphere of this radius is all it can
+// touch.
+float lightRadius(const PointLight& light);
+
+// First view depth of a slice; slice CLUSTER_Z gives CLUSTER_FAR.
+float clusterSliceDepth(int slice);
+
+// Slice holding a view depth, CLUSTER_Z past the far end.
+int clusterSlice(float depth);
+
+struct ClusterStats {
+    size_t lights = 0;
+    // lights inside the grid
+    size_t lightsBinned = 0;
+    // entries over every cluster's list
+    size_t indices = 0;
+    // entries that did not fit under the index limit
+    size_t dropped = 0;
+    size_t busiestCluster = 0;
+    float milliseconds = 0.0f;
+};
+
+// CPU half of clustered shading. The cluster boxes are built in view space
+// from the lens; each frame every light's sphere is moved into view space
+// and tested against the boxes it might reach, four clusters of a row at a
+// time, and the hits become one index list per cluster. No GL.
+class ClusterBinner {
+public:
+    void bin(const glm::mat4& view, const CameraLens& lens, const PointLight* lights, size_t count);
+
+    // offset into indices() and light count, two per cluster; clusters are
+    // numbered (slice * CLUSTER_Y + tileY) * CLUSTER_X + tileX, tile (0, 0)
+    // at the bottom left of the screen
+    const std::vector<uint32_t>& ranges() const { return m_ranges; }
+    const std::vector<uint16_t>& indices() const { return m_indices; }
+    // three per light: position and radius, colour and linear, then
+    // ambient, diffuse, specular and quadratic
+    const std::vector<glm::vec4>& lightTexels() const { return m_texels; }
+    const ClusterStats& stats() const { return m_stats; }
+    // The longest index list the shaders can be given;
+    // GL_MAX_TEXTURE_BUFFER_SIZE can be as low as 65536.
+    void setIndexLimit(size_t limit) { m_indexLimit = limit; }
+
+private:
+    CameraLens m_lens {};
+    bool m_haveLens = false;
+    // view-space cluster boxes, one array per bound; x and y are the
+    // camera's right and up, z is depth in front of it
+    std::vector<float> m_minX, m_minY, m_minZ, m_maxX, m_maxY, m_maxZ;
+    // (cluster, light) pairs before they are sorted into lists
+    std::vector<uint32_t> m_hitClusters;
+    std::vector<uint16_t> m_hitLights;
+    std::vector<uint32_t> m_ranges;
+    std::vector<uint16_t> m_indices;
+    std::vector<glm::vec4> m_texels;
+    size_t m_indexLimit = 1 << 20;
+    ClusterStats m_stats;
+
+    void buildBoxes(const CameraLens& lens);
+};
+
+// The binner's output as texture buffers, re-specified every frame; GL 3.3
+// has no storage buffers. Needs a GL context.
+class ClusterBuffers {
+public:
+    ClusterBuffers();
+    ~ClusterBuffers();
+
+    ClusterBuffers(const ClusterBuffers&) = delete;
+    ClusterBuffers& operator=(const ClusterBuffers&) = delete;
+
+    void upload(const ClusterBinner& binner);
+    // Light data on unit, ranges on unit + 1 and indices on unit + 2.
+    void bind(unsigned int unit) const;
+    // GL_MAX_TEXTURE_BUFFER_SIZE
+    size_t maxTexels() const { return m_maxTexels; }
+
+private:
+    unsigned int m_buffers[3] = {};
+    unsigned int m_textures[3] = {};
+    size_t m_maxTexels = 65536;
+};
+
+#endif // INCLUDE_CLUSTEREDLIGHTS_H_
@@ -0,0 +1,39 @@
+#ifndef INCLUDE_FRUSTUM_H_
+#define INCLUDE_FRUSTUM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Six inward-facing planes (xyz normal, w distance) pulled out of a
+// projection * view matrix. A plane that comes out degenerate, as from a
+// flat ortho box, is replaced by one that keeps everything.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    static Frustum fromMatrix(const glm::mat4& projectionView);
+    bool intersects(const glm::vec3& centre, const glm::vec3& extent) const;
+};
+
+// Axis-aligned boxes as centre and half extent, one array per component so
+// the culler can load four boxes at a time.
+struct BoxList {
+    std::vector<float> centreX, centreY, centreZ;
+    std::vector<float> extentX, extentY, extentZ;
+
+    size_t size() const { return centreX.size(); }
+    void clear();
+    void reserve(size_t count);
+    void add(const glm::vec3& centre, const glm::vec3& extent);
+};
+
+// World box around a model-space box after an affine transform (Arvo).
+void transformBox(const glm::mat4& transform, const glm::vec3& centre, const glm::vec3& extent, glm::vec3& outCentre,
+    glm::vec3& outExtent);
+
+// Sets visible[i] to 1 for every box that touches the frustum and returns
+// how many do. Conservative: boxes near a corner can pass.
+size_t cullBoxes(const Frustum& frustum, const BoxList& boxes, std::vector<uint8_t>& visible);
+
+#endif // INCLUDE_FRUSTUM_H_
@@ -2,17 +2,19 @@
 #define INCLUDE_INCLUDE_INSTANCE_H_
 
 #include "Terrain.h"
+#include "utils/Random.h"
 #include <glm/ext/matrix_transform.hpp>
 
 void initTreeTranslations(int amount, float offset, float radius, std::vector<glm::mat4>& translations, glm::vec3 housePosition, Terrain& terrain)
 {
     for (int i = 0; i < amount; i++) {
+        rng::Stream stream = rng::stream(rng::Subsystem::Trees, i);
         glm::mat4 model = glm::mat4(1.0f);
         float angle = (float)i / (float)amount * 360.0f;
         angle = glm::radians(angle);
 
-        float xDisplacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-        float zDisplacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
+        float xDisplacement = stream.range(-offset, offset);
+        float zDisplacement = stream.range(-offset, offset);
 
         float x = sin(angle) * radius + xDisplacement;
         float z = cos(angle) * radius + zDisplacement;
@@ -31,13 +33,15 @@ void initMultiTree(int amount, int numModels, float offset, float radius, std::v
 {
     translations.resize(numModels);
     for (int i = 0; i < amount; i++) {
-        int randomTreeIndex = rand() % numModels;
+        // one stream per tree, so placement does not depend on iteration order
+        rng::Stream stream = rng::stream(rng::Subsystem::Trees, i);
+        int randomTreeIndex = stream.nextInt(0, numModels);
         glm::mat4 model = glm::mat4(1.0f);
         float angle = (float)i / (float)amount * 360.0f;
         angle = glm::radians(angle);
 
-        float xDisplacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-        float zDisplacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
+        float xDisplacement = stream.range(-offset, offset);
+        float zDisplacement = stream.range(-offset, offset);
 
         float x = sin(angle) * radius + xDisplacement;
         float z = cos(angle) * radius + zDisplacement;
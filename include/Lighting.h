@@ -0,0 +1,67 @@
+#ifndef INCLUDE_LIGHTING_H_
+#define INCLUDE_LIGHTING_H_
+
+#include "StreamBuffer.h"
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// CPU copy of the std140 Lighting uniform block declared in
+// modelLoading.frag.glsl and terrain.frag.glsl. Filled once per frame and
+// shared by every program through one binding point. The GLSL structs put
+// each float in the spare fourth slot of a vec3, so the padding here is
+// only at the ends. Point lights are not in here; ClusteredLights.h hands
+// them to the shaders through texture buffers.
+const unsigned int LIGHTING_BLOCK_BINDING = 0;
+const char* const LIGHTING_BLOCK_NAME = "Lighting";
+
+struct DirLightStd140 {
+    glm::vec3 direction;
+    float pad0;
+    glm::vec3 ambient;
+    float pad1;
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    float pad3;
+};
+
+struct SpotLightStd140 {
+    glm::vec3 position;
+    float cutOff;
+    glm::vec3 direction;
+    float outerCutOff;
+    glm::vec3 ambient;
+    float constant;
+    glm::vec3 diffuse;
+    float linear;
+    glm::vec3 specular;
+    float quadratic;
+};
+
+struct LightingBlock {
+    DirLightStd140 dirLight;
+    SpotLightStd140 spotLight;
+    glm::vec3 viewPos;
+    float shininess;
+    glm::vec3 lightPos;
+    // GLSL bools are 4 bytes in a block
+    int torch;
+    int lightning;
+    int pad0;
+    // clusters per pixel, across and up
+    glm::vec2 clusterScale;
+};
+
+static_assert(sizeof(DirLightStd140) == 64, "DirLight std140 size");
+static_assert(sizeof(SpotLightStd140) == 80, "SpotLight std140 size");
+static_assert(offsetof(LightingBlock, spotLight) == 64, "Lighting block layout");
+static_assert(offsetof(LightingBlock, viewPos) == 144, "Lighting block layout");
+static_assert(offsetof(LightingBlock, lightPos) == 160, "Lighting block layout");
+static_assert(offsetof(LightingBlock, lightning) == 176, "Lighting block layout");
+static_assert(offsetof(LightingBlock, clusterScale) == 184, "Lighting block layout");
+
+// Writes the block into this frame's stream buffer and points
+// LIGHTING_BLOCK_BINDING at it. Needs a GL context.
+void bindLighting(StreamBuffer& stream, const LightingBlock& block);
+
+#endif // INCLUDE_LIGHTING_H_
@@ -8,9 +8,13 @@
 
 #include "BoundingBox.h"
 #include "Shader.h"
+#include "VertexLayout.h"
+#include "utils/GLHandle.h"
+#include "utils/TextureCache.h"
 #include <assimp/mesh.h>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <algorithm>
 #include <string>
 #include <vector>
 struct vertex {
@@ -27,21 +31,80 @@ struct texture {
     unsigned int id;
     std::string type;
     std::string path;
+    // keeps the shared GL texture alive while any mesh uses it
+    std::shared_ptr<CachedTexture> handle;
+};
+
+// One level of detail: a range of the mesh's index buffer. Every level
+// indexes the same vertex buffer. error is an upper bound, in model units, on
+// how far the simplified surface can stray from level 0.
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error;
+};
+
+const int MAX_MESH_LODS = 4;
+
+// What a mesh keeps on the CPU once its buffers are uploaded.
+enum class MeshResidency {
+    // nothing; the GPU copy is the only one
+    GpuOnly,
+    // positions and indices, for physics or picking
+    Positions,
+    // the full vertices and indices
+    Full,
 };
 
 class Mesh {
 public:
+    // Empty after upload unless the residency asks for them.
     std::vector<vertex> vertices;
     std::vector<unsigned int> indices;
+    std::vector<glm::vec3> positions;
     std::vector<texture> textures;
-    Mesh(std::vector<vertex> vertices, std::vector<unsigned int> indices, std::vector<texture> textures, aiAABB boundingbox, glm::vec3 position, float pitch, float yaw, float roll);
-    Mesh(const Mesh& mesh);
-    void draw(Shader& shader);
+    Mesh(std::vector<vertex> vertices, std::vector<unsigned int> indices, std::vector<texture> textures, aiAABB boundingbox, glm::vec3 position, float pitch, float yaw, float roll,
+        MeshResidency residency = MeshResidency::GpuOnly, std::vector<MeshLod> lods = {});
+    // Owns its GL objects, so moves only.
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh&&) noexcept = default;
+    Mesh& operator=(Mesh&&) noexcept = default;
+    // lod is clamped to the levels this mesh has
+    void draw(Shader& shader, int lod = 0);
+    void bindTextures(Shader& shader);
+    const MeshLod& level(int lod) const { return lods[std::min(std::max(lod, 0), (int)lods.size() - 1)]; }
     std::shared_ptr<BoundingBox> boundingbox;
-    unsigned int VAO, VBO, EBO;
+    GLVertexArray VAO;
+    GLBuffer VBO;
+    GLBuffer EBO;
+    VertexFormat format;
+    MeshResidency residency = MeshResidency::GpuOnly;
+    size_t vertexCount = 0;
+    // all levels together
+    size_t indexCount = 0;
+    // at least level 0, the whole mesh
+    std::vector<MeshLod> lods;
+
+    // GPU vertex buffer size against what the full vertex struct would take.
+    size_t vertexBytes() const { return vertexCount * format.stride; }
+    size_t fullVertexBytes() const { return vertexCount * sizeof(vertex); }
+    // CPU memory still held by the vectors above
+    size_t residentBytes() const;
+
+    // "texture_diffuse1" and so on per texture, named once rather than every draw
+    struct SamplerName {
+        std::string name;
+        uint64_t hash;
+    };
+    const std::vector<SamplerName>& samplerNames() const { return samplers; }
 
 private:
+    std::vector<SamplerName> samplers;
+
     void setUpMesh();
+    void nameSamplers();
+    void releaseCpuData();
 };
 
 #endif // MODELS_MESH_H
@@ -0,0 +1,16 @@
+#ifndef INCLUDE_MESHCACHE_H_
+#define INCLUDE_MESHCACHE_H_
+
+#include "Model.h"
+#include <cstdint>
+#include <string>
+
+// Baked copies of imported models, one file per source under
+// MODEL_CACHE_DIR. A bake stores the post-processed vertex and index blobs,
+// texture references, LOD ranges and AABBs, tagged with a hash of the source .obj (and
+// its .mtl), so editing either re-imports on the next run.
+uint64_t hashModelSource(const std::string& sourcePath);
+bool loadBakedModel(const std::string& sourcePath, uint64_t sourceHash, ModelData& data);
+void bakeModel(const std::string& sourcePath, uint64_t sourceHash, const ModelData& data);
+
+#endif // INCLUDE_MESHCACHE_H_
@@ -0,0 +1,60 @@
+#ifndef INCLUDE_MESHOPTIMIZER_H_
+#define INCLUDE_MESHOPTIMIZER_H_
+
+#include "Mesh.h"
+#include <cstddef>
+#include <vector>
+
+// CPU-only clean-up run on imported meshes before they are baked. Every
+// function works on an indexed triangle list in place and needs no GL context.
+
+struct MeshOptimizeOptions {
+    // also run simplifyMesh, keeping about this fraction of the triangles
+    bool simplify = false;
+    float simplifyRatio = 0.5f;
+    // largest allowed error as a fraction of the mesh extent
+    float simplifyError = 0.01f;
+};
+
+struct MeshOptimizeStats {
+    size_t verticesBefore = 0;
+    size_t verticesAfter = 0;
+    size_t trianglesBefore = 0;
+    size_t trianglesAfter = 0;
+    float acmrBefore = 0.0f;
+    float acmrAfter = 0.0f;
+};
+
+// Average cache miss ratio: vertex shader runs per triangle with a FIFO
+// post-transform cache. 3 is the worst case; around 0.6-0.7 is very good.
+float computeACMR(const std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize = 16);
+
+// Merges bit-identical vertices and rewrites the indices to match.
+void weldVertices(std::vector<vertex>& vertices, std::vector<unsigned int>& indices);
+// Forsyth's linear-speed reordering for the post-transform cache.
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+// Keeps the cache order but sorts the runs between cache flushes so
+// outward-facing clusters draw first, after Sander et al.
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<vertex>& vertices);
+// Renumbers vertices in first-use order so fetches walk memory forwards.
+void optimizeVertexFetch(std::vector<vertex>& vertices, std::vector<unsigned int>& indices);
+// Quadric edge-collapse simplification down to targetIndexCount indices or
+// until the next collapse would move the surface by more than targetError
+// (fraction of the mesh extent). Only the indices change; collapsed vertices
+// snap onto existing ones, so any index list produced shares the vertex
+// buffer. UV seams and open borders are kept fixed. resultError, if given,
+// receives the error actually reached, on the same scale as targetError.
+std::vector<unsigned int> simplifyMesh(const std::vector<vertex>& vertices, const std::vector<unsigned int>& indices,
+    size_t targetIndexCount, float targetError, float* resultError = nullptr);
+
+// Appends up to maxLods - 1 coarser index lists after the full one and
+// returns the ranges, level 0 first. Level k keeps about 1/2^k of the
+// triangles; building stops once a level no longer saves at least a tenth
+// over the one before. Errors are in model units, for screen-space selection.
+std::vector<MeshLod> buildLods(const std::vector<vertex>& vertices, std::vector<unsigned int>& indices, int maxLods = MAX_MESH_LODS);
+
+// Weld, optionally simplify, then cache, overdraw and fetch order.
+MeshOptimizeStats optimizeMesh(std::vector<vertex>& vertices, std::vector<unsigned int>& indices,
+    const MeshOptimizeOptions& options = {});
+
+#endif // INCLUDE_MESHOPTIMIZER_H_
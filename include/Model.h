@@ -1,6 +1,9 @@
 #ifndef MODEL_H
 #define MODEL_H
+#include "Frustum.h"
 #include "Mesh.h"
+#include "StreamBuffer.h"
+#include "Transform.h"
 #include "TextureUtils.h"
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
@@ -9,10 +12,35 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <vector>
 
+// CPU-side result of parsing a model file. Safe to build on a worker thread;
+// textures carry only their type and path until a Model uploads them.
+struct MeshData {
+    std::vector<vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<texture> textures;
+    aiAABB boundingbox;
+    // ranges into indices, see buildLods
+    std::vector<MeshLod> lods;
+};
+
+struct ModelData {
+    std::string path;
+    std::string directory;
+    aiAABB boundingbox;
+    std::vector<MeshData> meshes;
+    bool loaded = false;
+    bool fromCache = false;
+    float parseMilliseconds = 0.0f;
+    // triangle-weighted over all meshes, from the import that produced the bake
+    float acmrBefore = 0.0f;
+    float acmrAfter = 0.0f;
+};
+
 class Drawable {
 public:
     virtual void draw(Shader& shader) = 0;
@@ -24,6 +52,8 @@ public:
     float roll;
     bool isInstanced = false;
     int instanceAmount = 0;
+    // never moves, so its shadow depth can be cached
+    bool staticShadow = false;
 };
 
 class Model : public Drawable {
@@ -43,10 +73,63 @@ public:
     float scale = 1.0f;
     float roll = 0;
 
-    Model(const std::string& path, glm::mat4 translation, glm::vec3 position, int id, float pitch, float yaw, float roll, bool gamma = false);
+    Model(const std::string& path, glm::mat4 translation, glm::vec3 position, int id, float pitch, float yaw, float roll, bool gamma = false,
+        MeshResidency residency = MeshResidency::GpuOnly);
+    // GL setup only; the data comes from parse(), usually via ModelLoader.
+    Model(ModelData data, glm::mat4 translation, glm::vec3 position, int id, float pitch, float yaw, float roll, bool gamma = false,
+        MeshResidency residency = MeshResidency::GpuOnly);
+    // Meshes own their GL objects, so a Model moves but never copies.
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    Model(Model&&) noexcept = default;
+    Model& operator=(Model&&) noexcept = default;
+
+    // Assimp import and vertex conversion. Touches no GL state. Uncached
+    // parses neither read nor write the baked copy.
+    static ModelData parse(const std::string& path, bool cached = true);
+
+    // CPU bytes the meshes still hold after upload, see MeshResidency.
+    size_t residentBytes() const;
 
     void initInstanced(size_t amount, std::vector<glm::mat4> trans);
-    void drawInstanced(Shader& shader);
+    // For instances that move. Replaces the matrices after initInstanced and
+    // from then on streams them through the frame's ring, when
+    // streamInstances has written them there, instead of the model's own
+    // buffer.
+    void setInstanceTransforms(std::vector<glm::mat4> transforms);
+    // ring space the next streamInstances may take
+    size_t streamedBytes() const;
+    // Writes the bucketed matrices of moving instances into the frame's ring,
+    // before its writes are finished.
+    void streamInstances(StreamBuffer& stream);
+    // Draws from the ring, given the one streamInstances wrote to this frame.
+    void drawInstanced(Shader& shader, const StreamBuffer* stream = nullptr);
+
+    // Level of detail used by draw(); the instanced path keeps one per instance.
+    int lod = 0;
+    // triangles submitted by the last draw or drawInstanced, and what full detail would have cost
+    size_t drawnTriangles = 0;
+    size_t fullTriangles = 0;
+    int lodCount() const { return (int)lodErrors.size(); }
+    // Coarsest level whose error stays under a pixel on screen at this
+    // distance. Coarsening needs a margin on top, so a camera sitting on a
+    // boundary does not flip between two levels every frame.
+    int chooseLod(float distance, float pixelsPerUnit, int current) const;
+    // pixelsPerUnit is the screen height in pixels of one unit at distance one
+    void selectLod(const glm::vec3& eye, float pixelsPerUnit);
+    // Culls the instances against the frustum and buckets the visible ones
+    // by level. No GL: the next drawInstanced re-uploads the instance buffer,
+    // and only when an instance changed level or visibility.
+    void updateInstances(const Frustum& frustum, const glm::vec3& eye, float pixelsPerUnit);
+    size_t visibleInstances = 0;
+    // model-space box around every mesh
+    glm::vec3 localCentre = glm::vec3(0.0f);
+    glm::vec3 localExtent = glm::vec3(0.0f);
+    // Cached matrices for position and pitch/yaw/roll; see syncTransform.
+    Transform transform;
+    // Copies the public position and angles in, marking the cache dirty only
+    // if they moved. Rebuilding is left to updateTransforms.
+    void syncTransform() { transform.set(position, pitch, yaw, roll); }
     void setScale(float scale);
     void addPitch(float pitch);
     void addYaw(float yaw);
@@ -56,10 +139,45 @@ public:
     void setPosition(glm::vec3 position);
 
 private:
-    void loadModel(const std::string& path);
-    void processNode(aiNode* node, const aiScene* scene);
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene);
-    std::vector<texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, const std::string& typeName);
+    struct LodBucket {
+        unsigned int first;
+        unsigned int count;
+    };
+
+    GLBuffer instanceBuffer;
+    // largest error over the meshes per level, model units
+    std::vector<float> lodErrors;
+    // around localCentre, for the distance test
+    float lodRadius = 0.0f;
+    static const uint8_t INSTANCE_HIDDEN = 0xff;
+    std::vector<glm::mat4> instanceTransforms;
+    // world boxes of the instances, for the culler
+    BoxList instanceBoxes;
+    std::vector<uint8_t> instanceVisible;
+    // level per instance, or INSTANCE_HIDDEN when culled
+    std::vector<uint8_t> instanceLod;
+    std::vector<LodBucket> lodBuckets;
+    // instance matrices in bucket order, as uploaded
+    std::vector<glm::mat4> bucketedTransforms;
+    bool instancesChanged = false;
+    // set by setInstanceTransforms
+    bool streamedInstances = false;
+    bool instancesMoved = false;
+    // as of the last bucketing
+    bool bucketsStreamed = false;
+    // where streamInstances put this frame's matrices, NO_SPACE when it did not
+    size_t streamOffset = StreamRing::NO_SPACE;
+    size_t bucketedAmount = 0;
+
+    void computeLodBounds();
+    void buildInstanceBoxes();
+    // points locations 3-6 of the bound VAO at the bound GL_ARRAY_BUFFER from offset bytes on
+    void bindInstanceAttributes(size_t offset);
+
+    static void processNode(aiNode* node, const aiScene* scene, ModelData& data);
+    static MeshData processMesh(aiMesh* mesh, const aiScene* scene);
+    static void collectMaterialTextures(aiMaterial* mat, aiTextureType type, const std::string& typeName, std::vector<texture>& textures);
+    std::vector<texture> loadMaterialTextures(const std::vector<texture>& refs);
 };
 
 #endif // MODEL_H
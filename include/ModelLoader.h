@@ -0,0 +1,41 @@
+#ifndef INCLUDE_MODELLOADER_H_
+#define INCLUDE_MODELLOADER_H_
+
+#include "Model.h"
+#include "utils/JobSystem.h"
+#include <future>
+#include <memory>
+#include <string>
+
+// Parses models on the job system and builds them on the caller's thread.
+// Request everything up front, do other start-up work, then create() each
+// model; only the GL uploads and texture loads happen on the main thread.
+class ModelLoader {
+public:
+    using Handle = std::future<ModelData>;
+
+    explicit ModelLoader(JobSystem& jobSystem = jobs());
+
+    Handle request(const std::string& path);
+    // Blocks until the parse behind handle finishes, then uploads it. Consumes the handle.
+    std::shared_ptr<Model> create(Handle& handle, glm::mat4 translation, glm::vec3 position, int id, float pitch,
+        float yaw, float roll, bool gamma = false, MeshResidency residency = MeshResidency::GpuOnly);
+
+    int requested = 0;
+    int created = 0;
+    int cacheHits = 0;
+    // Summed worker parse time versus time the caller actually sat waiting.
+    float parseMilliseconds = 0.0f;
+    float waitMilliseconds = 0.0f;
+    float uploadMilliseconds = 0.0f;
+    // GPU vertex memory with the packed layouts versus the full vertex struct
+    size_t vertexBytes = 0;
+    size_t fullVertexBytes = 0;
+    // mesh data still held on the CPU after upload
+    size_t residentBytes = 0;
+
+private:
+    JobSystem& m_jobs;
+};
+
+#endif // INCLUDE_MODELLOADER_H_
@@ -0,0 +1,131 @@
+#ifndef INCLUDE_PARTICLES_H_
+#define INCLUDE_PARTICLES_H_
+
+#include "Shader.h"
+#include "StreamBuffer.h"
+#include "utils/GLHandle.h"
+#include "utils/Random.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <vector>
+
+// Particles simulated per job; a multiple of four so no SIMD group is
+// shared between two workers.
+const size_t PARTICLE_CHUNK = 32768;
+
+static_assert(PARTICLE_CHUNK % 4 == 0, "chunks hold whole SIMD groups");
+
+struct ParticleForces {
+    glm::vec3 gravity = glm::vec3(0.0f, -9.81f, 0.0f);
+    glm::vec3 wind = glm::vec3(0.0f);
+    // how fast velocity settles on the wind, per second
+    float drag = 0.0f;
+    // particles below this die, like rain reaching the ground
+    float killBelow = -std::numeric_limits<float>::infinity();
+};
+
+// Spawns particles in a box at a steady rate. Bursts go through
+// ParticleSystem::emit with the same description.
+struct ParticleEmitter {
+    glm::vec3 position = glm::vec3(0.0f);
+    // half size of the spawn box
+    glm::vec3 extent = glm::vec3(0.0f);
+    glm::vec3 velocity = glm::vec3(0.0f);
+    // each axis varies by up to this much either way
+    glm::vec3 velocityJitter = glm::vec3(0.0f);
+    float minLife = 1.0f;
+    float maxLife = 1.0f;
+    // per second
+    float rate = 0.0f;
+    bool enabled = true;
+    // fraction of a particle carried over to the next frame
+    float pending = 0.0f;
+};
+
+// How a system's particles are drawn.
+struct ParticleLook {
+    glm::vec4 colour = glm::vec4(1.0f);
+    // half width of a sprite, in world units
+    float size = 0.1f;
+    // world-space offset from head to tail; zero draws round sprites
+    glm::vec3 streak = glm::vec3(0.0f);
+    // alpha fades over the last this many seconds of life
+    float fade = 0.2f;
+    bool additive = false;
+};
+
+struct ParticleStats {
+    size_t alive = 0;
+    size_t spawned = 0;
+    size_t died = 0;
+    // spawns turned away because the pool was full
+    size_t dropped = 0;
+    size_t chunks = 0;
+    float milliseconds = 0.0f;
+};
+
+// A fixed pool of particles in structure-of-arrays form. update steps every
+// live particle with four-wide SIMD, one chunk per job, swaps the dead out
+// to keep the pool dense, then lets the emitters top it up. Drawing data is
+// packed as it goes, one vec4 (position, remaining life) per particle. No GL.
+class ParticleSystem {
+public:
+    explicit ParticleSystem(size_t capacity, uint64_t seed = 0);
+
+    std::vector<ParticleEmitter> emitters;
+    ParticleForces forces;
+    ParticleLook look;
+
+    void update(float dt);
+    // Spawns count particles now; returns how many fit.
+    size_t emit(const ParticleEmitter& emitter, size_t count);
+    void clear() { m_size = 0; }
+
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_capacity; }
+    const glm::vec4* instances() const { return m_instances.data(); }
+    const ParticleStats& stats() const { return m_stats; }
+
+private:
+    size_t m_capacity;
+    size_t m_size = 0;
+    std::vector<float> m_posX, m_posY, m_posZ;
+    std::vector<float> m_velX, m_velY, m_velZ;
+    std::vector<float> m_life;
+    std::vector<glm::vec4> m_instances;
+    // indices that died this frame, one list per chunk
+    std::vector<std::vector<uint32_t>> m_dead;
+    rng::Stream m_random;
+    ParticleStats m_stats;
+
+    void simulate(size_t begin, size_t end, float dt, std::vector<uint32_t>& dead);
+    void removeAt(size_t index);
+};
+
+// Draws particle systems as camera-facing quads, one instance per
+// particle. Needs a GL context.
+class ParticleSprites {
+public:
+    ParticleSprites();
+
+    // Copies the system's instances into the frame's ring, before its writes
+    // are finished. No GL; StreamRing::NO_SPACE when there was nothing to
+    // copy or no room.
+    static size_t upload(const ParticleSystem& system, StreamBuffer& stream);
+
+    // Sets the camera and blend state for a run of draws.
+    void begin(Shader& shader, const glm::mat4& projection, const glm::mat4& view);
+    // offset is what upload returned for the system this frame.
+    void draw(const ParticleSystem& system, Shader& shader, const StreamBuffer& stream, size_t offset);
+    void end();
+
+private:
+    GLVertexArray m_vao;
+    GLBuffer m_corners;
+    // respecified by a draw the ring had no room for
+    GLBuffer m_instances;
+};
+
+#endif // INCLUDE_PARTICLES_H_
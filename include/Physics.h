@@ -9,8 +9,7 @@
 #include <memory>
 #include <unordered_map>
 #include <vector>
-#include <random>
-#include <ctime>
+#include "utils/Random.h"
 
 #define DAMPENING 0.96f
 #define GRAVITY 9.8f
@@ -22,11 +21,10 @@ namespace physics {
 class PhysicsWorld {
     std::unordered_map<int, std::shared_ptr<Object>> objects = {};
     std::vector<std::shared_ptr<Object>> enemies = {};  // Separate list for enemies
-    std::default_random_engine generator;  // Random number generator
-
     struct EnemyMovement {
         glm::vec3 direction;
         float timeRemaining;
+        rng::Stream stream;  // per-enemy, so wander paths do not depend on update order
     };
 
     std::unordered_map<int, EnemyMovement> enemyMovements;  // Map to track enemy movement directions and times
@@ -35,10 +33,12 @@ public:
     Collider collider;
     std::vector<std::shared_ptr<Object>> triggers = {};
     std::vector<std::shared_ptr<Bullet>> bullets = {};
+    // where bullets stopped, for effects; the game empties it
+    std::vector<glm::vec3> impacts = {};
+    // the subset that hit the ground, which the game turns into craters
+    std::vector<glm::vec3> groundImpacts = {};
 
-    PhysicsWorld() {
-        generator.seed(static_cast<unsigned>(std::time(0)));  // Seed random number generator
-    }
+    PhysicsWorld() = default;
 
     void fireBullet(glm::vec3 position, glm::vec3 direction, float speed = 500.0f) {
         glm::vec3 velocity = glm::normalize(direction) * speed;
@@ -200,15 +200,19 @@ public:
     }
 
     void chooseNewDirection(int enemyId) {
-        std::uniform_real_distribution<float> directionDist(-1.0f, 1.0f);
-        std::uniform_real_distribution<float> timeDist(2.0f, 5.0f);  // Random time between 2 and 5 seconds
-
-        glm::vec3 direction(directionDist(generator), 0.0f, directionDist(generator));
+        auto found = enemyMovements.find(enemyId);
+        rng::Stream stream = found != enemyMovements.end()
+                                 ? found->second.stream
+                                 : rng::stream(rng::Subsystem::Physics, static_cast<uint64_t>(enemyId));
+
+        float dx = stream.range(-1.0f, 1.0f);
+        float dz = stream.range(-1.0f, 1.0f);
+        glm::vec3 direction(dx, 0.0f, dz);
         direction = glm::normalize(direction);  // Normalize to get a unit vector
 
-        float time = timeDist(generator);
+        float time = stream.range(2.0f, 5.0f);  // Random time between 2 and 5 seconds
 
-        enemyMovements[enemyId] = {direction, time};
+        enemyMovements[enemyId] = {direction, time, stream};
     }
 
     void updateEnemyMovements(float dt, Terrain &terrain) {
@@ -253,6 +257,22 @@ public:
 
     void tick(float dt, Terrain &terrain) {
         std::vector<std::shared_ptr<Bullet>> toRemove = {};
+
+        // Bullets stop at the ground: one batched terrain query for this tick's segments.
+        std::vector<TerrainRay> bulletRays(bullets.size());
+        std::vector<TerrainHit> bulletHits(bullets.size());
+        for (size_t i = 0; i < bullets.size(); i++) {
+            bulletRays[i] = {bullets[i]->position, bullets[i]->velocity, glm::length(bullets[i]->velocity) * dt};
+        }
+        terrain.raycast(bulletRays.data(), bulletHits.data(), bulletRays.size());
+        for (size_t i = 0; i < bullets.size(); i++) {
+            if (bulletHits[i].hit) {
+                toRemove.push_back(bullets[i]);
+                impacts.push_back(bulletHits[i].point);
+                groundImpacts.push_back(bulletHits[i].point);
+            }
+        }
+
         auto it = bullets.begin();
         while (it != bullets.end()) {
             auto &bullet = *it;
@@ -263,6 +283,7 @@ public:
                 for (auto &[id, object]: objects) {
                     if (object->boundingBox->intersects(nextPosition)) {
                         toRemove.push_back(bullet);
+                        impacts.push_back(nextPosition);
                         hit = true;
                         break;
                     }
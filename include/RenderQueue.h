@@ -0,0 +1,155 @@
+#ifndef INCLUDE_RENDERQUEUE_H_
+#define INCLUDE_RENDERQUEUE_H_
+
+#include "Mesh.h"
+#include "Shader.h"
+#include "StreamBuffer.h"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+// Where submitted draws go. The GL backend issues the calls; the recording
+// one only writes them down, so building, sorting and state filtering can be
+// checked without a context.
+class RenderBackend {
+public:
+    virtual ~RenderBackend() = default;
+    virtual void useProgram(const Shader& shader) = 0;
+    virtual int uniformLocation(const Shader& shader, UniformKey key) = 0;
+    virtual void setInt(int location, int value) = 0;
+    virtual void setMat4(int location, const glm::mat4& value) = 0;
+    virtual void bindTexture(unsigned int unit, unsigned int texture) = 0;
+    virtual void bindVertexArray(unsigned int vao) = 0;
+    virtual void bindUniformRange(unsigned int binding, unsigned int buffer, size_t offset, size_t size) = 0;
+    virtual void drawElements(unsigned int indexCount, unsigned int firstIndex) = 0;
+};
+
+class GLRenderBackend : public RenderBackend {
+public:
+    void useProgram(const Shader& shader) override;
+    int uniformLocation(const Shader& shader, UniformKey key) override;
+    void setInt(int location, int value) override;
+    void setMat4(int location, const glm::mat4& value) override;
+    void bindTexture(unsigned int unit, unsigned int texture) override;
+    void bindVertexArray(unsigned int vao) override;
+    void bindUniformRange(unsigned int binding, unsigned int buffer, size_t offset, size_t size) override;
+    void drawElements(unsigned int indexCount, unsigned int firstIndex) override;
+};
+
+class RecordingRenderBackend : public RenderBackend {
+public:
+    enum class Op {
+        UseProgram,
+        SetInt,
+        SetMat4,
+        BindTexture,
+        BindVertexArray,
+        BindUniformRange,
+        DrawElements,
+    };
+    struct Call {
+        Op op;
+        unsigned int a;
+        unsigned int b;
+    };
+    std::vector<Call> calls;
+
+    void useProgram(const Shader& shader) override { calls.push_back({ Op::UseProgram, shader.id(), 0 }); }
+    // low bits of the name hash stand in for a location
+    int uniformLocation(const Shader&, UniformKey key) override { return (int)(key.hash & 0x7fffffff); }
+    void setInt(int location, int value) override { calls.push_back({ Op::SetInt, (unsigned int)location, (unsigned int)value }); }
+    void setMat4(int location, const glm::mat4&) override { calls.push_back({ Op::SetMat4, (unsigned int)location, 0 }); }
+    void bindTexture(unsigned int unit, unsigned int texture) override { calls.push_back({ Op::BindTexture, unit, texture }); }
+    void bindVertexArray(unsigned int vao) override { calls.push_back({ Op::BindVertexArray, vao, 0 }); }
+    void bindUniformRange(unsigned int binding, unsigned int, size_t offset, size_t) override
+    {
+        calls.push_back({ Op::BindUniformRange, binding, (unsigned int)offset });
+    }
+    void drawElements(unsigned int indexCount, unsigned int firstIndex) override
+    {
+        calls.push_back({ Op::DrawElements, indexCount, firstIndex });
+    }
+};
+
+// Per-program state set once whenever a program becomes current.
+struct FrameUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::mat4 lightSpaceMatrix;
+};
+
+struct DrawCommand {
+    // program, material, VAO, depth; see makeDrawKey
+    uint64_t key;
+    const Shader* shader;
+    const Mesh* mesh;
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    // into the queue's transforms
+    unsigned int transform;
+};
+
+struct RenderQueueStats {
+    int draws = 0;
+    int programChanges = 0;
+    int materialChanges = 0;
+    int vaoChanges = 0;
+    int textureBinds = 0;
+    int uniformSets = 0;
+    // bytes of model matrices written to the stream buffer
+    size_t streamedBytes = 0;
+    // binds and uniform sets a draw asked for that were already current
+    int avoided = 0;
+};
+
+// Packs the sort order into one integer: program in the top 8 bits, then
+// material (16), VAO (16) and view depth (24), so sorting the keys groups
+// draws by the most expensive state first and goes front to back inside a
+// group.
+uint64_t makeDrawKey(unsigned int program, unsigned int material, unsigned int vao, float depth);
+
+// LSD radix sort on the keys, eight bits a pass; passes where every key has
+// the same byte are skipped. Stable.
+void radixSortDraws(std::vector<DrawCommand>& commands, std::vector<DrawCommand>& scratch);
+
+// One frame's opaque, non-instanced draws. Filled, sorted, then submitted
+// with every bind that would not change anything skipped.
+class RenderQueue {
+public:
+    void clear();
+    unsigned int addTransform(const glm::mat4& transform);
+    void add(const Shader& shader, const Mesh& mesh, int lod, unsigned int transform, float depth);
+    void sort();
+    // Packs the matrices into the stream buffer, if any draw's program has
+    // the Object block, so a pass that only takes the plain uniform costs no
+    // stream space. Runs before the frame's writes are finished.
+    void upload(StreamBuffer& stream);
+    // Given the stream buffer upload packed into, programs with the Object
+    // block get a range bound per draw; the rest, or all of them when nothing
+    // was packed, fall back to the model uniform.
+    RenderQueueStats submit(RenderBackend& backend, const FrameUniforms& frame,
+        const StreamBuffer* stream = nullptr) const;
+
+    const std::vector<DrawCommand>& commands() const { return m_commands; }
+    size_t transformCount() const { return m_transforms.size(); }
+    // what submit may take from the stream buffer
+    size_t streamBytes(size_t uniformAlignment) const;
+
+private:
+    std::vector<DrawCommand> m_commands;
+    std::vector<DrawCommand> m_scratch;
+    std::vector<glm::mat4> m_transforms;
+    // dense per-frame ids for the key; GL names can be anything
+    std::vector<unsigned int> m_programs;
+    std::unordered_map<uint64_t, unsigned int> m_materials;
+    // where upload packed the matrices, NO_SPACE when it did not
+    size_t m_streamBase = StreamRing::NO_SPACE;
+    size_t m_streamStride = 0;
+    size_t m_streamedBytes = 0;
+
+    unsigned int programIndex(unsigned int program);
+    unsigned int materialIndex(const Mesh& mesh);
+};
+
+#endif // INCLUDE_RENDERQUEUE_H_
@@ -2,7 +2,16 @@
 #define INCLUDE_RENDERER_H_
 
 #include "Camera.h"
+#include "ClusteredLights.h"
+#include "Frustum.h"
+#include "Lighting.h"
 #include "Model.h"
+#include "Particles.h"
+#include "RenderQueue.h"
+#include "ShadowCascades.h"
+#include "utils/JobSystem.h"
+#include <chrono>
+#include <future>
 #include <glm/ext/matrix_transform.hpp>
 #include <initializer_list>
 #include <memory>
@@ -16,17 +25,83 @@ private:
     glm::mat4& projection;
     glm::mat4 cameraMatrix;
     Terrain& terrain;
+    // model matrices, moving instances and lighting, rewritten every frame
+    StreamBuffer stream { std::make_unique<GLStreamBackend>(), 1 << 20 };
+    RenderQueue commands;
+    // per cascade: casters that move, and the static ones for the cache
+    RenderQueue shadowDynamic[SHADOW_CASCADES];
+    RenderQueue shadowStatic[SHADOW_CASCADES];
+    std::unique_ptr<ShadowCascades> shadowMaps;
+    // what each cascade's static layer was drawn with
+    glm::mat4 staticMatrices[SHADOW_CASCADES];
+    bool staticValid[SHADOW_CASCADES] = {};
+    unsigned int staticTerrainRevision = 0;
+    // a static caster moved, appeared or went away since the cache was drawn
+    bool staticCastersChanged = true;
+    GLRenderBackend backend;
+    LightingBlock lighting {};
+    ClusterBinner clusters;
+    std::unique_ptr<ClusterBuffers> clusterBuffers;
+    std::vector<const ParticleSystem*> particleSystems;
+    // where beginSubmit put each system's instances in the ring
+    std::vector<size_t> particleOffsets;
+    std::unique_ptr<ParticleSprites> particleSprites;
+    // what prepareFrame captured, so submission never reads the live camera
+    struct PreparedFrame {
+        FrameUniforms uniforms;
+        CameraLens lens;
+        glm::vec3 eye;
+        float pixelsPerUnit;
+        Cascade cascades[SHADOW_CASCADES];
+        bool staticStale[SHADOW_CASCADES];
+        ShadowBlock shadows;
+    } frame {};
+    struct CulledModel {
+        unsigned int shader;
+        const Model* model;
+        glm::mat4 transform;
+    };
+    std::vector<CulledModel> cullModels;
+    std::vector<Model*> instancedModels;
+    std::vector<Transform*> dirtyTransforms;
+    BoxList cullBoxesList;
+    std::vector<uint8_t> cullVisible;
 
 public:
     bool lightning = false;
-    std::vector<glm::vec3> pointLightPositions = {};
+    // binned into the cluster grid every frame; lamps first, anything that
+    // moves can be added or rewritten between frames
+    std::vector<PointLight> pointLights = {};
     glm::vec3 lightPos;
     std::shared_ptr<Camera> cam;
-    glm::mat4 lightSpaceMatrix;
     bool torch = false;
     glm::vec3 torchPos = glm::vec3(0.0f, 0.0f, 0.0f);
+    // drives the screen-space LOD choice and the cluster tiles
+    float viewportWidth = 1280.0f;
+    float viewportHeight = 720.0f;
+    // from the last renderAll
+    size_t trianglesDrawn = 0;
+    size_t trianglesFull = 0;
+    RenderQueueStats commandStats;
+    // model matrices rebuilt while preparing the last frame
+    size_t transformsRebuilt = 0;
+    size_t lastTransformsRebuilt = 0;
+    struct CullStats {
+        size_t meshesTested = 0;
+        size_t meshesVisible = 0;
+        size_t instancesTested = 0;
+        size_t instancesVisible = 0;
+        // all of prepareFrame
+        float milliseconds = 0.0f;
+    } cullStats;
+    struct ShadowStats {
+        size_t dynamicCasters[SHADOW_CASCADES] = {};
+        size_t staticCasters[SHADOW_CASCADES] = {};
+        // cascades whose static layer was drawn again last frame
+        int staticRedraws = 0;
+    } shadowStats;
 
-    Renderer(glm::mat4 projection, std::shared_ptr<Camera> cam, Terrain& terrain)
+    Renderer(glm::mat4& projection, std::shared_ptr<Camera> cam, Terrain& terrain)
         : projection(projection)
         , cam(std::move(cam))
         , terrain(terrain)
@@ -39,10 +114,13 @@ public:
         lightning = !lightning;
     }
 
-    void addLampPointLight(glm::vec3 position)
+    void addLampPointLight(glm::vec3 position, float linear = 0.009f)
     {
-        position.y += 25;
-        pointLightPositions.push_back(position);
+        PointLight light;
+        light.position = position;
+        light.position.y += 25;
+        light.linear = linear;
+        pointLights.push_back(light);
     }
     void enqueue(const Shader& shader, std::initializer_list<std::shared_ptr<Model>> model)
     {
@@ -50,125 +128,389 @@ public:
             renderQueue[shader.ID][m->id] = m;
             shaders[shader.ID] = std::make_shared<Shader>(shader);
         }
+        staticCastersChanged = true;
     }
 
     void enqueue(const Shader& shader, const std::shared_ptr<Model>& model)
     {
         renderQueue[shader.ID][model->id] = model;
         shaders[shader.ID] = std::make_shared<Shader>(shader);
+        staticCastersChanged = staticCastersChanged || model->staticShadow;
     }
 
-    void lightingShader(Shader& lightingShader)
+    // Fills the shared Lighting block for this frame; every lit program reads
+    // it from the same binding, so this replaces per-program setVec3 calls.
+    // CPU only, beginSubmit binds it.
+    void prepareLighting()
     {
-        lightingShader.setVec3("lightPos", lightPos);
-        lightingShader.setVec3("viewPos", cam->position);
-        lightingShader.setFloat("shininess", 30.0f);
+        LightingBlock block {};
+        block.lightPos = lightPos;
+        block.viewPos = cam->position;
+        block.shininess = 30.0f;
 
-        lightingShader.setVec3("dirLight.direction", lightPos);
+        block.dirLight.direction = lightPos;
         if (lightning) {
-            lightingShader.setVec3("dirLight.ambient", 0.25f, 0.21f, 0.11f);
+            block.dirLight.ambient = glm::vec3(0.25f, 0.21f, 0.11f);
         } else {
-            lightingShader.setVec3("dirLight.ambient", 0.2f, 0.2f, 0.2f);
-        }
-
-        lightingShader.setBool("torch", torch);
-        lightingShader.setVec3("spotLight.position", torchPos);
-        lightingShader.setVec3("spotLight.direction", cam->front);
-        lightingShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-        lightingShader.setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-        lightingShader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setFloat("spotLight.constant", 1.0f);
-        lightingShader.setFloat("spotLight.linear", 0.0009f);
-        lightingShader.setFloat("spotLight.quadratic", 0.00032f);
-        lightingShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(20.5f)));
-        lightingShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(25.0f)));
-        lightingShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-        lightingShader.setVec3("dirLight.specular", 0.8f, 0.8f, 0.8f);
-        lightingShader.setBool("lightning", lightning);
-
-        // Set first point light properties
-        lightingShader.setVec3("pointLights[0].position", pointLightPositions[0]);
-        lightingShader.setVec3("pointLights[0].ambient", 0.6f, 0.6f, 0.6f);
-        lightingShader.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-        lightingShader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setFloat("pointLights[0].constant", 1.0f);
-        lightingShader.setFloat("pointLights[0].linear", 0.009f);
-        lightingShader.setFloat("pointLights[0].quadratic", 0.0032f);
-
-        // Set second point light properties
-        lightingShader.setVec3("pointLights[1].position", pointLightPositions[1]);
-        lightingShader.setVec3("pointLights[1].ambient", 0.6f, 0.6f, 0.6f);
-        lightingShader.setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-        lightingShader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setFloat("pointLights[1].constant", 1.0f);
-        lightingShader.setFloat("pointLights[1].linear", 0.09f);
-        lightingShader.setFloat("pointLights[1].quadratic", 0.0032f);
-
-        lightingShader.setVec3("pointLights[2].position", pointLightPositions[2]);
-        lightingShader.setVec3("pointLights[2].ambient", 0.6f, 0.6f, 0.6f);
-        lightingShader.setVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-        lightingShader.setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setFloat("pointLights[2].constant", 1.0f);
-        lightingShader.setFloat("pointLights[2].linear", 0.009f);
-        lightingShader.setFloat("pointLights[2].quadratic", 0.0032f);
+            block.dirLight.ambient = glm::vec3(0.2f, 0.2f, 0.2f);
+        }
+        block.dirLight.diffuse = glm::vec3(0.4f, 0.4f, 0.4f);
+        block.dirLight.specular = glm::vec3(0.8f, 0.8f, 0.8f);
+        block.lightning = lightning;
+
+        block.torch = torch;
+        block.spotLight.position = torchPos;
+        block.spotLight.direction = cam->front;
+        block.spotLight.ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+        block.spotLight.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+        block.spotLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        block.spotLight.constant = 1.0f;
+        block.spotLight.linear = 0.0009f;
+        block.spotLight.quadratic = 0.00032f;
+        block.spotLight.cutOff = glm::cos(glm::radians(20.5f));
+        block.spotLight.outerCutOff = glm::cos(glm::radians(25.0f));
+        block.clusterScale = glm::vec2(CLUSTER_X / viewportWidth, CLUSTER_Y / viewportHeight);
+        lighting = block;
+    }
+
+    // Drawn after everything opaque, in the order added. The game updates
+    // them; update must not run while renderParticles does.
+    void addParticles(const ParticleSystem& system)
+    {
+        particleSystems.push_back(&system);
     }
 
     void addModel(int shaderId, const std::shared_ptr<Model>& model)
     {
         renderQueue[shaderId][model->id] = model;
+        staticCastersChanged = staticCastersChanged || model->staticShadow;
     }
 
     void removeModel(unsigned int shaderId, const std::shared_ptr<Model>& model)
     {
         renderQueue[shaderId].erase(model->id);
+        staticCastersChanged = staticCastersChanged || model->staticShadow;
     }
 
-    void renderShadowMap(Shader& shader)
+    // Syncs every plain model's transform and rebuilds the ones that moved,
+    // in one batch. Cheap when nothing did.
+    void updateModelTransforms()
+    {
+        dirtyTransforms.clear();
+        for (auto& [key, value] : renderQueue) {
+            for (auto& [key, modelPtr] : value) {
+                if (!modelPtr->isInstanced) {
+                    modelPtr->syncTransform();
+                    staticCastersChanged = staticCastersChanged || (modelPtr->staticShadow && modelPtr->transform.dirty);
+                    dirtyTransforms.push_back(&modelPtr->transform);
+                }
+            }
+        }
+        transformsRebuilt += updateTransforms(dirtyTransforms.data(), dirtyTransforms.size());
+    }
+
+    // Picks every plain model's level of detail for this frame's camera.
+    void selectLods()
     {
         for (auto& [key, value] : renderQueue) {
-            for (auto [key, modelPtr] : value) {
+            for (auto& [key, modelPtr] : value) {
+                if (!modelPtr->isInstanced) {
+                    modelPtr->selectLod(frame.eye, frame.pixelsPerUnit);
+                }
+            }
+        }
+    }
 
-                if (modelPtr->isInstanced)
+    // Culls the plain models' meshes against the camera and records the
+    // sorted main pass. Runs on a worker.
+    void recordMainPass(const Frustum& frustum)
+    {
+        // World boxes for every mesh of every plain model, culled in one
+        // batch; one matrix per model, shared by all of its meshes.
+        cullBoxesList.clear();
+        for (const auto& entry : cullModels) {
+            for (const auto& mesh : entry.model->meshes) {
+                glm::vec3 centre, extent;
+                transformBox(entry.transform, mesh.boundingbox->position, mesh.boundingbox->extents, centre, extent);
+                cullBoxesList.add(centre, extent);
+            }
+        }
+        size_t visibleMeshes = cullBoxes(frustum, cullBoxesList, cullVisible);
+
+        commands.clear();
+        size_t box = 0;
+        trianglesDrawn = 0;
+        trianglesFull = 0;
+        for (const auto& entry : cullModels) {
+            const Model& model = *entry.model;
+            unsigned int transform = ~0u;
+            float depth = glm::length(model.position - frame.eye);
+            for (const auto& mesh : model.meshes) {
+                trianglesFull += mesh.level(0).indexCount / 3;
+                if (!cullVisible[box++]) {
                     continue;
-                auto model = glm::mat4(1.0f);
-                model = glm::translate(model, modelPtr->position);
-                model = glm::rotate(model, glm::radians(modelPtr->yaw), glm::vec3(0, 1, 0));
-                model = glm::rotate(model, glm::radians(modelPtr->pitch), glm::vec3(1, 0, 0));
-                model = glm::rotate(model, glm::radians(modelPtr->roll), glm::vec3(0, 0, 1));
-                shader.setMat4("model", model);
-                modelPtr->draw(shader);
+                }
+                if (transform == ~0u) {
+                    transform = commands.addTransform(entry.transform);
+                }
+                commands.add(*shaders.at(entry.shader), mesh, model.lod, transform, depth);
+                trianglesDrawn += mesh.level(model.lod).indexCount / 3;
+            }
+        }
+        commands.sort();
+        cullStats.meshesTested = cullBoxesList.size();
+        cullStats.meshesVisible = visibleMeshes;
+    }
+
+    // Culls the casters against one cascade. Static ones are only recorded
+    // when the cascade's cached layer has to be drawn again. Runs on a
+    // worker, one job per cascade, each with its own queues.
+    void recordShadowCascade(int cascade, const Shader& shader)
+    {
+        Frustum frustum = Frustum::fromMatrix(frame.cascades[cascade].lightSpace);
+        RenderQueue& dynamicQueue = shadowDynamic[cascade];
+        RenderQueue& staticQueue = shadowStatic[cascade];
+        dynamicQueue.clear();
+        staticQueue.clear();
+        size_t dynamicCasters = 0;
+        size_t staticCasters = 0;
+        for (const auto& entry : cullModels) {
+            const Model& model = *entry.model;
+            if (model.staticShadow && !frame.staticStale[cascade]) {
+                continue;
             }
+            glm::vec3 centre, extent;
+            transformBox(entry.transform, model.localCentre, model.localExtent, centre, extent);
+            if (!frustum.intersects(centre, extent)) {
+                continue;
+            }
+            RenderQueue& queue = model.staticShadow ? staticQueue : dynamicQueue;
+            (model.staticShadow ? staticCasters : dynamicCasters)++;
+            unsigned int transform = queue.addTransform(entry.transform);
+            for (const auto& mesh : model.meshes) {
+                queue.add(shader, mesh, model.lod, transform, 0.0f);
+            }
+        }
+        dynamicQueue.sort();
+        staticQueue.sort();
+        shadowStats.dynamicCasters[cascade] = dynamicCasters;
+        shadowStats.staticCasters[cascade] = staticCasters;
+    }
+
+    // Fits the cascades to this frame's view and works out which cached
+    // static layers no longer match.
+    void prepareShadows()
+    {
+        fitCascades(frame.uniforms.view, frame.lens, lightPos, frame.cascades);
+        bool invalidate = staticCastersChanged || terrain.editRevision != staticTerrainRevision;
+        for (int c = 0; c < SHADOW_CASCADES; c++) {
+            frame.staticStale[c] = invalidate || !staticValid[c] || staticMatrices[c] != frame.cascades[c].lightSpace;
+            frame.shadows.cascades[c] = frame.cascades[c].lightSpace;
+            frame.shadows.splits[c] = frame.cascades[c].farDepth;
         }
+        frame.shadows.cameraForward = glm::vec4(glm::normalize(cam->front), 0.0f);
+        // the flags are consumed by this frame's redraw
+        staticCastersChanged = false;
+        staticTerrainRevision = terrain.editRevision;
+    }
+
+    // CPU half of a frame: LOD selection, culling, matrix packing and
+    // sorting for the shadow and main passes, the lighting block and the
+    // point light clusters.
+    // Everything the GL half needs is copied out of the scene, so the
+    // simulation can move on while renderShadowMap and renderAll submit.
+    // The passes and each instanced model are recorded as separate jobs and
+    // joined in a fixed order, so the result never depends on scheduling.
+    void prepareFrame(const Shader& shadowShader)
+    {
+        auto cullStart = std::chrono::steady_clock::now();
+        frame.uniforms = { projection, cam->getCameraView(), glm::mat4(1.0f) };
+        frame.lens = lensFromProjection(projection);
+        frame.eye = cam->position;
+        // pixels covered by one unit at distance one
+        frame.pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f;
+        Frustum frustum = Frustum::fromMatrix(frame.uniforms.projection * frame.uniforms.view);
+
+        selectLods();
+        updateModelTransforms();
+        prepareLighting();
+        prepareShadows();
+        cullModels.clear();
+        instancedModels.clear();
+        for (auto& [program, value] : renderQueue) {
+            for (auto& [key, modelPtr] : value) {
+                if (modelPtr->isInstanced) {
+                    instancedModels.push_back(modelPtr.get());
+                } else {
+                    cullModels.push_back({ program, modelPtr.get(), modelPtr->transform.world });
+                }
+            }
+        }
+
+        std::vector<std::future<void>> recording;
+        recording.push_back(jobs().submit([this, frustum] { recordMainPass(frustum); }));
+        recording.push_back(jobs().submit([this] {
+            clusters.bin(frame.uniforms.view, frame.lens, pointLights.data(), pointLights.size());
+        }));
+        for (int c = 0; c < SHADOW_CASCADES; c++) {
+            recording.push_back(jobs().submit([this, c, &shadowShader] { recordShadowCascade(c, shadowShader); }));
+        }
+        for (Model* model : instancedModels) {
+            recording.push_back(jobs().submit([this, model, frustum] {
+                model->updateInstances(frustum, frame.eye, frame.pixelsPerUnit);
+            }));
+        }
+        for (auto& job : recording) {
+            job.get();
+        }
+
+        cullStats.instancesTested = 0;
+        cullStats.instancesVisible = 0;
+        for (const Model* model : instancedModels) {
+            cullStats.instancesTested += model->instanceAmount;
+            cullStats.instancesVisible += model->visibleInstances;
+        }
+        lastTransformsRebuilt = transformsRebuilt;
+        transformsRebuilt = 0;
+        cullStats.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - cullStart).count();
+    }
+
+    // The view the prepared frame was recorded with; the simulation may
+    // already have moved the camera on.
+    const glm::mat4& frameView() const { return frame.uniforms.view; }
+
+    // Brackets the GL half of a frame: everything drawn in between may take
+    // per-frame data from the stream buffer, and the region is fenced after.
+    // All of the frame's ring writes happen here, up front: without
+    // persistent mapping the region is mapped while they run, and no draw
+    // may read a buffer that is mapped.
+    void beginSubmit()
+    {
+        size_t alignment = stream.uniformAlignment();
+        size_t bytes = commands.streamBytes(alignment) + sizeof(LightingBlock) + sizeof(ShadowBlock) + 2 * alignment;
+        for (int c = 0; c < SHADOW_CASCADES; c++) {
+            bytes += shadowDynamic[c].streamBytes(alignment) + shadowStatic[c].streamBytes(alignment);
+        }
+        for (const Model* model : instancedModels) {
+            bytes += model->streamedBytes() + sizeof(glm::vec4);
+        }
+        for (const ParticleSystem* system : particleSystems) {
+            bytes += system->size() * sizeof(glm::vec4) + sizeof(glm::vec4);
+        }
+        stream.beginFrame(bytes);
+        bindLighting(stream, lighting);
+        bindShadows(stream, frame.shadows);
+        commands.upload(stream);
+        for (int c = 0; c < SHADOW_CASCADES; c++) {
+            // renderShadowMap only draws the static layer when it is stale
+            if (frame.staticStale[c]) {
+                shadowStatic[c].upload(stream);
+            }
+            shadowDynamic[c].upload(stream);
+        }
+        for (Model* model : instancedModels) {
+            model->streamInstances(stream);
+        }
+        particleOffsets.clear();
+        for (const ParticleSystem* system : particleSystems) {
+            particleOffsets.push_back(ParticleSprites::upload(*system, stream));
+        }
+        stream.finishWrites();
+    }
+
+    void endSubmit()
+    {
+        stream.endFrame();
+    }
+
+    const StreamStats& streamStats() const { return stream.stats(); }
+    const ClusterStats& clusterStats() const { return clusters.stats(); }
+
+    // Draws every cascade with the depth shader. A stale static layer is
+    // drawn again first, terrain included; then the live layer starts from
+    // the static depth and only the moving casters are added on top.
+    void renderShadowMap(Shader& shader)
+    {
+        if (!shadowMaps) {
+            shadowMaps = std::make_unique<ShadowCascades>();
+        }
+        shadowStats.staticRedraws = 0;
+        for (int c = 0; c < SHADOW_CASCADES; c++) {
+            FrameUniforms uniforms = frame.uniforms;
+            uniforms.lightSpaceMatrix = frame.cascades[c].lightSpace;
+            if (frame.staticStale[c]) {
+                shadowMaps->beginStatic(c);
+                shadowStatic[c].submit(backend, uniforms, &stream);
+                shader.use();
+                shader.setMat4("lightSpaceMatrix", uniforms.lightSpaceMatrix);
+                shader.setMat4("model", glm::translate(glm::mat4(1.0f), terrain.terposition));
+                terrain.renderShadow();
+                staticMatrices[c] = uniforms.lightSpaceMatrix;
+                staticValid[c] = true;
+                shadowStats.staticRedraws++;
+            }
+            shadowMaps->beginCascade(c);
+            shadowDynamic[c].submit(backend, uniforms, &stream);
+        }
+        shadowMaps->end();
     }
 
     void renderAll()
     {
-        for (auto& [key, value] : renderQueue) {
-            auto shader = shaders.at(key);
+        if (shadowMaps) {
+            shadowMaps->bindTexture(SHADOW_TEXTURE_UNIT);
+        }
+        if (!clusterBuffers) {
+            clusterBuffers = std::make_unique<ClusterBuffers>();
+            clusters.setIndexLimit(clusterBuffers->maxTexels());
+        }
+        clusterBuffers->upload(clusters);
+        clusterBuffers->bind(CLUSTER_TEXTURE_UNIT);
+        for (auto& [key, shader] : shaders) {
             shader->use();
+            shader->setInt("shadowMap", SHADOW_TEXTURE_UNIT);
+            shader->setInt("lightData", CLUSTER_TEXTURE_UNIT);
+            shader->setInt("clusterRanges", CLUSTER_TEXTURE_UNIT + 1);
+            shader->setInt("lightIndices", CLUSTER_TEXTURE_UNIT + 2);
+        }
+        commandStats = commands.submit(backend, frame.uniforms, &stream);
 
-            this->lightingShader(*shader);
-            shader->setMat4("projection", projection);
-            shader->setMat4("view", cam->getCameraView());
-            shader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
-            for (auto [key, modelPtr] : value) {
-                if (modelPtr->isInstanced) {
+        // Instanced models re-point their instance attributes per LOD bucket,
+        // which the command list has no notion of, so they keep their own path.
+        for (auto& [key, value] : renderQueue) {
+            auto shader = shaders.at(key);
+            bool bound = false;
+            for (auto& [key, modelPtr] : value) {
+                if (!modelPtr->isInstanced) {
+                    continue;
+                }
+                if (!bound) {
+                    shader->use();
+                    shader->setMat4("projection", frame.uniforms.projection);
+                    shader->setMat4("view", frame.uniforms.view);
                     shader->setBool("isInstanced", true);
-                    modelPtr->drawInstanced(*shader);
-                } else {
-                    shader->setBool("isInstanced", false);
-                    auto model = glm::mat4(1.0f);
-                    model = glm::translate(model, modelPtr->position);
-                    model = glm::rotate(model, glm::radians(modelPtr->yaw), glm::vec3(0, 1, 0));
-                    model = glm::rotate(model, glm::radians(modelPtr->pitch), glm::vec3(1, 0, 0));
-                    model = glm::rotate(model, glm::radians(modelPtr->roll), glm::vec3(0, 0, 1));
-                    shader->setMat4("model", model);
-                    modelPtr->draw(*shader);
+                    bound = true;
                 }
+                modelPtr->drawInstanced(*shader, &stream);
+                trianglesDrawn += modelPtr->drawnTriangles;
+                trianglesFull += modelPtr->fullTriangles;
             }
         }
     }
 
+    // Blended, so it goes after the terrain and the rest of the opaque scene.
+    void renderParticles(Shader& shader)
+    {
+        if (!particleSprites) {
+            particleSprites = std::make_unique<ParticleSprites>();
+        }
+        particleSprites->begin(shader, frame.uniforms.projection, frame.uniforms.view);
+        for (size_t i = 0; i < particleSystems.size(); i++) {
+            particleSprites->draw(*particleSystems[i], shader, stream, particleOffsets[i]);
+        }
+        particleSprites->end();
+    }
+
     void clear()
     {
         for (auto& [key, value] : renderQueue) {
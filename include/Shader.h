@@ -3,80 +3,177 @@
 
 #include <GL/glew.h>
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
 #include "glm/glm.hpp"
+#include "utils/Hash.h"
 
+// A uniform name with its hash. Literals convert implicitly and hash at
+// compile time, so a cached lookup is one map probe and never builds a
+// std::string. Names built at runtime have to be wrapped explicitly.
+struct UniformKey {
+    const char* name;
+    uint64_t hash;
+
+    template <size_t N>
+    constexpr UniformKey(const char (&name)[N])
+        : name(name)
+        , hash(hashLiteral(name))
+    {
+    }
+    constexpr UniformKey(const char* name, uint64_t hash)
+        : name(name)
+        , hash(hash)
+    {
+    }
+    explicit UniformKey(const std::string& name)
+        : name(name.c_str())
+        , hash(hashString(name))
+    {
+    }
+};
+
+// Per-draw uniform block holding the model matrix, so draws can point at a
+// range of the frame's stream buffer instead of uploading the matrix.
+const unsigned int OBJECT_BLOCK_BINDING = 1;
+const char* const OBJECT_BLOCK_NAME = "Object";
+
+// What every copy of a Shader shares, so the copies handed to the renderer
+// see a background link finish and a debug reload land.
+struct ShaderProgram {
+    // program in use; a debug reload swaps in its replacement
+    unsigned int id = 0;
+    std::unordered_map<uint64_t, int> locations;
+    bool objectBlock = false;
+    // compiled and linked but not yet checked; the shader objects are
+    // still attached
+    bool pending = false;
+    unsigned int vertex = 0;
+    unsigned int fragment = 0;
+    std::string vertexPath;
+    std::string fragmentPath;
+    // shaderCacheKey of the sources it was built from
+    uint64_t key = 0;
+};
+
+// Checks a pending program, stores its binary and binds its blocks.
+void finishShaderProgram(ShaderProgram& program);
+
+// Programs come from the binary cache when the driver accepts it. Otherwise
+// they are compiled without waiting on the result, so the driver can work on
+// several at once, and checked on first use or in finishPendingShaders.
 class Shader {
 public:
+    // The program the Shader was created with. It stays alive and keeps its
+    // name after a reload, so it is safe as a key; GL calls want id().
     unsigned int ID;
     Shader(const char* vertexPath, const char* fragmentPath);
+    unsigned int id() const { return program->id; }
     void use() const
     {
-        glUseProgram(ID);
+        finish();
+        glUseProgram(program->id);
+    }
+    // declares the Object block rather than a plain model uniform
+    bool objectBlock() const
+    {
+        finish();
+        return program->objectBlock;
+    }
+    // Looked up once per program; misses (-1) are cached too. Copies of a
+    // Shader share the cache.
+    int location(UniformKey key) const
+    {
+        finish();
+        auto found = program->locations.find(key.hash);
+        if (found != program->locations.end()) {
+            return found->second;
+        }
+        int location = glGetUniformLocation(program->id, key.name);
+        program->locations.emplace(key.hash, location);
+        return location;
     }
     // utility uniform functions
 
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    void setBool(UniformKey name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(location(name), (int)value);
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    void setInt(UniformKey name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(location(name), value);
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    void setFloat(UniformKey name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(location(name), value);
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
+    void setVec2(UniformKey name, const glm::vec2 &value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(location(name), 1, &value[0]);
     }
-    void setVec2(const std::string &name, float x, float y) const
+    void setVec2(UniformKey name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(location(name), x, y);
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
+    void setVec3(UniformKey name, const glm::vec3 &value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(location(name), 1, &value[0]);
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
+    void setVec3(UniformKey name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(location(name), x, y, z);
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
+    void setVec4(UniformKey name, const glm::vec4 &value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(location(name), 1, &value[0]);
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) const
+    void setVec4(UniformKey name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(location(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setMat2(UniformKey name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    void setMat3(UniformKey name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setMat4(UniformKey name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
-    void checkCompileErrors(unsigned int shader, const std::string& type);
+    // Prints the log and returns false when the shader or program failed.
+    static bool checkCompileErrors(unsigned int shader, const std::string& type);
+
+private:
+    std::shared_ptr<ShaderProgram> program;
 
+    void finish() const
+    {
+        if (program->pending) {
+            finishShaderProgram(*program);
+        }
+    }
 };
 
+// Checks every program still compiling, waiting on the driver where it has
+// to. Call once the startup shaders and other loading are under way.
+void finishPendingShaders();
+// Debug builds recompile shaders whose source changed on disk. Files are
+// checked on a worker and the new program is swapped in only once the driver
+// has finished it; a broken edit keeps the old one. Call once a frame. Does
+// nothing when NDEBUG is defined.
+void pollShaderReloads();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef INCLUDE_SHADERCACHE_H_
+#define INCLUDE_SHADERCACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Linked program binaries, one file per vertex/fragment pair under
+// SHADER_CACHE_DIR. The key hashes both sources together with the GL vendor,
+// renderer and version strings, so an edit or a driver update rebuilds from
+// source. Needs a GL context, except for the key of a driver that stores no
+// binaries.
+bool programBinariesSupported();
+uint64_t shaderCacheKey(const std::string& vertexSource, const std::string& fragmentSource);
+
+// Links program from the cached binary. False when there is none or the
+// driver rejects it; the program can still be compiled from source.
+bool loadProgramBinary(unsigned int program, const std::string& vertexPath, const std::string& fragmentPath,
+    uint64_t key);
+void storeProgramBinary(unsigned int program, const std::string& vertexPath, const std::string& fragmentPath,
+    uint64_t key);
+
+// The linked program's binary as the driver hands it out.
+bool readProgramBinary(unsigned int program, unsigned int& format, std::vector<unsigned char>& blob);
+
+#endif // INCLUDE_SHADERCACHE_H_
@@ -0,0 +1,95 @@
+#ifndef INCLUDE_SHADOWCASCADES_H_
+#define INCLUDE_SHADOWCASCADES_H_
+
+#include "StreamBuffer.h"
+#include <glm/glm.hpp>
+
+// Directional-light shadows split into cascades along the view: the near
+// cascade covers a few metres at full resolution, the last one reaches
+// SHADOW_DISTANCE. Each cascade lives in one layer of a depth texture array.
+const int SHADOW_CASCADES = 3;
+const int SHADOW_RESOLUTION = 1024;
+const float SHADOW_DISTANCE = 200.0f;
+// blend between logarithmic (1) and even (0) split distances
+const float SHADOW_SPLIT_LAMBDA = 0.75f;
+// casters this far towards the light from a cascade still land in it
+const float SHADOW_CASTER_DISTANCE = 150.0f;
+// Cascades move in steps of this many texels, so their matrices, and with
+// them the cached static depth, stay put while the camera moves inside one.
+const int SHADOW_SNAP_TEXELS = 32;
+// the material units of the render queue sit below this
+const unsigned int SHADOW_TEXTURE_UNIT = 4;
+const unsigned int SHADOW_BLOCK_BINDING = 2;
+const char* const SHADOW_BLOCK_NAME = "Shadows";
+
+// CPU copy of the std140 Shadows block in modelLoading.frag.glsl and
+// terrain.frag.glsl.
+struct ShadowBlock {
+    glm::mat4 cascades[SHADOW_CASCADES];
+    // far view depth of each cascade
+    glm::vec4 splits;
+    // view depth is measured along this from viewPos
+    glm::vec4 cameraForward;
+};
+
+static_assert(sizeof(ShadowBlock) == 64 * SHADOW_CASCADES + 32, "Shadows block layout");
+
+struct CameraLens {
+    float nearPlane;
+    float farPlane;
+    float tanHalfFovY;
+    float aspect;
+};
+
+// Reads the lens back out of a glm::perspective matrix.
+CameraLens lensFromProjection(const glm::mat4& projection);
+
+struct Cascade {
+    glm::mat4 lightSpace;
+    float nearDepth;
+    float farDepth;
+};
+
+// Fits one cascade per split of [near, min(far, SHADOW_DISTANCE)]. Each
+// cascade is a light-aligned box around the bounding sphere of its slice
+// of the view frustum: the sphere's size does not change as the camera
+// turns, and its centre is snapped to SHADOW_SNAP_TEXELS texels in light
+// space, so a texel always covers the same patch of world and edges do not
+// shimmer. lightDirection is the way the light travels.
+void fitCascades(const glm::mat4& view, const CameraLens& lens, const glm::vec3& lightDirection,
+    Cascade cascades[SHADOW_CASCADES]);
+
+// The depth texture array and its framebuffers. A second array keeps the
+// static casters' depth per cascade; while a cascade's matrix is unchanged
+// it is copied over instead of drawing the terrain and scenery again.
+// Needs a GL context.
+class ShadowCascades {
+public:
+    explicit ShadowCascades(int resolution = SHADOW_RESOLUTION);
+    ~ShadowCascades();
+
+    ShadowCascades(const ShadowCascades&) = delete;
+    ShadowCascades& operator=(const ShadowCascades&) = delete;
+
+    // Binds and clears the static cache layer of a cascade for drawing.
+    void beginStatic(int cascade);
+    // Binds the live layer of a cascade, starting from its static depth.
+    void beginCascade(int cascade);
+    // Back to the default framebuffer.
+    void end();
+    void bindTexture(unsigned int unit) const;
+    int resolution() const { return m_resolution; }
+
+private:
+    int m_resolution;
+    unsigned int m_live = 0;
+    unsigned int m_static = 0;
+    unsigned int m_liveFramebuffers[SHADOW_CASCADES] = {};
+    unsigned int m_staticFramebuffers[SHADOW_CASCADES] = {};
+};
+
+// Writes the block into this frame's stream buffer and points
+// SHADOW_BLOCK_BINDING at it. Needs a GL context.
+void bindShadows(StreamBuffer& stream, const ShadowBlock& block);
+
+#endif // INCLUDE_SHADOWCASCADES_H_
@@ -0,0 +1,188 @@
+#ifndef INCLUDE_STREAMBUFFER_H_
+#define INCLUDE_STREAMBUFFER_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Frames the ring is split between: the CPU writes one region while the GPU
+// may still be reading the other two.
+const unsigned int STREAM_FRAMES = 3;
+
+// Bookkeeping half of the ring. The buffer is cut into one region per frame
+// in flight and each frame allocates linearly from its own. No GL, offsets
+// are from the start of the whole buffer.
+class StreamRing {
+public:
+    static const size_t NO_SPACE = ~(size_t)0;
+
+    // regionSize is rounded up so every region starts 256-byte aligned
+    explicit StreamRing(size_t regionSize = 0, unsigned int frames = STREAM_FRAMES);
+
+    // Moves to the next region and empties it.
+    void beginFrame();
+    // NO_SPACE when the rest of the region cannot hold it. alignment must be
+    // a power of two no larger than 256.
+    size_t allocate(size_t bytes, size_t alignment);
+
+    unsigned int region() const { return m_region; }
+    unsigned int frames() const { return m_frames; }
+    size_t regionSize() const { return m_regionSize; }
+    size_t regionOffset() const { return (size_t)m_region * m_regionSize; }
+    size_t used() const { return m_head; }
+
+private:
+    size_t m_regionSize;
+    unsigned int m_frames;
+    // starts on the last region so the first beginFrame lands on region 0
+    unsigned int m_region;
+    size_t m_head = 0;
+};
+
+// What the ring needs from GL. The recording backend stands in for a context
+// so the allocator and fence handling can be checked without one.
+class StreamBackend {
+public:
+    virtual ~StreamBackend() = default;
+    // (Re)creates the buffer; anything mapped before is gone.
+    virtual void create(size_t bytes) = 0;
+    // Writable memory for [offset, offset + bytes).
+    virtual unsigned char* map(size_t offset, size_t bytes) = 0;
+    // Ends writes to the range mapped last; only the first bytesWritten count.
+    virtual void unmap(size_t offset, size_t bytesWritten) = 0;
+    // Marks everything submitted so far.
+    virtual uintptr_t fence() = 0;
+    // Returns once the GPU is past the fence and releases it. True if that
+    // meant blocking.
+    virtual bool wait(uintptr_t fence) = 0;
+    virtual unsigned int buffer() const = 0;
+    // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    virtual size_t uniformAlignment() const = 0;
+};
+
+// Persistent, coherent mapping where ARB_buffer_storage exists. Elsewhere
+// (macOS stops at 4.1) each frame maps its region unsynchronized and flushes
+// what it wrote; the fences keep the GPU off the region while it is written,
+// and StreamBuffer unmaps it before any draw reads it.
+class GLStreamBackend : public StreamBackend {
+public:
+    ~GLStreamBackend() override;
+
+    void create(size_t bytes) override;
+    unsigned char* map(size_t offset, size_t bytes) override;
+    void unmap(size_t offset, size_t bytesWritten) override;
+    uintptr_t fence() override;
+    bool wait(uintptr_t fence) override;
+    unsigned int buffer() const override { return m_buffer; }
+    size_t uniformAlignment() const override { return m_uniformAlignment; }
+
+private:
+    unsigned int m_buffer = 0;
+    size_t m_uniformAlignment = 256;
+    // the whole buffer, when mapped persistently
+    unsigned char* m_persistent = nullptr;
+
+    void release();
+};
+
+class RecordingStreamBackend : public StreamBackend {
+public:
+    std::vector<unsigned char> memory;
+    // fences issued and not yet waited on, oldest first
+    std::vector<uintptr_t> pending;
+    int creates = 0;
+    int maps = 0;
+    int waits = 0;
+    bool mapped = false;
+    uintptr_t nextFence = 1;
+
+    void create(size_t bytes) override
+    {
+        memory.assign(bytes, 0);
+        creates++;
+    }
+    unsigned char* map(size_t offset, size_t) override
+    {
+        mapped = true;
+        maps++;
+        return memory.data() + offset;
+    }
+    void unmap(size_t, size_t) override { mapped = false; }
+    uintptr_t fence() override
+    {
+        pending.push_back(nextFence);
+        return nextFence++;
+    }
+    // a fake GPU is always behind, so every wait blocks
+    bool wait(uintptr_t fence) override
+    {
+        pending.erase(std::remove(pending.begin(), pending.end(), fence), pending.end());
+        waits++;
+        return true;
+    }
+    unsigned int buffer() const override { return 1; }
+    size_t uniformAlignment() const override { return 256; }
+};
+
+struct StreamAllocation {
+    // null when the frame's region is full
+    unsigned char* data = nullptr;
+    // from the start of the buffer, for glBindBufferRange and attribute pointers
+    size_t offset = 0;
+    size_t size = 0;
+};
+
+struct StreamStats {
+    // frames that had to wait for the GPU to release their region
+    int stalls = 0;
+    int overflows = 0;
+    int grows = 0;
+    size_t lastFrameBytes = 0;
+};
+
+// Triple-buffered ring for data rewritten every frame: model matrices,
+// moving instances and the lighting block. Between beginFrame and
+// finishWrites allocations hand out mapped memory; draws come after that and
+// refer to it by offset into buffer(), since a buffer may not be drawn from
+// while it is mapped. endFrame fences the region, and the next frame to
+// reuse it waits on that fence before writing.
+class StreamBuffer {
+public:
+    StreamBuffer(std::unique_ptr<StreamBackend> backend, size_t regionSize, unsigned int frames = STREAM_FRAMES);
+    ~StreamBuffer();
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    // bytesNeeded is the frame's estimate. A region smaller than that, or one
+    // that overflowed last frame, is regrown here, after every frame in
+    // flight has finished with the old buffer.
+    void beginFrame(size_t bytesNeeded = 0);
+    StreamAllocation allocate(size_t bytes, size_t alignment);
+    // Unmaps the region; allocations after this get nothing.
+    void finishWrites();
+    void endFrame();
+
+    unsigned int buffer() const { return m_backend->buffer(); }
+    size_t uniformAlignment() const { return m_backend->uniformAlignment(); }
+    size_t regionSize() const { return m_ring.regionSize(); }
+    const StreamStats& stats() const { return m_stats; }
+
+private:
+    std::unique_ptr<StreamBackend> m_backend;
+    StreamRing m_ring;
+    // one per region, 0 when nothing is in flight there
+    std::vector<uintptr_t> m_fences;
+    unsigned char* m_mapped = nullptr;
+    // between beginFrame and endFrame, mapped or not
+    bool m_inFrame = false;
+    bool m_created = false;
+    bool m_overflowed = false;
+    StreamStats m_stats;
+
+    void waitAll();
+};
+
+#endif // INCLUDE_STREAMBUFFER_H_
@@ -2,9 +2,14 @@
 #define INCLUDE_INCLUDE_TERRAIN_H_
 
 #include "./utils/Array2D.h"
+#include "./utils/HeightPyramid.h"
+#include "./utils/Random.h"
 #include "Shader.h"
 #include "utils/Texture.h"
 #include <GL/glew.h>
+#include <cstdint>
+struct Vertex;
+
 struct TerrainPoint {
     int x = 0;
     int z = 0;
@@ -19,6 +24,46 @@ struct TerrainPoint {
     }
 };
 
+// Half-open cell range [x0, x1) x [z0, z1) on the heightmap.
+struct TerrainRect {
+    int x0 = 0;
+    int z0 = 0;
+    int x1 = 0;
+    int z1 = 0;
+
+    bool empty() const
+    {
+        return x0 >= x1 || z0 >= z1;
+    }
+    bool touches(const TerrainRect& other) const
+    {
+        return x0 <= other.x1 && other.x0 <= x1 && z0 <= other.z1 && other.z0 <= z1;
+    }
+    TerrainRect merged(const TerrainRect& other) const
+    {
+        return { std::min(x0, other.x0), std::min(z0, other.z0), std::max(x1, other.x1), std::max(z1, other.z1) };
+    }
+};
+
+// Everything the generated terrain depends on. Also hashed into the disk
+// cache key, so any new generator input belongs here.
+struct TerrainParams {
+    int size = 1000;
+    int iterations = 300;
+    float minHeight = 0.0f;
+    float maxHeight = 120.0f;
+    float filter = 0.9f;
+    // taken when the params are made, so set SPOOKY_SEED before that
+    uint64_t seed = rng::globalSeed();
+};
+
+struct TerrainEditStats {
+    int rects = 0;
+    int uploads = 0;
+    size_t vertices = 0;
+    float milliseconds = 0.0f;
+};
+
 class Terrain {
 public:
     int width;
@@ -30,6 +75,7 @@ public:
     float minHeight;
     float maxHeight;
     float textureScale;
+    TerrainParams params;
     Array2D<glm::vec3> normalMap;
     float FIRFilterSinglePoint(int x, int z, float preval, float filter);
     std::vector<std::shared_ptr<Texture>> textures = {};
@@ -38,7 +84,9 @@ public:
     float getTerPosition(int x, int z);
     float getWorldHeight();
     Shader terrainShader = Shader("../src/terrain.vert.glsl", "../src/terrain.frag.glsl");
-    explicit Terrain(float scale, std::initializer_list<const std::string> textureFiles, float textureScale);
+    // Uncached terrain is neither loaded from nor written to TERRAIN_CACHE_DIR.
+    explicit Terrain(float scale, std::initializer_list<const std::string> textureFiles, float textureScale,
+        const TerrainParams& generator = TerrainParams(), bool cached = true);
     void renderShadow();
     void LoadFromFile(const std::string& filename);
     void render();
@@ -46,7 +94,23 @@ public:
     void populateBuffer();
     void CreateFaultFormation(int terrainSize, int iterations, float minHeight, float maxHeight);
     void faultFormationTerrain(int iterations, float minHeight, float maxHeight);
+
+    // Runtime deformation. Heights change immediately, so physics and
+    // GetHeightInterpolated see the edit straight away; normals and the GPU
+    // copy of the affected rows are refreshed by the next applyEdits().
     void flattenArea(int x, int z, int size, float height);
+    void raiseArea(float x, float z, float radius, float amount);
+    void crater(float x, float z, float radius, float depth);
+    void applyEdits();
+    TerrainEditStats editStats;
+    // bumped whenever applyEdits changes the mesh
+    unsigned int editRevision = 0;
+
+    // World-space ray queries against the same bilinear surface as
+    // GetHeightInterpolated. Directions need not be normalised; distances and
+    // maxDistance are in world units. Edits are visible immediately.
+    TerrainHit raycast(const TerrainRay& ray) const;
+    void raycast(const TerrainRay* rays, TerrainHit* hits, size_t count) const;
 
     float GetHeightInterpolated(float x, float z) const
     {
@@ -79,6 +143,18 @@ protected:
 
 private:
     float scale = 1.0f;
+    HeightPyramid heightPyramid;
+    std::vector<TerrainRect> dirtyRects;
+    TerrainRect clampRect(TerrainRect rect) const;
+    void markDirty(TerrainRect rect);
+    void buildVertexRow(int x, int zBegin, int zEnd, Vertex* out);
+    void buildVertexRowFromMaps(int x, Vertex* out) const;
+    uint64_t cacheKey() const;
+    std::string cachePath() const;
+    bool loadCache(const std::string& path);
+    void saveCache(const std::string& path) const;
+    void buildVertices(int xBegin, int xEnd, Vertex* vertices);
+    void buildIndices(std::vector<unsigned int>& indices) const;
 };
 
 #endif // INCLUDE_INCLUDE_TERRAIN_H_
@@ -1,9 +1,48 @@
-
 #ifndef TEXTURE_UTILS_H
 #define TEXTURE_UTILS_H
 
+#include "utils/BakedTexture.h"
+#include <memory>
 #include <string>
 
+struct TextureInfo {
+    unsigned int id = 0;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+};
+
+struct ImageFree {
+    void operator()(unsigned char* pixels) const;
+};
+
+// Pixels straight from stb_image, or the prebuilt compressed mips when a baked
+// .spktex matches the source. Decoding touches no GL state, so it can run on a
+// worker; the upload has to happen on the GL thread.
+struct DecodedImage {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::unique_ptr<unsigned char, ImageFree> pixels;
+    BakedTexture baked;
+    std::string filename;
+
+    bool isBaked() const { return !baked.levels.empty(); }
+    bool ok() const { return pixels != nullptr || isBaked(); }
+    size_t bytes() const { return isBaked() ? baked.bytes() : (size_t)width * height * channels; }
+};
+
+DecodedImage DecodeImageFile(const std::string& filename);
+// Replaces the contents of texture id with image. Baked images upload their
+// stored mips; plain ones have mipmaps generated by the driver.
+void UploadTexture(unsigned int id, const DecodedImage& image);
+// 1x1 mid-grey stand-in shown until the real image has been uploaded.
+void UploadPlaceholderTexture(unsigned int id);
+
+// Decodes filename and uploads it with mipmaps and repeat wrapping. On failure
+// the texture object is still created, just left empty with zero size.
+TextureInfo LoadTextureFile(const std::string& filename);
+
 unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma = false);
 
 #endif // TEXTURE_UTILS_H
@@ -0,0 +1,42 @@
+#ifndef INCLUDE_TRANSFORM_H_
+#define INCLUDE_TRANSFORM_H_
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// Position plus Euler angles in degrees, with the world and normal matrices
+// they produce cached. The matrix is translate * yaw * pitch * roll, the
+// order models have always been drawn in. set() only marks it dirty;
+// updateTransforms rebuilds the dirty ones in one pass.
+struct Transform {
+    glm::vec3 position = glm::vec3(0.0f);
+    float pitch = 0.0f;
+    float yaw = 0.0f;
+    float roll = 0.0f;
+    bool dirty = true;
+    glm::mat4 world = glm::mat4(1.0f);
+    // rotation only, so this is also the inverse transpose
+    glm::mat3 normal = glm::mat3(1.0f);
+
+    void set(const glm::vec3& newPosition, float newPitch, float newYaw, float newRoll)
+    {
+        if (newPosition != position || newPitch != pitch || newYaw != yaw || newRoll != roll) {
+            position = newPosition;
+            pitch = newPitch;
+            yaw = newYaw;
+            roll = newRoll;
+            dirty = true;
+        }
+    }
+};
+
+// Rebuilds every dirty transform in the list and returns how many it did.
+// The sines and cosines for the whole batch are taken in one loop over
+// packed angles before any matrix is written.
+size_t updateTransforms(Transform* const* transforms, size_t count);
+
+// The rotation updateTransforms would cache for these angles, built on the
+// spot for callers that must not touch the transform itself.
+glm::mat3 transformRotation(float pitch, float yaw, float roll);
+
+#endif // INCLUDE_TRANSFORM_H_
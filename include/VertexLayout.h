@@ -0,0 +1,46 @@
+#ifndef INCLUDE_VERTEXLAYOUT_H_
+#define INCLUDE_VERTEXLAYOUT_H_
+
+#include <cstddef>
+#include <vector>
+
+struct vertex;
+struct texture;
+
+// What actually goes to the GPU for a mesh. The full 88 byte vertex stays the
+// import and cache format; at upload time each mesh gets the smallest layout
+// that still carries everything it uses.
+enum class VertexLayout {
+    // position, normal, uv
+    StaticLit,
+    // plus tangent with the bitangent sign in w
+    NormalMapped,
+    // plus bone ids and weights
+    Skinned,
+};
+
+struct VertexAttribute {
+    unsigned int location;
+    int components;
+    unsigned int type;
+    bool normalized;
+    // bound with glVertexAttribIPointer
+    bool integer;
+    unsigned int offset;
+};
+
+struct VertexFormat {
+    VertexLayout layout = VertexLayout::StaticLit;
+    // uvs fit in half floats without visible error
+    bool halfTexCoords = false;
+    unsigned int stride = 0;
+    std::vector<VertexAttribute> attributes;
+};
+
+const char* vertexLayoutName(VertexLayout layout);
+VertexFormat chooseVertexFormat(const std::vector<vertex>& vertices, const std::vector<texture>& textures);
+std::vector<unsigned char> packVertices(const std::vector<vertex>& vertices, const VertexFormat& format);
+// Sets up the attribute pointers for the bound VAO and GL_ARRAY_BUFFER.
+void bindVertexFormat(const VertexFormat& format);
+
+#endif // INCLUDE_VERTEXLAYOUT_H_
@@ -1,4 +1,8 @@
+#ifndef INCLUDE_UTILS_ARRAY2D_H_
+#define INCLUDE_UTILS_ARRAY2D_H_
+
 #include <iostream>
+#include <memory>
 #include <ostream>
 #include <vector>
 
@@ -66,6 +70,13 @@ public:
         return (*data)[row][col];
     }
 
+    // Unchecked pointer to the start of a row, for tight loops that already
+    // know their bounds.
+    T* rowData(int row) const
+    {
+        return (*data)[row].data();
+    }
+
     void GetMinMax(T& Min, T& Max)
     {
         Max = (*data)[0][0];
@@ -100,3 +111,5 @@ public:
         }
     }
 };
+
+#endif // INCLUDE_UTILS_ARRAY2D_H_
@@ -0,0 +1,74 @@
+#ifndef INCLUDE_UTILS_BAKEDTEXTURE_H_
+#define INCLUDE_UTILS_BAKEDTEXTURE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Block-compressed textures with their whole mip chain precomputed, baked
+// offline by tools/bake_textures and stored next to the source image as
+// <name>.spktex. Nothing in here touches GL, so baking and decoding run
+// headless; TextureUtils does the upload.
+
+enum class BlockFormat : uint32_t {
+    // opaque colour, 8 bytes per 4x4 block
+    BC1 = 1,
+    // colour with alpha, 16 bytes per block
+    BC3 = 3,
+    // two channel data such as tangent space normals, 16 bytes per block
+    BC5 = 5,
+};
+
+struct MipLevel {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> rgba;
+};
+
+struct BakedLevel {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> blocks;
+};
+
+struct BakedTexture {
+    BlockFormat format = BlockFormat::BC1;
+    // colour data was filtered in linear space when the mips were built
+    bool srgb = true;
+    std::vector<BakedLevel> levels;
+
+    int width() const { return levels.empty() ? 0 : levels[0].width; }
+    int height() const { return levels.empty() ? 0 : levels[0].height; }
+    size_t bytes() const;
+};
+
+size_t blockBytes(BlockFormat format);
+const char* blockFormatName(BlockFormat format);
+
+// Full chain down to 1x1 from an RGBA8 image. sRGB colour is averaged in
+// linear light and weighted by alpha so cut-out edges do not darken.
+std::vector<MipLevel> buildMipChain(const unsigned char* rgba, int width, int height, bool srgb);
+
+// BC5 for files named like normal maps, BC3 when any pixel is translucent,
+// BC1 otherwise.
+BlockFormat chooseBlockFormat(const std::string& path, const unsigned char* rgba, int width, int height);
+BakedTexture compressTexture(const unsigned char* rgba, int width, int height, BlockFormat format, bool srgb);
+// Back to RGBA8, used when the driver has no S3TC support and by the baker's --check.
+std::vector<unsigned char> decompressLevel(const BakedLevel& level, BlockFormat format);
+
+// Blocks are 4x4 RGBA8 pixels in row order.
+void encodeBC1Block(const unsigned char* rgba, unsigned char* out);
+void encodeBC3Block(const unsigned char* rgba, unsigned char* out);
+void encodeBC5Block(const unsigned char* rgba, unsigned char* out);
+void decodeBC1Block(const unsigned char* block, unsigned char* rgba);
+void decodeBC3Block(const unsigned char* block, unsigned char* rgba);
+void decodeBC5Block(const unsigned char* block, unsigned char* rgba);
+
+std::string bakedTexturePath(const std::string& sourcePath);
+uint64_t hashTextureSource(const std::string& sourcePath);
+bool writeBakedTexture(const std::string& path, uint64_t sourceHash, const BakedTexture& texture);
+// Fails on a missing or corrupt file, or one baked from a different source.
+bool readBakedTexture(const std::string& path, uint64_t sourceHash, BakedTexture& texture);
+
+#endif // INCLUDE_UTILS_BAKEDTEXTURE_H_
@@ -0,0 +1,72 @@
+#ifndef INCLUDE_UTILS_GLHANDLE_H_
+#define INCLUDE_UTILS_GLHANDLE_H_
+
+#include <utility>
+
+enum class GLObjectKind {
+    Buffer,
+    VertexArray,
+};
+
+// Live counts of objects created through GLHandle, for the leak check at exit.
+struct GLObjectStats {
+    int buffers = 0;
+    int vertexArrays = 0;
+
+    int total() const { return buffers + vertexArrays; }
+};
+
+unsigned int createGLObject(GLObjectKind kind);
+void deleteGLObject(GLObjectKind kind, unsigned int id);
+GLObjectStats glObjectStats();
+
+// Owns one GL object name and deletes it when destroyed. Move-only; a
+// moved-from or default constructed handle holds 0 and deletes nothing.
+// Needs a current context when created and destroyed.
+template <GLObjectKind Kind>
+class GLHandle {
+public:
+    GLHandle() = default;
+    ~GLHandle() { reset(); }
+
+    GLHandle(const GLHandle&) = delete;
+    GLHandle& operator=(const GLHandle&) = delete;
+    GLHandle(GLHandle&& other) noexcept
+        : m_id(std::exchange(other.m_id, 0))
+    {
+    }
+    GLHandle& operator=(GLHandle&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            m_id = std::exchange(other.m_id, 0);
+        }
+        return *this;
+    }
+
+    static GLHandle create() { return GLHandle(createGLObject(Kind)); }
+
+    unsigned int id() const { return m_id; }
+    explicit operator bool() const { return m_id != 0; }
+
+    void reset()
+    {
+        if (m_id != 0) {
+            deleteGLObject(Kind, m_id);
+            m_id = 0;
+        }
+    }
+
+private:
+    explicit GLHandle(unsigned int id)
+        : m_id(id)
+    {
+    }
+
+    unsigned int m_id = 0;
+};
+
+using GLBuffer = GLHandle<GLObjectKind::Buffer>;
+using GLVertexArray = GLHandle<GLObjectKind::VertexArray>;
+
+#endif // INCLUDE_UTILS_GLHANDLE_H_
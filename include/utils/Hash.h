@@ -0,0 +1,55 @@
+#ifndef INCLUDE_UTILS_HASH_H_
+#define INCLUDE_UTILS_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 64-bit FNV-1a. Used for cache keys, so it has to stay stable across runs and
+// platforms; do not swap it for std::hash.
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = FNV_OFFSET)
+{
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+template <typename T>
+uint64_t hashValue(const T& value, uint64_t hash = FNV_OFFSET)
+{
+    return hashBytes(&value, sizeof(T), hash);
+}
+
+inline uint64_t hashString(const std::string& value, uint64_t hash = FNV_OFFSET)
+{
+    return hashBytes(value.data(), value.size(), hash);
+}
+
+// Same hash as hashString, usable in constant expressions on literals.
+constexpr uint64_t hashLiteral(const char* text, uint64_t hash = FNV_OFFSET)
+{
+    for (; *text != '\0'; text++) {
+        hash ^= (unsigned char)*text;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+inline std::string hashToHex(uint64_t hash)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        hex[i] = digits[hash & 0xf];
+        hash >>= 4;
+    }
+    return hex;
+}
+
+#endif // INCLUDE_UTILS_HASH_H_
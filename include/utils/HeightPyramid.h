@@ -0,0 +1,55 @@
+#ifndef INCLUDE_UTILS_HEIGHTPYRAMID_H_
+#define INCLUDE_UTILS_HEIGHTPYRAMID_H_
+
+#include "Array2D.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+struct TerrainRay {
+    glm::vec3 origin = glm::vec3(0.0f);
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    float maxDistance = 1.0e30f;
+};
+
+struct TerrainHit {
+    bool hit = false;
+    glm::vec3 point = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f, 1.0f, 0.0f);
+    float distance = 0.0f;
+};
+
+// Min/max quadtree over the terrain cells, in world height (the heightmap
+// stores heights negated). Level 0 holds one entry per cell between four
+// vertices; each level above halves the resolution until a single root.
+// Rays step across it front to back, skipping whole nodes they pass above,
+// and only test the bilinear surface in leaf cells whose height range they
+// reach. A ray that starts below the surface hits at its start.
+class HeightPyramid {
+public:
+    void build(const Array2D<float>& heightMap, int width, int height);
+    // Refresh after heights in the half-open vertex range [x0, x1) x [z0, z1) changed.
+    void update(int x0, int z0, int x1, int z1);
+
+    bool empty() const { return m_levels.empty(); }
+    TerrainHit raycast(const TerrainRay& ray) const;
+    void raycast(const TerrainRay* rays, TerrainHit* hits, size_t count) const;
+
+private:
+    struct Level {
+        int cellsX = 0;
+        int cellsZ = 0;
+        // (min, max) world height, interleaved so a box test touches one cache line
+        std::vector<glm::vec2> range;
+    };
+
+    float worldHeight(int x, int z) const { return -m_heights.rowData(x)[z]; }
+    void refreshLeaves(int x0, int z0, int x1, int z1);
+    void refreshLevel(int level, int x0, int z0, int x1, int z1);
+    bool intersectCell(int x, int z, const glm::vec3& origin, const glm::vec3& direction,
+        float tEnter, float tExit, TerrainHit& hit) const;
+
+    Array2D<float> m_heights;
+    std::vector<Level> m_levels;
+};
+
+#endif // INCLUDE_UTILS_HEIGHTPYRAMID_H_
@@ -0,0 +1,52 @@
+#ifndef INCLUDE_UTILS_JOBSYSTEM_H_
+#define INCLUDE_UTILS_JOBSYSTEM_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed pool of worker threads pulling jobs from one FIFO queue. Jobs must not
+// touch GL: the context only lives on the main thread, so anything that needs
+// it is handed back through the returned future.
+class JobSystem {
+public:
+    // 0 picks one worker per hardware thread, leaving the main thread free.
+    explicit JobSystem(unsigned int workers = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    template <typename Fn>
+    auto submit(Fn&& fn) -> std::future<std::invoke_result_t<Fn>>
+    {
+        using Result = std::invoke_result_t<Fn>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Fn>(fn));
+        std::future<Result> future = task->get_future();
+        push([task] { (*task)(); });
+        return future;
+    }
+
+    size_t workerCount() const { return m_workers.size(); }
+
+private:
+    void push(std::function<void()> job);
+    void run();
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_queue;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+};
+
+// Process-wide pool, created on first use.
+JobSystem& jobs();
+
+#endif // INCLUDE_UTILS_JOBSYSTEM_H_
@@ -0,0 +1,44 @@
+#ifndef INCLUDE_UTILS_MAPPEDFILE_H_
+#define INCLUDE_UTILS_MAPPEDFILE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. Uses a single mmap where the platform has
+// one and falls back to reading the file into memory otherwise.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool isOpen() const { return m_data != nullptr; }
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    void close();
+
+    const unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_mapped = false;
+    std::vector<unsigned char> m_buffer;
+};
+
+struct FileChunk {
+    const void* data;
+    size_t size;
+};
+
+// Writes chunks back to back under a temporary name unique to this call, then
+// renames it over path, so readers (and other writers) never see a torn file.
+// Returns false and leaves path untouched if anything fails.
+bool writeFileAtomically(const std::string& path, const std::vector<FileChunk>& chunks);
+
+#endif // INCLUDE_UTILS_MAPPEDFILE_H_
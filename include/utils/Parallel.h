@@ -0,0 +1,62 @@
+#ifndef INCLUDE_UTILS_PARALLEL_H_
+#define INCLUDE_UTILS_PARALLEL_H_
+
+#include "utils/JobSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+// Splits [begin, end) into at most one contiguous tile per pool worker plus
+// the caller (never smaller than grain) and runs fn(tileBegin, tileEnd) on
+// each through jobs(). Tiles are claimed from a shared counter and the
+// calling thread claims them too, so a busy pool, or a call from inside a
+// job, only means the caller does more of the work itself.
+template <typename Fn>
+void parallelFor(int begin, int end, int grain, Fn&& fn)
+{
+    int count = end - begin;
+    if (count <= 0) {
+        return;
+    }
+    grain = std::max(1, grain);
+    int workers = (int)jobs().workerCount() + 1;
+    int tiles = std::min(workers, (count + grain - 1) / grain);
+    if (tiles <= 1) {
+        fn(begin, end);
+        return;
+    }
+    int tileSize = (count + tiles - 1) / tiles;
+    tiles = (count + tileSize - 1) / tileSize;
+
+    struct Progress {
+        std::atomic<int> next { 0 };
+        std::atomic<int> done { 0 };
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    // shared, because a helper may only get to run after the loop is over;
+    // it then finds no tile left and never touches fn
+    auto progress = std::make_shared<Progress>();
+    auto* body = &fn;
+    auto work = [progress, body, begin, end, tileSize, tiles] {
+        for (int tile = progress->next++; tile < tiles; tile = progress->next++) {
+            int tileBegin = begin + tile * tileSize;
+            (*body)(tileBegin, std::min(end, tileBegin + tileSize));
+            if (++progress->done == tiles) {
+                std::lock_guard<std::mutex> lock(progress->mutex);
+                progress->finished.notify_all();
+            }
+        }
+    };
+    for (int helper = 1; helper < tiles; helper++) {
+        jobs().submit(work);
+    }
+    work();
+    std::unique_lock<std::mutex> lock(progress->mutex);
+    progress->finished.wait(lock, [&] { return progress->done == tiles; });
+}
+
+#endif // INCLUDE_UTILS_PARALLEL_H_
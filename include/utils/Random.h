@@ -0,0 +1,102 @@
+#ifndef INCLUDE_UTILS_RANDOM_H_
+#define INCLUDE_UTILS_RANDOM_H_
+
+#include <cstdint>
+
+// Counter-based random numbers (SplitMix64). A value is a pure function of
+// (seed, subsystem, stream index, counter), so generators can split work
+// across threads or tiles and still produce identical output for a seed.
+namespace rng {
+
+enum class Subsystem : uint32_t {
+    Terrain = 1,
+    Trees,
+    Lightning,
+    Physics,
+    Particles,
+    Lights,
+};
+
+constexpr uint64_t GOLDEN_GAMMA = 0x9E3779B97F4A7C15ull;
+
+constexpr uint64_t mix64(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+class Stream {
+public:
+    Stream() = default;
+    Stream(uint64_t seed, Subsystem subsystem, uint64_t index = 0)
+        : key(mix64(mix64(seed + GOLDEN_GAMMA) ^ mix64(((uint64_t)subsystem << 32) + index + GOLDEN_GAMMA)))
+    {
+    }
+
+    // Random access: the n-th value of this stream.
+    uint64_t at(uint64_t n) const
+    {
+        return mix64(key + (n + 1) * GOLDEN_GAMMA);
+    }
+
+    uint64_t next()
+    {
+        return at(counter++);
+    }
+
+    // Uniform in [0, bound).
+    uint32_t nextUInt(uint32_t bound)
+    {
+        return (uint32_t)(((next() >> 32) * (uint64_t)bound) >> 32);
+    }
+
+    int nextInt(int lo, int hiExclusive)
+    {
+        return lo + (int)nextUInt((uint32_t)(hiExclusive - lo));
+    }
+
+    // Uniform in [0, 1).
+    float nextFloat()
+    {
+        return (float)(next() >> 40) * (1.0f / 16777216.0f);
+    }
+
+    float range(float lo, float hi)
+    {
+        return lo + (hi - lo) * nextFloat();
+    }
+
+    // Independent sub-stream, e.g. one per tile or per instance.
+    Stream child(uint64_t index) const
+    {
+        Stream stream;
+        stream.key = mix64(key ^ mix64(index + GOLDEN_GAMMA));
+        return stream;
+    }
+
+private:
+    uint64_t key = 0;
+    uint64_t counter = 0;
+};
+
+// Process-wide seed. Set it once at startup, before anything generates.
+inline uint64_t& globalSeed()
+{
+    static uint64_t seed = 1;
+    return seed;
+}
+
+inline void setSeed(uint64_t seed)
+{
+    globalSeed() = seed;
+}
+
+inline Stream stream(Subsystem subsystem, uint64_t index = 0)
+{
+    return { globalSeed(), subsystem, index };
+}
+
+} // namespace rng
+
+#endif // INCLUDE_UTILS_RANDOM_H_
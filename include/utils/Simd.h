@@ -0,0 +1,141 @@
+#ifndef INCLUDE_UTILS_SIMD_H_
+#define INCLUDE_UTILS_SIMD_H_
+
+// Minimal 4-wide float abstraction. SSE on x86, NEON on Apple silicon / ARM,
+// plain scalar code everywhere else so the kernels stay portable.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPOOKY_SIMD_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SPOOKY_SIMD_NEON 1
+#else
+#include <cmath>
+#endif
+
+namespace simd {
+
+#if defined(SPOOKY_SIMD_SSE)
+
+struct Float4 {
+    __m128 v;
+};
+
+inline Float4 load(const float* p) { return { _mm_loadu_ps(p) }; }
+inline void store(float* p, Float4 a) { _mm_storeu_ps(p, a.v); }
+inline Float4 set1(float s) { return { _mm_set1_ps(s) }; }
+inline Float4 set(float a, float b, float c, float d) { return { _mm_setr_ps(a, b, c, d) }; }
+inline Float4 add(Float4 a, Float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+inline Float4 sub(Float4 a, Float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline Float4 mul(Float4 a, Float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline Float4 div(Float4 a, Float4 b) { return { _mm_div_ps(a.v, b.v) }; }
+inline Float4 sqrt(Float4 a) { return { _mm_sqrt_ps(a.v) }; }
+inline Float4 min(Float4 a, Float4 b) { return { _mm_min_ps(a.v, b.v) }; }
+inline Float4 max(Float4 a, Float4 b) { return { _mm_max_ps(a.v, b.v) }; }
+// Comparisons return all-ones lanes where true.
+inline Float4 less(Float4 a, Float4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline Float4 greater(Float4 a, Float4 b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+inline Float4 bitAnd(Float4 a, Float4 b) { return { _mm_and_ps(a.v, b.v) }; }
+inline Float4 bitOr(Float4 a, Float4 b) { return { _mm_or_ps(a.v, b.v) }; }
+inline Float4 select(Float4 mask, Float4 a, Float4 b) { return { _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)) }; }
+inline int mask(Float4 a) { return _mm_movemask_ps(a.v); }
+
+#elif defined(SPOOKY_SIMD_NEON)
+
+struct Float4 {
+    float32x4_t v;
+};
+
+inline Float4 load(const float* p) { return { vld1q_f32(p) }; }
+inline void store(float* p, Float4 a) { vst1q_f32(p, a.v); }
+inline Float4 set1(float s) { return { vdupq_n_f32(s) }; }
+inline Float4 set(float a, float b, float c, float d)
+{
+    float tmp[4] = { a, b, c, d };
+    return { vld1q_f32(tmp) };
+}
+inline Float4 add(Float4 a, Float4 b) { return { vaddq_f32(a.v, b.v) }; }
+inline Float4 sub(Float4 a, Float4 b) { return { vsubq_f32(a.v, b.v) }; }
+inline Float4 mul(Float4 a, Float4 b) { return { vmulq_f32(a.v, b.v) }; }
+inline Float4 div(Float4 a, Float4 b) { return { vdivq_f32(a.v, b.v) }; }
+inline Float4 sqrt(Float4 a) { return { vsqrtq_f32(a.v) }; }
+inline Float4 min(Float4 a, Float4 b) { return { vminq_f32(a.v, b.v) }; }
+inline Float4 max(Float4 a, Float4 b) { return { vmaxq_f32(a.v, b.v) }; }
+inline Float4 less(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vcltq_f32(a.v, b.v)) }; }
+inline Float4 greater(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vcgtq_f32(a.v, b.v)) }; }
+inline Float4 bitAnd(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))) }; }
+inline Float4 bitOr(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))) }; }
+inline Float4 select(Float4 mask, Float4 a, Float4 b) { return { vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v) }; }
+inline int mask(Float4 a)
+{
+    uint32x4_t bits = vshrq_n_u32(vreinterpretq_u32_f32(a.v), 31);
+    return (int)(vgetq_lane_u32(bits, 0) | (vgetq_lane_u32(bits, 1) << 1) | (vgetq_lane_u32(bits, 2) << 2) | (vgetq_lane_u32(bits, 3) << 3));
+}
+
+#else
+
+struct Float4 {
+    float v[4];
+};
+
+inline Float4 load(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+inline void store(float* p, Float4 a)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = a.v[i];
+}
+inline Float4 set1(float s) { return { { s, s, s, s } }; }
+inline Float4 set(float a, float b, float c, float d) { return { { a, b, c, d } }; }
+#define SPOOKY_SIMD_LANEWISE(name, expr)              \
+    inline Float4 name(Float4 a, Float4 b)            \
+    {                                                 \
+        Float4 r;                                     \
+        for (int i = 0; i < 4; i++) {                 \
+            float x = a.v[i];                         \
+            float y = b.v[i];                         \
+            r.v[i] = (expr);                          \
+        }                                             \
+        return r;                                     \
+    }
+SPOOKY_SIMD_LANEWISE(add, x + y)
+SPOOKY_SIMD_LANEWISE(sub, x - y)
+SPOOKY_SIMD_LANEWISE(mul, x * y)
+SPOOKY_SIMD_LANEWISE(div, x / y)
+SPOOKY_SIMD_LANEWISE(min, x < y ? x : y)
+SPOOKY_SIMD_LANEWISE(max, x > y ? x : y)
+#undef SPOOKY_SIMD_LANEWISE
+inline Float4 sqrt(Float4 a) { return { { std::sqrt(a.v[0]), std::sqrt(a.v[1]), std::sqrt(a.v[2]), std::sqrt(a.v[3]) } }; }
+inline Float4 fromMask(bool a, bool b, bool c, bool d)
+{
+    // An all-ones lane is a NaN bit pattern; only ever consumed by select/mask.
+    Float4 r;
+    unsigned int bits[4] = { a ? ~0u : 0u, b ? ~0u : 0u, c ? ~0u : 0u, d ? ~0u : 0u };
+    for (int i = 0; i < 4; i++)
+        __builtin_memcpy(&r.v[i], &bits[i], sizeof(float));
+    return r;
+}
+inline unsigned int laneBits(const Float4& a, int i)
+{
+    unsigned int bits;
+    __builtin_memcpy(&bits, &a.v[i], sizeof(float));
+    return bits;
+}
+inline Float4 less(Float4 a, Float4 b) { return fromMask(a.v[0] < b.v[0], a.v[1] < b.v[1], a.v[2] < b.v[2], a.v[3] < b.v[3]); }
+inline Float4 greater(Float4 a, Float4 b) { return fromMask(a.v[0] > b.v[0], a.v[1] > b.v[1], a.v[2] > b.v[2], a.v[3] > b.v[3]); }
+inline Float4 bitAnd(Float4 a, Float4 b) { return fromMask(laneBits(a, 0) & laneBits(b, 0), laneBits(a, 1) & laneBits(b, 1), laneBits(a, 2) & laneBits(b, 2), laneBits(a, 3) & laneBits(b, 3)); }
+inline Float4 bitOr(Float4 a, Float4 b) { return fromMask(laneBits(a, 0) | laneBits(b, 0), laneBits(a, 1) | laneBits(b, 1), laneBits(a, 2) | laneBits(b, 2), laneBits(a, 3) | laneBits(b, 3)); }
+inline Float4 select(Float4 mask, Float4 a, Float4 b)
+{
+    Float4 r;
+    for (int i = 0; i < 4; i++)
+        r.v[i] = laneBits(mask, i) ? a.v[i] : b.v[i];
+    return r;
+}
+inline int mask(Float4 a) { return (laneBits(a, 0) ? 1 : 0) | (laneBits(a, 1) ? 2 : 0) | (laneBits(a, 2) ? 4 : 0) | (laneBits(a, 3) ? 8 : 0); }
+
+#endif
+
+} // namespace simd
+
+#endif // INCLUDE_UTILS_SIMD_H_
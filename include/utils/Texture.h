@@ -4,7 +4,9 @@
 
 #ifndef SPOOKY_TEXTURE_H
 #define SPOOKY_TEXTURE_H
+#include "TextureCache.h"
 #include <gl/glew.h>
+#include <memory>
 #include <string>
 
 class Texture {
@@ -13,6 +15,9 @@ public:
 
     Texture(GLenum TextureTarget);
 
+    // Wraps a shared 2D texture from the texture cache instead of owning one.
+    explicit Texture(std::shared_ptr<CachedTexture> cached);
+
     // Should be called once to load the texture
     bool Load();
 
@@ -49,5 +54,6 @@ private:
     int m_imageWidth = 0;
     int m_imageHeight = 0;
     int m_imageBPP = 0;
+    std::shared_ptr<CachedTexture> m_cached;
 };
 #endif // SPOOKY_TEXTURE_H
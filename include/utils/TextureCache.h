@@ -0,0 +1,78 @@
+#ifndef INCLUDE_UTILS_TEXTURECACHE_H_
+#define INCLUDE_UTILS_TEXTURECACHE_H_
+
+#include "TextureUtils.h"
+#include "JobSystem.h"
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// One GL texture per canonical file path, shared by every Model and the
+// terrain. The texture is deleted when the last handle goes away.
+struct CachedTexture {
+    unsigned int id = 0;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    // GPU footprint estimate including the mip chain
+    size_t bytes = 0;
+    std::string path;
+    // false while the placeholder is still showing
+    bool ready = false;
+    // cache hits while the placeholder showed; bytes is only known once the
+    // upload lands, so their saving is counted then
+    int pendingHits = 0;
+};
+
+struct TextureCacheStats {
+    int hits = 0;
+    int misses = 0;
+    int live = 0;
+    int pending = 0;
+    size_t residentBytes = 0;
+    // bytes that would have been decoded and uploaded again without the cache
+    size_t bytesSaved = 0;
+    int lastPumpUploads = 0;
+    float lastPumpMilliseconds = 0.0f;
+
+    float hitRate() const { return hits + misses > 0 ? (float)hits / (float)(hits + misses) : 0.0f; }
+};
+
+class TextureCache {
+public:
+    // Call with a current GL context. The returned texture id is valid at once:
+    // asynchronous loads show a placeholder and decode on the cache's own
+    // workers, and pumpUploads() later swaps the real image into the same
+    // texture object.
+    std::shared_ptr<CachedTexture> acquire(const std::string& path, bool async = true);
+
+    // Uploads decoded images on the GL thread until either budget is spent,
+    // always at least one if any is ready. Returns how many were uploaded.
+    int pumpUploads(float budgetMilliseconds, size_t budgetBytes);
+    TextureCacheStats stats() const;
+
+private:
+    struct PendingTexture {
+        std::weak_ptr<CachedTexture> texture;
+        std::future<DecodedImage> image;
+    };
+
+    void release(CachedTexture* texture);
+    void finishUpload(CachedTexture& texture, const DecodedImage& image);
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, std::weak_ptr<CachedTexture>> m_entries;
+    std::deque<PendingTexture> m_pending;
+    TextureCacheStats m_stats;
+    // Decodes get their own small pool so a burst of them never sits in front
+    // of the frame's jobs() work, which the main thread blocks on.
+    JobSystem m_decoders { 2 };
+};
+
+TextureCache& textureCache();
+
+#endif // INCLUDE_UTILS_TEXTURECACHE_H_
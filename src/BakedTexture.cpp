@@ -0,0 +1,628 @@
+#include "utils/BakedTexture.h"
+#include "utils/Hash.h"
+#include "utils/MappedFile.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+#define BAKED_TEXTURE_VERSION 1
+
+namespace {
+// Layout follows KTX2: header, one index entry per level (level 0 first),
+// then the level data stored smallest mip first, each on a 16 byte boundary.
+struct TextureHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t srgb;
+    uint64_t sourceHash;
+};
+
+struct LevelIndex {
+    uint64_t offset;
+    uint64_t length;
+};
+
+const char BAKED_TEXTURE_MAGIC[8] = { 'S', 'P', 'K', 'T', 'E', 'X', '\0', '\0' };
+
+uint64_t align16(uint64_t offset)
+{
+    return (offset + 15) & ~uint64_t(15);
+}
+
+int blocksAcross(int pixels)
+{
+    return (pixels + 3) / 4;
+}
+
+const std::array<float, 256>& srgbTable()
+{
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> values {};
+        for (int i = 0; i < 256; i++) {
+            float c = i / 255.0f;
+            values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table;
+}
+
+unsigned char toByte(float value)
+{
+    return (unsigned char)std::clamp((int)std::lround(value * 255.0f), 0, 255);
+}
+
+unsigned char linearToSrgb(float value)
+{
+    value = std::clamp(value, 0.0f, 1.0f);
+    return toByte(value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f);
+}
+
+uint16_t pack565(const float* color)
+{
+    int r = std::clamp((int)std::lround(color[0] * 31.0f / 255.0f), 0, 31);
+    int g = std::clamp((int)std::lround(color[1] * 63.0f / 255.0f), 0, 63);
+    int b = std::clamp((int)std::lround(color[2] * 31.0f / 255.0f), 0, 31);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void unpack565(uint16_t packed, float* color)
+{
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    color[0] = (float)((r << 3) | (r >> 2));
+    color[1] = (float)((g << 2) | (g >> 4));
+    color[2] = (float)((b << 3) | (b >> 2));
+}
+
+void colorPalette(uint16_t c0, uint16_t c1, bool fourColor, float palette[4][3])
+{
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        if (fourColor) {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2.0f;
+            palette[3][c] = 0.0f;
+        }
+    }
+}
+
+struct ColorBlock {
+    uint16_t c0 = 0;
+    uint16_t c1 = 0;
+    uint32_t indices = 0;
+    float error = 0.0f;
+};
+
+// Always four colour mode, which is what BC3 forces anyway.
+ColorBlock fitColorBlock(const float pixels[16][3], uint16_t c0, uint16_t c1)
+{
+    ColorBlock block;
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+    block.c0 = c0;
+    block.c1 = c1;
+    float palette[4][3];
+    colorPalette(c0, c1, true, palette);
+    // equal endpoints would decode in three colour mode, where index 3 is transparent
+    int choices = c0 == c1 ? 1 : 4;
+    for (int i = 0; i < 16; i++) {
+        int best = 0;
+        float bestError = 1e30f;
+        for (int p = 0; p < choices; p++) {
+            float dr = pixels[i][0] - palette[p][0];
+            float dg = pixels[i][1] - palette[p][1];
+            float db = pixels[i][2] - palette[p][2];
+            float error = dr * dr + dg * dg + db * db;
+            if (error < bestError) {
+                bestError = error;
+                best = p;
+            }
+        }
+        block.indices |= (uint32_t)best << (2 * i);
+        block.error += bestError;
+    }
+    return block;
+}
+
+void encodeColorBlock(const unsigned char* rgba, unsigned char* out)
+{
+    float pixels[16][3];
+    float mean[3] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            pixels[i][c] = rgba[i * 4 + c];
+            mean[c] += pixels[i][c] / 16.0f;
+        }
+    }
+
+    // principal axis of the colours by power iteration on the covariance
+    float cov[6] = {};
+    for (int i = 0; i < 16; i++) {
+        float r = pixels[i][0] - mean[0];
+        float g = pixels[i][1] - mean[1];
+        float b = pixels[i][2] - mean[2];
+        cov[0] += r * r;
+        cov[1] += r * g;
+        cov[2] += r * b;
+        cov[3] += g * g;
+        cov[4] += g * b;
+        cov[5] += b * b;
+    }
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[3] = {
+            cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+            cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+            cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2],
+        };
+        float length = std::max({ std::fabs(next[0]), std::fabs(next[1]), std::fabs(next[2]) });
+        if (length < 1e-6f) {
+            break;
+        }
+        for (int c = 0; c < 3; c++) {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float minT = 1e30f;
+    float maxT = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float t = (pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1]
+            + (pixels[i][2] - mean[2]) * axis[2];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float end0[3];
+    float end1[3];
+    for (int c = 0; c < 3; c++) {
+        end0[c] = mean[c] + axis[c] * maxT / axisLength2;
+        end1[c] = mean[c] + axis[c] * minT / axisLength2;
+        // pull the endpoints in a little, the extremes are rarely the best fit
+        float inset = (end0[c] - end1[c]) / 16.0f;
+        end0[c] -= inset;
+        end1[c] += inset;
+    }
+    ColorBlock best = fitColorBlock(pixels, pack565(end0), pack565(end1));
+
+    // One least squares pass: solve for the endpoints that best reproduce the
+    // pixels given the indices just chosen, and keep them if they do better.
+    static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[3] = {}, bx[3] = {};
+    for (int i = 0; i < 16; i++) {
+        float a = weights[(best.indices >> (2 * i)) & 3];
+        float b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 3; c++) {
+            ax[c] += a * pixels[i][c];
+            bx[c] += b * pixels[i][c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) > 1e-6f) {
+        for (int c = 0; c < 3; c++) {
+            end0[c] = (bb * ax[c] - ab * bx[c]) / det;
+            end1[c] = (aa * bx[c] - ab * ax[c]) / det;
+        }
+        ColorBlock refined = fitColorBlock(pixels, pack565(end0), pack565(end1));
+        if (refined.error < best.error) {
+            best = refined;
+        }
+    }
+
+    out[0] = best.c0 & 0xff;
+    out[1] = best.c0 >> 8;
+    out[2] = best.c1 & 0xff;
+    out[3] = best.c1 >> 8;
+    for (int i = 0; i < 4; i++) {
+        out[4 + i] = (best.indices >> (8 * i)) & 0xff;
+    }
+}
+
+void decodeColorBlock(const unsigned char* block, unsigned char* rgba, bool forceFourColor)
+{
+    uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+    uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+    bool fourColor = forceFourColor || c0 > c1;
+    float palette[4][3];
+    colorPalette(c0, c1, fourColor, palette);
+    for (int i = 0; i < 16; i++) {
+        int index = (indices >> (2 * i)) & 3;
+        for (int c = 0; c < 3; c++) {
+            rgba[i * 4 + c] = (unsigned char)std::lround(palette[index][c]);
+        }
+        rgba[i * 4 + 3] = !fourColor && index == 3 ? 0 : 255;
+    }
+}
+
+void alphaPalette(int a0, int a1, float palette[8])
+{
+    palette[0] = (float)a0;
+    palette[1] = (float)a1;
+    if (a0 > a1) {
+        for (int i = 2; i < 8; i++) {
+            palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7.0f;
+        }
+    } else {
+        for (int i = 2; i < 6; i++) {
+            palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5.0f;
+        }
+        palette[6] = 0.0f;
+        palette[7] = 255.0f;
+    }
+}
+
+// BC4: one channel, read with the given stride from 16 pixels.
+void encodeChannelBlock(const unsigned char* values, int stride, unsigned char* out)
+{
+    int lo = 255;
+    int hi = 0;
+    for (int i = 0; i < 16; i++) {
+        lo = std::min(lo, (int)values[i * stride]);
+        hi = std::max(hi, (int)values[i * stride]);
+    }
+    out[0] = (unsigned char)hi;
+    out[1] = (unsigned char)lo;
+    uint64_t indices = 0;
+    if (hi > lo) {
+        float palette[8];
+        alphaPalette(hi, lo, palette);
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            float bestError = 1e30f;
+            for (int p = 0; p < 8; p++) {
+                float error = std::fabs(values[i * stride] - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; i++) {
+        out[2 + i] = (indices >> (8 * i)) & 0xff;
+    }
+}
+
+void decodeChannelBlock(const unsigned char* block, unsigned char* values, int stride)
+{
+    float palette[8];
+    alphaPalette(block[0], block[1], palette);
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; i++) {
+        indices |= (uint64_t)block[2 + i] << (8 * i);
+    }
+    for (int i = 0; i < 16; i++) {
+        values[i * stride] = (unsigned char)std::lround(palette[(indices >> (3 * i)) & 7]);
+    }
+}
+
+using BlockEncoder = void (*)(const unsigned char*, unsigned char*);
+using BlockDecoder = void (*)(const unsigned char*, unsigned char*);
+
+BlockEncoder encoderFor(BlockFormat format)
+{
+    switch (format) {
+    case BlockFormat::BC3:
+        return encodeBC3Block;
+    case BlockFormat::BC5:
+        return encodeBC5Block;
+    default:
+        return encodeBC1Block;
+    }
+}
+
+BlockDecoder decoderFor(BlockFormat format)
+{
+    switch (format) {
+    case BlockFormat::BC3:
+        return decodeBC3Block;
+    case BlockFormat::BC5:
+        return decodeBC5Block;
+    default:
+        return decodeBC1Block;
+    }
+}
+
+bool validFormat(uint32_t format)
+{
+    return format == (uint32_t)BlockFormat::BC1 || format == (uint32_t)BlockFormat::BC3
+        || format == (uint32_t)BlockFormat::BC5;
+}
+}
+
+size_t BakedTexture::bytes() const
+{
+    size_t total = 0;
+    for (const auto& level : levels) {
+        total += level.blocks.size();
+    }
+    return total;
+}
+
+size_t blockBytes(BlockFormat format)
+{
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+const char* blockFormatName(BlockFormat format)
+{
+    switch (format) {
+    case BlockFormat::BC3:
+        return "BC3";
+    case BlockFormat::BC5:
+        return "BC5";
+    default:
+        return "BC1";
+    }
+}
+
+void encodeBC1Block(const unsigned char* rgba, unsigned char* out)
+{
+    encodeColorBlock(rgba, out);
+}
+
+void encodeBC3Block(const unsigned char* rgba, unsigned char* out)
+{
+    encodeChannelBlock(rgba + 3, 4, out);
+    encodeColorBlock(rgba, out + 8);
+}
+
+void encodeBC5Block(const unsigned char* rgba, unsigned char* out)
+{
+    encodeChannelBlock(rgba, 4, out);
+    encodeChannelBlock(rgba + 1, 4, out + 8);
+}
+
+void decodeBC1Block(const unsigned char* block, unsigned char* rgba)
+{
+    decodeColorBlock(block, rgba, false);
+}
+
+void decodeBC3Block(const unsigned char* block, unsigned char* rgba)
+{
+    decodeColorBlock(block + 8, rgba, true);
+    decodeChannelBlock(block, rgba + 3, 4);
+}
+
+void decodeBC5Block(const unsigned char* block, unsigned char* rgba)
+{
+    decodeChannelBlock(block, rgba, 4);
+    decodeChannelBlock(block + 8, rgba + 1, 4);
+    // rebuild z so the RGBA fallback still looks like a normal map
+    for (int i = 0; i < 16; i++) {
+        float x = rgba[i * 4] / 127.5f - 1.0f;
+        float y = rgba[i * 4 + 1] / 127.5f - 1.0f;
+        float z = std::sqrt(std::max(0.0f, 1.0f - x * x - y * y));
+        rgba[i * 4 + 2] = toByte(z * 0.5f + 0.5f);
+        rgba[i * 4 + 3] = 255;
+    }
+}
+
+std::vector<MipLevel> buildMipChain(const unsigned char* rgba, int width, int height, bool srgb)
+{
+    std::vector<MipLevel> chain;
+    if (width <= 0 || height <= 0) {
+        return chain;
+    }
+    chain.push_back({ width, height, std::vector<unsigned char>(rgba, rgba + (size_t)width * height * 4) });
+
+    // Filter from a float copy of the previous level rather than the stored
+    // bytes so rounding does not build up down the chain.
+    const auto& table = srgbTable();
+    std::vector<float> current((size_t)width * height * 4);
+    for (size_t i = 0; i < current.size(); i++) {
+        bool colour = srgb && (i & 3) != 3;
+        current[i] = colour ? table[rgba[i]] : rgba[i] / 255.0f;
+    }
+
+    while (width > 1 || height > 1) {
+        int nextWidth = std::max(1, width / 2);
+        int nextHeight = std::max(1, height / 2);
+        std::vector<float> next((size_t)nextWidth * nextHeight * 4);
+        for (int y = 0; y < nextHeight; y++) {
+            for (int x = 0; x < nextWidth; x++) {
+                float weighted[3] = {};
+                float plain[3] = {};
+                float alpha = 0.0f;
+                for (int dy = 0; dy < 2; dy++) {
+                    for (int dx = 0; dx < 2; dx++) {
+                        int sx = std::min(2 * x + dx, width - 1);
+                        int sy = std::min(2 * y + dy, height - 1);
+                        const float* texel = &current[((size_t)sy * width + sx) * 4];
+                        for (int c = 0; c < 3; c++) {
+                            weighted[c] += texel[c] * texel[3];
+                            plain[c] += texel[c];
+                        }
+                        alpha += texel[3];
+                    }
+                }
+                float* out = &next[((size_t)y * nextWidth + x) * 4];
+                for (int c = 0; c < 3; c++) {
+                    out[c] = alpha > 1e-4f ? weighted[c] / alpha : plain[c] / 4.0f;
+                }
+                out[3] = alpha / 4.0f;
+            }
+        }
+
+        MipLevel level { nextWidth, nextHeight, std::vector<unsigned char>(next.size()) };
+        for (size_t i = 0; i < next.size(); i++) {
+            bool colour = srgb && (i & 3) != 3;
+            level.rgba[i] = colour ? linearToSrgb(next[i]) : toByte(next[i]);
+        }
+        chain.push_back(std::move(level));
+        current = std::move(next);
+        width = nextWidth;
+        height = nextHeight;
+    }
+    return chain;
+}
+
+BlockFormat chooseBlockFormat(const std::string& path, const unsigned char* rgba, int width, int height)
+{
+    std::string name = std::filesystem::path(path).stem().string();
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    bool normalMap = name.find("normal") != std::string::npos || name.find("_nrm") != std::string::npos
+        || (name.size() > 2 && name.compare(name.size() - 2, 2, "_n") == 0);
+    if (normalMap) {
+        return BlockFormat::BC5;
+    }
+    size_t pixels = (size_t)width * height;
+    for (size_t i = 0; i < pixels; i++) {
+        if (rgba[i * 4 + 3] != 255) {
+            return BlockFormat::BC3;
+        }
+    }
+    return BlockFormat::BC1;
+}
+
+BakedTexture compressTexture(const unsigned char* rgba, int width, int height, BlockFormat format, bool srgb)
+{
+    BakedTexture texture;
+    texture.format = format;
+    texture.srgb = srgb;
+    BlockEncoder encode = encoderFor(format);
+    size_t stride = blockBytes(format);
+    for (const MipLevel& mip : buildMipChain(rgba, width, height, srgb)) {
+        BakedLevel level;
+        level.width = mip.width;
+        level.height = mip.height;
+        int columns = blocksAcross(mip.width);
+        int rows = blocksAcross(mip.height);
+        level.blocks.resize((size_t)columns * rows * stride);
+        unsigned char pixels[64];
+        for (int by = 0; by < rows; by++) {
+            for (int bx = 0; bx < columns; bx++) {
+                // edge blocks repeat the last row and column
+                for (int i = 0; i < 16; i++) {
+                    int x = std::min(bx * 4 + (i & 3), mip.width - 1);
+                    int y = std::min(by * 4 + (i >> 2), mip.height - 1);
+                    memcpy(pixels + i * 4, &mip.rgba[((size_t)y * mip.width + x) * 4], 4);
+                }
+                encode(pixels, &level.blocks[((size_t)by * columns + bx) * stride]);
+            }
+        }
+        texture.levels.push_back(std::move(level));
+    }
+    return texture;
+}
+
+std::vector<unsigned char> decompressLevel(const BakedLevel& level, BlockFormat format)
+{
+    std::vector<unsigned char> rgba((size_t)level.width * level.height * 4);
+    BlockDecoder decode = decoderFor(format);
+    size_t stride = blockBytes(format);
+    int columns = blocksAcross(level.width);
+    int rows = blocksAcross(level.height);
+    unsigned char pixels[64];
+    for (int by = 0; by < rows; by++) {
+        for (int bx = 0; bx < columns; bx++) {
+            decode(&level.blocks[((size_t)by * columns + bx) * stride], pixels);
+            for (int i = 0; i < 16; i++) {
+                int x = bx * 4 + (i & 3);
+                int y = by * 4 + (i >> 2);
+                if (x < level.width && y < level.height) {
+                    memcpy(&rgba[((size_t)y * level.width + x) * 4], pixels + i * 4, 4);
+                }
+            }
+        }
+    }
+    return rgba;
+}
+
+std::string bakedTexturePath(const std::string& sourcePath)
+{
+    return std::filesystem::path(sourcePath).replace_extension(".spktex").string();
+}
+
+uint64_t hashTextureSource(const std::string& sourcePath)
+{
+    MappedFile source(sourcePath);
+    return source.isOpen() ? hashBytes(source.data(), source.size()) : 0;
+}
+
+bool writeBakedTexture(const std::string& path, uint64_t sourceHash, const BakedTexture& texture)
+{
+    TextureHeader header {};
+    memcpy(header.magic, BAKED_TEXTURE_MAGIC, sizeof(header.magic));
+    header.version = BAKED_TEXTURE_VERSION;
+    header.format = (uint32_t)texture.format;
+    header.width = (uint32_t)texture.width();
+    header.height = (uint32_t)texture.height();
+    header.levelCount = (uint32_t)texture.levels.size();
+    header.srgb = texture.srgb ? 1 : 0;
+    header.sourceHash = sourceHash;
+
+    std::vector<LevelIndex> index(texture.levels.size());
+    uint64_t offset = sizeof(header) + index.size() * sizeof(LevelIndex);
+    for (size_t i = index.size(); i-- > 0;) {
+        index[i].offset = offset = align16(offset);
+        index[i].length = texture.levels[i].blocks.size();
+        offset += index[i].length;
+    }
+
+    static const unsigned char padding[16] = {};
+    std::vector<FileChunk> chunks { { &header, sizeof(header) }, { index.data(), index.size() * sizeof(LevelIndex) } };
+    uint64_t written = sizeof(header) + index.size() * sizeof(LevelIndex);
+    for (size_t i = index.size(); i-- > 0;) {
+        chunks.push_back({ padding, (size_t)(index[i].offset - written) });
+        chunks.push_back({ texture.levels[i].blocks.data(), (size_t)index[i].length });
+        written = index[i].offset + index[i].length;
+    }
+    return writeFileAtomically(path, chunks);
+}
+
+bool readBakedTexture(const std::string& path, uint64_t sourceHash, BakedTexture& texture)
+{
+    MappedFile file(path);
+    if (!file.isOpen() || file.size() < sizeof(TextureHeader)) {
+        return false;
+    }
+    TextureHeader header {};
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, BAKED_TEXTURE_MAGIC, sizeof(header.magic)) != 0 || header.version != BAKED_TEXTURE_VERSION
+        || header.sourceHash != sourceHash || !validFormat(header.format) || header.levelCount == 0
+        || header.levelCount > 32 || sizeof(header) + (uint64_t)header.levelCount * sizeof(LevelIndex) > file.size()) {
+        return false;
+    }
+
+    BakedTexture loaded;
+    loaded.format = (BlockFormat)header.format;
+    loaded.srgb = header.srgb != 0;
+    int width = (int)header.width;
+    int height = (int)header.height;
+    for (uint32_t i = 0; i < header.levelCount; i++) {
+        LevelIndex entry {};
+        memcpy(&entry, file.data() + sizeof(header) + (size_t)i * sizeof(LevelIndex), sizeof(entry));
+        uint64_t expected = (uint64_t)blocksAcross(width) * blocksAcross(height) * blockBytes(loaded.format);
+        if (entry.length != expected || entry.offset > file.size() || entry.length > file.size() - entry.offset) {
+            return false;
+        }
+        BakedLevel level;
+        level.width = width;
+        level.height = height;
+        level.blocks.assign(file.data() + entry.offset, file.data() + entry.offset + entry.length);
+        loaded.levels.push_back(std::move(level));
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    texture = std::move(loaded);
+    return true;
+}
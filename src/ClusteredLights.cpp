@@ -0,0 +1,258 @@
+#include "ClusteredLights.h"
+#include "utils/Simd.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+float lightRadius(const PointLight& light)
+{
+    float brightest = std::max({ light.colour.x, light.colour.y, light.colour.z })
+        * std::max({ light.ambient, light.diffuse, light.specular });
+    // solve constant + linear d + quadratic d^2 = 256 * brightest, constant 1
+    float target = 256.0f * brightest - 1.0f;
+    if (target <= 0.0f) {
+        return 0.0f;
+    }
+    if (light.quadratic > 0.0f) {
+        float disc = light.linear * light.linear + 4.0f * light.quadratic * target;
+        return std::min((std::sqrt(disc) - light.linear) / (2.0f * light.quadratic), CLUSTER_FAR);
+    }
+    if (light.linear > 0.0f) {
+        return std::min(target / light.linear, CLUSTER_FAR);
+    }
+    return CLUSTER_FAR;
+}
+
+float clusterSliceDepth(int slice)
+{
+    if (slice <= 0) {
+        return 0.0f;
+    }
+    if (slice >= CLUSTER_Z) {
+        return CLUSTER_FAR;
+    }
+    return CLUSTER_NEAR * std::pow(CLUSTER_FAR / CLUSTER_NEAR, (float)(slice - 1) / (CLUSTER_Z - 1));
+}
+
+int clusterSlice(float depth)
+{
+    if (depth < CLUSTER_NEAR) {
+        return 0;
+    }
+    if (depth >= CLUSTER_FAR) {
+        return CLUSTER_Z;
+    }
+    int slice = 1 + (int)(std::log(depth / CLUSTER_NEAR) * (CLUSTER_Z - 1) / std::log(CLUSTER_FAR / CLUSTER_NEAR));
+    return std::min(slice, CLUSTER_Z - 1);
+}
+
+void ClusterBinner::buildBoxes(const CameraLens& lens)
+{
+    for (auto* bound : { &m_minX, &m_minY, &m_minZ, &m_maxX, &m_maxY, &m_maxZ }) {
+        bound->resize(CLUSTER_COUNT);
+    }
+    float tanX = lens.tanHalfFovY * lens.aspect;
+    float tanY = lens.tanHalfFovY;
+    for (int z = 0; z < CLUSTER_Z; z++) {
+        float nearDepth = clusterSliceDepth(z);
+        float farDepth = clusterSliceDepth(z + 1);
+        for (int y = 0; y < CLUSTER_Y; y++) {
+            float bottom = (-1.0f + 2.0f * y / CLUSTER_Y) * tanY;
+            float top = (-1.0f + 2.0f * (y + 1) / CLUSTER_Y) * tanY;
+            for (int x = 0; x < CLUSTER_X; x++) {
+                float left = (-1.0f + 2.0f * x / CLUSTER_X) * tanX;
+                float right = (-1.0f + 2.0f * (x + 1) / CLUSTER_X) * tanX;
+                size_t c = ((size_t)z * CLUSTER_Y + y) * CLUSTER_X + x;
+                // a tile's edges fan out from the eye, so its widest extent
+                // on each side is at one of the two depths
+                m_minX[c] = std::min(left * nearDepth, left * farDepth);
+                m_maxX[c] = std::max(right * nearDepth, right * farDepth);
+                m_minY[c] = std::min(bottom * nearDepth, bottom * farDepth);
+                m_maxY[c] = std::max(top * nearDepth, top * farDepth);
+                m_minZ[c] = nearDepth;
+                m_maxZ[c] = farDepth;
+            }
+        }
+    }
+    m_lens = lens;
+    m_haveLens = true;
+}
+
+namespace {
+// Tiles a light can reach along one screen axis, from the box around its
+// sphere seen at both ends of its depth range. False when it is off screen.
+bool tileSpan(float centre, float radius, float nearDepth, float farDepth, float tanHalf, int tiles, int& first,
+    int& last)
+{
+    float low = std::min((centre - radius) / nearDepth, (centre - radius) / farDepth) / tanHalf;
+    float high = std::max((centre + radius) / nearDepth, (centre + radius) / farDepth) / tanHalf;
+    if (low > 1.0f || high < -1.0f) {
+        return false;
+    }
+    low = std::max(low, -1.0f);
+    high = std::min(high, 1.0f);
+    first = std::clamp((int)std::floor((low + 1.0f) * 0.5f * tiles), 0, tiles - 1);
+    last = std::clamp((int)std::floor((high + 1.0f) * 0.5f * tiles), 0, tiles - 1);
+    return true;
+}
+}
+
+void ClusterBinner::bin(const glm::mat4& view, const CameraLens& lens, const PointLight* lights, size_t count)
+{
+    auto start = std::chrono::steady_clock::now();
+    if (!m_haveLens || lens.tanHalfFovY != m_lens.tanHalfFovY || lens.aspect != m_lens.aspect) {
+        buildBoxes(lens);
+    }
+    count = std::min(count, CLUSTER_MAX_LIGHTS);
+    m_texels.resize(count * 3);
+    m_hitClusters.clear();
+    m_hitLights.clear();
+    m_stats = {};
+    m_stats.lights = count;
+
+    float tanX = lens.tanHalfFovY * lens.aspect;
+    float tanY = lens.tanHalfFovY;
+    const simd::Float4 zero = simd::set1(0.0f);
+    for (size_t i = 0; i < count; i++) {
+        const PointLight& light = lights[i];
+        float radius = lightRadius(light);
+        m_texels[i * 3] = glm::vec4(light.position, radius);
+        m_texels[i * 3 + 1] = glm::vec4(light.colour, light.linear);
+        m_texels[i * 3 + 2] = glm::vec4(light.ambient, light.diffuse, light.specular, light.quadratic);
+
+        glm::vec3 centre(view * glm::vec4(light.position, 1.0f));
+        float depth = -centre.z;
+        if (radius <= 0.0f || depth + radius <= 0.0f || depth - radius >= CLUSTER_FAR) {
+            continue;
+        }
+        int firstSlice = clusterSlice(std::max(depth - radius, 0.0f));
+        int lastSlice = std::min(clusterSlice(depth + radius), CLUSTER_Z - 1);
+        int firstX = 0, lastX = CLUSTER_X - 1;
+        int firstY = 0, lastY = CLUSTER_Y - 1;
+        // a sphere around the eye can reach any tile
+        if (depth - radius > 0.0f) {
+            if (!tileSpan(centre.x, radius, depth - radius, depth + radius, tanX, CLUSTER_X, firstX, lastX)
+                || !tileSpan(centre.y, radius, depth - radius, depth + radius, tanY, CLUSTER_Y, firstY, lastY)) {
+                continue;
+            }
+        }
+
+        // squared distance from the centre to each box, four boxes of a row
+        // at once; lanes either side of the span are real tests too
+        simd::Float4 cx = simd::set1(centre.x);
+        simd::Float4 cy = simd::set1(centre.y);
+        simd::Float4 cz = simd::set1(depth);
+        simd::Float4 radiusSquared = simd::set1(radius * radius);
+        size_t hitsBefore = m_hitClusters.size();
+        for (int z = firstSlice; z <= lastSlice; z++) {
+            for (int y = firstY; y <= lastY; y++) {
+                size_t row = ((size_t)z * CLUSTER_Y + y) * CLUSTER_X;
+                for (int x = firstX & ~3; x <= lastX; x += 4) {
+                    size_t c = row + x;
+                    simd::Float4 dx = simd::max(simd::max(simd::sub(simd::load(&m_minX[c]), cx),
+                                                    simd::sub(cx, simd::load(&m_maxX[c]))),
+                        zero);
+                    simd::Float4 dy = simd::max(simd::max(simd::sub(simd::load(&m_minY[c]), cy),
+                                                    simd::sub(cy, simd::load(&m_maxY[c]))),
+                        zero);
+                    simd::Float4 dz = simd::max(simd::max(simd::sub(simd::load(&m_minZ[c]), cz),
+                                                    simd::sub(cz, simd::load(&m_maxZ[c]))),
+                        zero);
+                    simd::Float4 distance = simd::add(simd::add(simd::mul(dx, dx), simd::mul(dy, dy)), simd::mul(dz, dz));
+                    int inside = simd::mask(simd::less(distance, radiusSquared));
+                    for (int lane = 0; lane < 4; lane++) {
+                        if (inside & (1 << lane)) {
+                            m_hitClusters.push_back((uint32_t)(c + lane));
+                            m_hitLights.push_back((uint16_t)i);
+                        }
+                    }
+                }
+            }
+        }
+        if (m_hitClusters.size() > hitsBefore) {
+            m_stats.lightsBinned++;
+        }
+    }
+
+    // counting sort of the hits into one list per cluster, lights in order
+    m_ranges.assign(CLUSTER_COUNT * 2, 0);
+    for (uint32_t cluster : m_hitClusters) {
+        m_ranges[cluster * 2 + 1]++;
+    }
+    uint32_t offset = 0;
+    for (int c = 0; c < CLUSTER_COUNT; c++) {
+        m_stats.busiestCluster = std::max(m_stats.busiestCluster, (size_t)m_ranges[c * 2 + 1]);
+        m_ranges[c * 2] = offset;
+        offset += m_ranges[c * 2 + 1];
+        m_ranges[c * 2 + 1] = 0;
+    }
+    m_indices.resize(std::min((size_t)offset, m_indexLimit));
+    for (size_t h = 0; h < m_hitClusters.size(); h++) {
+        uint32_t cluster = m_hitClusters[h];
+        uint32_t slot = m_ranges[cluster * 2] + m_ranges[cluster * 2 + 1];
+        if (slot >= m_indices.size()) {
+            m_stats.dropped++;
+            continue;
+        }
+        m_indices[slot] = m_hitLights[h];
+        m_ranges[cluster * 2 + 1]++;
+    }
+    m_stats.indices = m_indices.size();
+    m_stats.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+ClusterBuffers::ClusterBuffers()
+{
+    glGenBuffers(3, m_buffers);
+    glGenTextures(3, m_textures);
+    GLint maxTexels = 65536;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    m_maxTexels = (size_t)std::max(maxTexels, 65536);
+}
+
+ClusterBuffers::~ClusterBuffers()
+{
+    glDeleteTextures(3, m_textures);
+    glDeleteBuffers(3, m_buffers);
+}
+
+void ClusterBuffers::upload(const ClusterBinner& binner)
+{
+    struct Source {
+        const void* data;
+        size_t bytes;
+        GLenum format;
+    };
+    // an empty buffer makes an incomplete texture, so there is always a texel
+    static const glm::vec4 noLight(0.0f);
+    static const uint16_t noIndex = 0;
+    const Source sources[3] = {
+        binner.lightTexels().empty()
+            ? Source { &noLight, sizeof(noLight), GL_RGBA32F }
+            : Source { binner.lightTexels().data(), binner.lightTexels().size() * sizeof(glm::vec4), GL_RGBA32F },
+        { binner.ranges().data(), binner.ranges().size() * sizeof(uint32_t), GL_RG32UI },
+        binner.indices().empty()
+            ? Source { &noIndex, sizeof(noIndex), GL_R16UI }
+            : Source { binner.indices().data(), binner.indices().size() * sizeof(uint16_t), GL_R16UI },
+    };
+    for (int i = 0; i < 3; i++) {
+        // respecifying the store lets the driver hand over fresh memory
+        // instead of waiting for last frame's draws
+        glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)sources[i].bytes, sources[i].data, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, sources[i].format, m_buffers[i]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusterBuffers::bind(unsigned int unit) const
+{
+    for (unsigned int i = 0; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE0 + unit + i);
+        glBindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
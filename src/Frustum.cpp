@@ -0,0 +1,125 @@
+#include "Frustum.h"
+#include "utils/Simd.h"
+#include <cmath>
+
+Frustum Frustum::fromMatrix(const glm::mat4& projectionView)
+{
+    // Gribb and Hartmann: each plane is the fourth row plus or minus another
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; r++) {
+        rows[r] = glm::vec4(projectionView[0][r], projectionView[1][r], projectionView[2][r], projectionView[3][r]);
+    }
+    Frustum frustum;
+    for (int i = 0; i < 3; i++) {
+        frustum.planes[i * 2] = rows[3] + rows[i];
+        frustum.planes[i * 2 + 1] = rows[3] - rows[i];
+    }
+    for (auto& plane : frustum.planes) {
+        float length = glm::length(glm::vec3(plane));
+        if (!std::isfinite(length) || !std::isfinite(plane.w) || length <= 1e-12f) {
+            plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        } else {
+            plane /= length;
+        }
+    }
+    return frustum;
+}
+
+bool Frustum::intersects(const glm::vec3& centre, const glm::vec3& extent) const
+{
+    for (const auto& plane : planes) {
+        glm::vec3 normal(plane);
+        float distance = glm::dot(normal, centre) + plane.w;
+        float radius = glm::dot(glm::abs(normal), extent);
+        if (distance + radius < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BoxList::clear()
+{
+    centreX.clear();
+    centreY.clear();
+    centreZ.clear();
+    extentX.clear();
+    extentY.clear();
+    extentZ.clear();
+}
+
+void BoxList::reserve(size_t count)
+{
+    centreX.reserve(count);
+    centreY.reserve(count);
+    centreZ.reserve(count);
+    extentX.reserve(count);
+    extentY.reserve(count);
+    extentZ.reserve(count);
+}
+
+void BoxList::add(const glm::vec3& centre, const glm::vec3& extent)
+{
+    centreX.push_back(centre.x);
+    centreY.push_back(centre.y);
+    centreZ.push_back(centre.z);
+    extentX.push_back(extent.x);
+    extentY.push_back(extent.y);
+    extentZ.push_back(extent.z);
+}
+
+void transformBox(const glm::mat4& transform, const glm::vec3& centre, const glm::vec3& extent, glm::vec3& outCentre,
+    glm::vec3& outExtent)
+{
+    outCentre = glm::vec3(transform * glm::vec4(centre, 1.0f));
+    outExtent = glm::abs(glm::vec3(transform[0])) * extent.x + glm::abs(glm::vec3(transform[1])) * extent.y
+        + glm::abs(glm::vec3(transform[2])) * extent.z;
+}
+
+size_t cullBoxes(const Frustum& frustum, const BoxList& boxes, std::vector<uint8_t>& visible)
+{
+    size_t count = boxes.size();
+    visible.resize(count);
+    simd::Float4 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], w[6];
+    for (int p = 0; p < 6; p++) {
+        const glm::vec4& plane = frustum.planes[p];
+        nx[p] = simd::set1(plane.x);
+        ny[p] = simd::set1(plane.y);
+        nz[p] = simd::set1(plane.z);
+        ax[p] = simd::set1(std::abs(plane.x));
+        ay[p] = simd::set1(std::abs(plane.y));
+        az[p] = simd::set1(std::abs(plane.z));
+        w[p] = simd::set1(plane.w);
+    }
+    const simd::Float4 zero = simd::set1(0.0f);
+
+    size_t inside = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        simd::Float4 cx = simd::load(&boxes.centreX[i]);
+        simd::Float4 cy = simd::load(&boxes.centreY[i]);
+        simd::Float4 cz = simd::load(&boxes.centreZ[i]);
+        simd::Float4 ex = simd::load(&boxes.extentX[i]);
+        simd::Float4 ey = simd::load(&boxes.extentY[i]);
+        simd::Float4 ez = simd::load(&boxes.extentZ[i]);
+        int outside = 0;
+        for (int p = 0; p < 6; p++) {
+            simd::Float4 distance = simd::add(simd::add(simd::mul(nx[p], cx), simd::mul(ny[p], cy)),
+                simd::add(simd::mul(nz[p], cz), w[p]));
+            simd::Float4 radius = simd::add(simd::add(simd::mul(ax[p], ex), simd::mul(ay[p], ey)), simd::mul(az[p], ez));
+            outside |= simd::mask(simd::less(simd::add(distance, radius), zero));
+        }
+        for (int lane = 0; lane < 4; lane++) {
+            uint8_t in = (outside >> lane) & 1 ? 0 : 1;
+            visible[i + lane] = in;
+            inside += in;
+        }
+    }
+    for (; i < count; i++) {
+        glm::vec3 centre(boxes.centreX[i], boxes.centreY[i], boxes.centreZ[i]);
+        glm::vec3 extent(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+        visible[i] = frustum.intersects(centre, extent) ? 1 : 0;
+        inside += visible[i];
+    }
+    return inside;
+}
@@ -0,0 +1,40 @@
+#include "utils/GLHandle.h"
+#include <GL/glew.h>
+#include <atomic>
+
+namespace {
+std::atomic<int> liveBuffers { 0 };
+std::atomic<int> liveVertexArrays { 0 };
+}
+
+unsigned int createGLObject(GLObjectKind kind)
+{
+    GLuint id = 0;
+    if (kind == GLObjectKind::Buffer) {
+        glGenBuffers(1, &id);
+        liveBuffers++;
+    } else {
+        glGenVertexArrays(1, &id);
+        liveVertexArrays++;
+    }
+    return id;
+}
+
+void deleteGLObject(GLObjectKind kind, unsigned int id)
+{
+    if (kind == GLObjectKind::Buffer) {
+        glDeleteBuffers(1, &id);
+        liveBuffers--;
+    } else {
+        glDeleteVertexArrays(1, &id);
+        liveVertexArrays--;
+    }
+}
+
+GLObjectStats glObjectStats()
+{
+    GLObjectStats stats;
+    stats.buffers = liveBuffers.load();
+    stats.vertexArrays = liveVertexArrays.load();
+    return stats;
+}
@@ -0,0 +1,269 @@
+#include "utils/HeightPyramid.h"
+#include "utils/Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+namespace {
+// Pushes a point on a cell boundary into the cell the ray is heading for.
+constexpr float CELL_NUDGE = 1.0e-4f;
+// Boxes are padded slightly so rays grazing a flat cell still reach the leaf test.
+constexpr float BOX_EPSILON = 1.0e-3f;
+
+float safeInverse(float d)
+{
+    if (std::fabs(d) < 1.0e-12f) {
+        return d < 0.0f ? -1.0e30f : 1.0e30f;
+    }
+    return 1.0f / d;
+}
+
+// Spreads the low 16 bits of v out to the even bit positions.
+uint32_t interleaveBits(uint32_t v)
+{
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+}
+
+void HeightPyramid::build(const Array2D<float>& heightMap, int width, int height)
+{
+    m_heights = heightMap;
+    m_levels.clear();
+    if (width < 2 || height < 2) {
+        return;
+    }
+
+    int cellsX = width - 1;
+    int cellsZ = height - 1;
+    while (true) {
+        Level level;
+        level.cellsX = cellsX;
+        level.cellsZ = cellsZ;
+        level.range.resize((size_t)cellsX * cellsZ);
+        m_levels.push_back(std::move(level));
+        if (cellsX == 1 && cellsZ == 1) {
+            break;
+        }
+        cellsX = (cellsX + 1) / 2;
+        cellsZ = (cellsZ + 1) / 2;
+    }
+    update(0, 0, width, height);
+}
+
+void HeightPyramid::update(int x0, int z0, int x1, int z1)
+{
+    if (m_levels.empty()) {
+        return;
+    }
+    // a vertex belongs to the cells on either side of it
+    x0 = std::max(x0 - 1, 0);
+    z0 = std::max(z0 - 1, 0);
+    x1 = std::min(x1, m_levels[0].cellsX);
+    z1 = std::min(z1, m_levels[0].cellsZ);
+    if (x0 >= x1 || z0 >= z1) {
+        return;
+    }
+    refreshLeaves(x0, z0, x1, z1);
+    for (int level = 1; level < (int)m_levels.size(); level++) {
+        x0 >>= 1;
+        z0 >>= 1;
+        x1 = ((x1 - 1) >> 1) + 1;
+        z1 = ((z1 - 1) >> 1) + 1;
+        refreshLevel(level, x0, z0, x1, z1);
+    }
+}
+
+void HeightPyramid::refreshLeaves(int x0, int z0, int x1, int z1)
+{
+    Level& leaves = m_levels[0];
+    parallelFor(x0, x1, 64, [&](int xBegin, int xEnd) {
+        for (int x = xBegin; x < xEnd; x++) {
+            const float* row0 = m_heights.rowData(x);
+            const float* row1 = m_heights.rowData(x + 1);
+            for (int z = z0; z < z1; z++) {
+                // stored heights are negated, so the world minimum is the stored maximum
+                float a = std::max(std::max(row0[z], row0[z + 1]), std::max(row1[z], row1[z + 1]));
+                float b = std::min(std::min(row0[z], row0[z + 1]), std::min(row1[z], row1[z + 1]));
+                size_t index = (size_t)x * leaves.cellsZ + z;
+                leaves.range[index] = glm::vec2(-a, -b);
+            }
+        }
+    });
+}
+
+void HeightPyramid::refreshLevel(int level, int x0, int z0, int x1, int z1)
+{
+    const Level& child = m_levels[level - 1];
+    Level& parent = m_levels[level];
+    for (int x = x0; x < x1; x++) {
+        for (int z = z0; z < z1; z++) {
+            float lo = 1.0e30f;
+            float hi = -1.0e30f;
+            for (int cx = 2 * x; cx < std::min(2 * x + 2, child.cellsX); cx++) {
+                for (int cz = 2 * z; cz < std::min(2 * z + 2, child.cellsZ); cz++) {
+                    size_t index = (size_t)cx * child.cellsZ + cz;
+                    lo = std::min(lo, child.range[index].x);
+                    hi = std::max(hi, child.range[index].y);
+                }
+            }
+            size_t index = (size_t)x * parent.cellsZ + z;
+            parent.range[index] = glm::vec2(lo, hi);
+        }
+    }
+}
+
+bool HeightPyramid::intersectCell(int x, int z, const glm::vec3& origin, const glm::vec3& direction,
+    float tEnter, float tExit, TerrainHit& hit) const
+{
+    float h00 = worldHeight(x, z);
+    float h10 = worldHeight(x + 1, z);
+    float h01 = worldHeight(x, z + 1);
+    float h11 = worldHeight(x + 1, z + 1);
+
+    // Same bilinear surface as GetHeightInterpolated: h00 + b*u + c*v + e*u*v.
+    // Along the ray u and v are linear in t, so ray height minus surface height
+    // is a quadratic in t, solved relative to the cell entry point.
+    glm::vec3 entry = origin + direction * tEnter;
+    float u0 = entry.x - x;
+    float v0 = entry.z - z;
+    float b = h10 - h00;
+    float c = h01 - h00;
+    float e = h00 - h10 - h01 + h11;
+
+    float qa = -e * direction.x * direction.z;
+    float qb = direction.y - b * direction.x - c * direction.z - e * (u0 * direction.z + v0 * direction.x);
+    float qc = entry.y - (h00 + b * u0 + c * v0 + e * u0 * v0);
+    float span = tExit - tEnter + 1.0e-4f;
+
+    float s = -1.0f;
+    if (qc <= 0.0f) {
+        // already below the surface where the ray enters this cell
+        s = 0.0f;
+    } else if (std::fabs(qa) < 1.0e-8f) {
+        if (qb < 0.0f) {
+            s = -qc / qb;
+        }
+    } else {
+        float discriminant = qb * qb - 4.0f * qa * qc;
+        if (discriminant >= 0.0f) {
+            float q = -0.5f * (qb + std::copysign(std::sqrt(discriminant), qb));
+            float r0 = q / qa;
+            float r1 = q != 0.0f ? qc / q : r0;
+            if (r0 > r1) {
+                std::swap(r0, r1);
+            }
+            s = r0 >= 0.0f ? r0 : r1;
+        }
+    }
+    if (s < 0.0f || s > span) {
+        return false;
+    }
+
+    glm::vec3 point = entry + direction * s;
+    float u = std::min(std::max(point.x - x, 0.0f), 1.0f);
+    float v = std::min(std::max(point.z - z, 0.0f), 1.0f);
+    hit.hit = true;
+    hit.point = point;
+    hit.normal = glm::normalize(glm::vec3(-(b + e * v), 1.0f, -(c + e * u)));
+    hit.distance = tEnter + s;
+    return true;
+}
+
+TerrainHit HeightPyramid::raycast(const TerrainRay& ray) const
+{
+    TerrainHit result;
+    float length = glm::length(ray.direction);
+    if (m_levels.empty() || length <= 0.0f) {
+        return result;
+    }
+    const glm::vec3 origin = ray.origin;
+    const glm::vec3 direction = ray.direction / length;
+    const glm::vec3 inverse(safeInverse(direction.x), safeInverse(direction.y), safeInverse(direction.z));
+    const int top = (int)m_levels.size() - 1;
+    const int leafCellsX = m_levels[0].cellsX;
+    const int leafCellsZ = m_levels[0].cellsZ;
+
+    // Clip the ray against the root box first.
+    const glm::vec2 rootRange = m_levels[top].range[0];
+    float tStart = 0.0f;
+    float tEnd = ray.maxDistance;
+    {
+        float x0 = (0.0f - origin.x) * inverse.x;
+        float x1 = ((float)leafCellsX - origin.x) * inverse.x;
+        float y0 = (rootRange.x - BOX_EPSILON - origin.y) * inverse.y;
+        float y1 = (rootRange.y + BOX_EPSILON - origin.y) * inverse.y;
+        float z0 = (0.0f - origin.z) * inverse.z;
+        float z1 = ((float)leafCellsZ - origin.z) * inverse.z;
+        tStart = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), tStart));
+        tEnd = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), tEnd));
+    }
+    if (tStart > tEnd) {
+        return result;
+    }
+
+    // Walk the leaf cells the ray crosses, but climb the pyramid while the ray
+    // stays above a node's maximum and skip straight to where it leaves that
+    // node; only descend where the ray dips into a node's height range.
+    const float stepX = direction.x > 0.0f ? CELL_NUDGE : -CELL_NUDGE;
+    const float stepZ = direction.z > 0.0f ? CELL_NUDGE : -CELL_NUDGE;
+    float t = tStart;
+    int level = top;
+    while (t < tEnd) {
+        glm::vec3 position = origin + direction * t;
+        int cellX = std::min(std::max((int)std::floor(position.x + stepX), 0), leafCellsX - 1);
+        int cellZ = std::min(std::max((int)std::floor(position.z + stepZ), 0), leafCellsZ - 1);
+        int nodeX = cellX >> level;
+        int nodeZ = cellZ >> level;
+
+        float tExit = tEnd;
+        if (direction.x != 0.0f) {
+            int edge = direction.x > 0.0f ? std::min((nodeX + 1) << level, leafCellsX) : nodeX << level;
+            tExit = std::min(tExit, ((float)edge - origin.x) * inverse.x);
+        }
+        if (direction.z != 0.0f) {
+            int edge = direction.z > 0.0f ? std::min((nodeZ + 1) << level, leafCellsZ) : nodeZ << level;
+            tExit = std::min(tExit, ((float)edge - origin.z) * inverse.z);
+        }
+        tExit = std::max(tExit, t);
+
+        const Level& node = m_levels[level];
+        const glm::vec2 range = node.range[(size_t)nodeX * node.cellsZ + nodeZ];
+        float lowest = std::min(position.y, origin.y + direction.y * tExit);
+        if (lowest > range.y + BOX_EPSILON) {
+            t = tExit > t ? tExit : t + CELL_NUDGE;
+            level = std::min(level + 1, top);
+            continue;
+        }
+        if (level > 0) {
+            level--;
+            continue;
+        }
+        if (intersectCell(cellX, cellZ, origin, direction, t, tExit, result)) {
+            return result;
+        }
+        t = tExit > t ? tExit : t + CELL_NUDGE;
+    }
+    return result;
+}
+
+void HeightPyramid::raycast(const TerrainRay* rays, TerrainHit* hits, size_t count) const
+{
+    // Walk the batch in Morton order of the ray origins so neighbouring rays
+    // reuse the same pyramid nodes and height rows while they are still cached.
+    std::vector<std::pair<uint32_t, uint32_t>> order(count);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t x = (uint32_t)std::min(std::max(rays[i].origin.x, 0.0f), 65535.0f);
+        uint32_t z = (uint32_t)std::min(std::max(rays[i].origin.z, 0.0f), 65535.0f);
+        order[i] = { interleaveBits(x) | (interleaveBits(z) << 1), (uint32_t)i };
+    }
+    std::sort(order.begin(), order.end());
+    for (const auto& entry : order) {
+        hits[entry.second] = raycast(rays[entry.second]);
+    }
+}
@@ -0,0 +1,58 @@
+#include "utils/JobSystem.h"
+
+JobSystem::JobSystem(unsigned int workers)
+{
+    if (workers == 0) {
+        unsigned int threads = std::thread::hardware_concurrency();
+        workers = threads > 1 ? threads - 1 : 1;
+    }
+    m_workers.reserve(workers);
+    for (unsigned int i = 0; i < workers; i++) {
+        m_workers.emplace_back([this] { run(); });
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void JobSystem::push(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(job));
+    }
+    m_wake.notify_one();
+}
+
+void JobSystem::run()
+{
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            // drain what is already queued before shutting down
+            if (m_queue.empty()) {
+                return;
+            }
+            job = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        job();
+    }
+}
+
+JobSystem& jobs()
+{
+    static JobSystem system;
+    return system;
+}
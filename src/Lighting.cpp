@@ -0,0 +1,15 @@
+#include "Lighting.h"
+#include <GL/glew.h>
+#include <cstring>
+
+void bindLighting(StreamBuffer& stream, const LightingBlock& block)
+{
+    StreamAllocation range = stream.allocate(sizeof(LightingBlock), stream.uniformAlignment());
+    if (!range.data) {
+        // the ring regrows next frame; until then the binding keeps an older block
+        return;
+    }
+    memcpy(range.data, &block, sizeof(LightingBlock));
+    glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTING_BLOCK_BINDING, stream.buffer(), (GLintptr)range.offset,
+        sizeof(LightingBlock));
+}
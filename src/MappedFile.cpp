@@ -0,0 +1,116 @@
+#include "utils/MappedFile.h"
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SPOOKY_HAS_MMAP 1
+#endif
+
+MappedFile::MappedFile(const std::string& path)
+{
+#ifdef SPOOKY_HAS_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info {};
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* mapping = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            m_data = static_cast<const unsigned char*>(mapping);
+            m_size = (size_t)info.st_size;
+            m_mapped = true;
+        }
+    }
+    ::close(fd);
+#else
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size > 0) {
+        m_buffer.resize((size_t)size);
+        if (fread(m_buffer.data(), 1, m_buffer.size(), file) == m_buffer.size()) {
+            m_data = m_buffer.data();
+            m_size = m_buffer.size();
+        }
+    }
+    fclose(file);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other) {
+        close();
+        m_buffer = std::move(other.m_buffer);
+        m_data = other.m_mapped ? other.m_data : (m_buffer.empty() ? nullptr : m_buffer.data());
+        m_size = other.m_size;
+        m_mapped = other.m_mapped;
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_mapped = false;
+    }
+    return *this;
+}
+
+void MappedFile::close()
+{
+#ifdef SPOOKY_HAS_MMAP
+    if (m_mapped && m_data != nullptr) {
+        munmap(const_cast<unsigned char*>(m_data), m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+    m_buffer.clear();
+}
+
+bool writeFileAtomically(const std::string& path, const std::vector<FileChunk>& chunks)
+{
+    // a per-process tag and a counter keep concurrent writers of the same path
+    // apart, whether they are threads here or other processes
+    static const unsigned int processTag = std::random_device {}();
+    static std::atomic<unsigned int> counter { 0 };
+    std::string tmpPath = path + "." + std::to_string(processTag) + "-" + std::to_string(counter++) + ".tmp";
+
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; ok && i < chunks.size(); i++) {
+        ok = chunks[i].size == 0 || fwrite(chunks[i].data, 1, chunks[i].size, file) == chunks[i].size;
+    }
+    ok = fclose(file) == 0 && ok;
+    std::error_code error;
+    if (ok) {
+        std::filesystem::rename(tmpPath, path, error);
+    }
+    if (!ok || error) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -5,34 +5,42 @@
 #include "Mesh.h"
 
 Mesh::Mesh(std::vector<vertex> vertices, std::vector<unsigned int> indices, std::vector<texture> textures,
-           aiAABB boundingbox, glm::vec3 pos, float pitch, float yaw, float roll)
-    : vertices{vertices}
-      , indices{indices}
-      , textures{textures} {
+           aiAABB boundingbox, glm::vec3 pos, float pitch, float yaw, float roll, MeshResidency residency,
+           std::vector<MeshLod> lods)
+    : vertices{std::move(vertices)}
+      , indices{std::move(indices)}
+      , textures{std::move(textures)}
+      , residency(residency)
+      , vertexCount(this->vertices.size())
+      , indexCount(this->indices.size())
+      , lods{std::move(lods)} {
+    if (this->lods.empty()) {
+        this->lods.push_back({0, static_cast<unsigned int>(indexCount), 0.0f});
+    }
     setUpMesh();
+    nameSamplers();
+    releaseCpuData();
     this->boundingbox = std::make_shared<BoundingBox>(boundingbox, pos, pitch, yaw, roll);
 }
 
 
-Mesh::Mesh(const Mesh &mesh): VAO(0), VBO(0), EBO(0) {
-    this->VAO = mesh.VAO;
-    this->VBO = mesh.VBO;
-    this->VBO = mesh.EBO;
-    this->textures = mesh.textures;
-    this->indices = mesh.indices;
-    this->boundingbox = mesh.boundingbox;
+void Mesh::bindTextures(Shader &shader) {
+    for (unsigned int i = 0; i < textures.size(); i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        shader.setInt(UniformKey(samplers[i].name.c_str(), samplers[i].hash), i);
+        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+    }
 }
 
-
-void Mesh::draw(Shader &shader) {
+void Mesh::nameSamplers() {
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
     unsigned int normalNr = 1;
     unsigned int heightNr = 1;
-    for (unsigned int i = 0; i < textures.size(); i++) {
-        glActiveTexture(GL_TEXTURE0 + i);
+    samplers.clear();
+    for (const auto &t : textures) {
         std::string number;
-        std::string name = textures[i].type;
+        const std::string &name = t.type;
         if (name == "texture_diffuse")
             number = std::to_string(diffuseNr++);
         else if (name == "texture_specular")
@@ -41,43 +49,68 @@ void Mesh::draw(Shader &shader) {
             number = std::to_string(normalNr++);
         else if (name == "texture_height")
             number = std::to_string(heightNr++);
-        glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        std::string sampler = name + number;
+        uint64_t hash = hashString(sampler);
+        samplers.push_back({std::move(sampler), hash});
     }
+}
 
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+void Mesh::draw(Shader &shader, int lod) {
+    bindTextures(shader);
+    const MeshLod &range = level(lod);
+    glBindVertexArray(VAO.id());
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(range.indexCount), GL_UNSIGNED_INT,
+                   (void *) (range.firstIndex * sizeof(unsigned int)));
     glBindVertexArray(0);
     glActiveTexture(GL_TEXTURE0);
 }
 
 void Mesh::setUpMesh() {
     // create buffers/arrays
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    VAO = GLVertexArray::create();
+    VBO = GLBuffer::create();
+    EBO = GLBuffer::create();
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertex), &vertices[0], GL_STATIC_DRAW);
+    format = chooseVertexFormat(vertices, textures);
+    std::vector<unsigned char> packed = packVertices(vertices, format);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glBindVertexArray(VAO.id());
+    glBindBuffer(GL_ARRAY_BUFFER, VBO.id());
+    glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) 0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, normal));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, textureCoordinates));
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, tangent));
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, bitangent));
-    glEnableVertexAttribArray(5);
-    glVertexAttribIPointer(5, 4, GL_INT, sizeof(vertex), (void *) offsetof(vertex, boneid));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO.id());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
 
-    glEnableVertexAttribArray(6);
-    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, weights));
+    bindVertexFormat(format);
     glBindVertexArray(0);
 }
+
+void Mesh::releaseCpuData() {
+    if (residency == MeshResidency::Positions) {
+        positions.reserve(vertices.size());
+        for (const auto &v : vertices) {
+            positions.push_back(v.position);
+        }
+    }
+    if (residency != MeshResidency::Full) {
+        // swap with empties so the capacity goes too, not just the size
+        std::vector<vertex>().swap(vertices);
+        if (residency == MeshResidency::GpuOnly) {
+            std::vector<unsigned int>().swap(indices);
+        }
+    }
+    if (!indices.empty() && lods.size() > 1) {
+        // CPU users only want the full-detail triangles; level 0 comes first
+        indices.resize(lods[0].indexCount);
+        indices.shrink_to_fit();
+    }
+}
+
+size_t Mesh::residentBytes() const {
+    size_t bytes = vertices.capacity() * sizeof(vertex) + indices.capacity() * sizeof(unsigned int)
+                   + positions.capacity() * sizeof(glm::vec3) + textures.capacity() * sizeof(texture);
+    for (const auto &t : textures) {
+        bytes += t.type.capacity() + t.path.capacity();
+    }
+    return bytes;
+}
@@ -0,0 +1,246 @@
+#include "MeshCache.h"
+#include "utils/Hash.h"
+#include "utils/MappedFile.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+
+#define MODEL_CACHE_DIR "../cache/models"
+#define MODEL_CACHE_VERSION 3
+
+namespace {
+// Layout: header, meshCount BakedMesh records, then for each mesh its vertex
+// blob, index blob and texture strings, each starting on a 16 byte boundary.
+// Texture strings are (uint32 typeLength, uint32 pathLength, type, path).
+struct BakedHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint64_t sourceHash;
+    uint32_t meshCount;
+    float bounds[6];
+    float acmrBefore;
+    float acmrAfter;
+};
+
+struct BakedMesh {
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t textureOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureCount;
+    uint32_t textureBytes;
+    float bounds[6];
+    // ranges into the index blob, level 0 first
+    uint32_t lodCount;
+    MeshLod lods[MAX_MESH_LODS];
+};
+
+const char MODEL_CACHE_MAGIC[8] = { 'S', 'P', 'K', 'M', 'E', 'S', 'H', '\0' };
+
+uint64_t align16(uint64_t offset)
+{
+    return (offset + 15) & ~uint64_t(15);
+}
+
+void writeBounds(const aiAABB& box, float* out)
+{
+    out[0] = box.mMin.x;
+    out[1] = box.mMin.y;
+    out[2] = box.mMin.z;
+    out[3] = box.mMax.x;
+    out[4] = box.mMax.y;
+    out[5] = box.mMax.z;
+}
+
+aiAABB readBounds(const float* in)
+{
+    aiAABB box;
+    box.mMin.x = in[0];
+    box.mMin.y = in[1];
+    box.mMin.z = in[2];
+    box.mMax.x = in[3];
+    box.mMax.y = in[4];
+    box.mMax.z = in[5];
+    return box;
+}
+
+std::string cachePath(const std::string& sourcePath)
+{
+    std::string stem = std::filesystem::path(sourcePath).stem().string();
+    return std::string(MODEL_CACHE_DIR) + "/" + stem + "-" + hashToHex(hashString(sourcePath)) + ".spkmesh";
+}
+
+size_t textureBytes(const std::vector<texture>& textures)
+{
+    size_t bytes = 0;
+    for (const auto& texture : textures) {
+        bytes += 2 * sizeof(uint32_t) + texture.type.size() + texture.path.size();
+    }
+    return bytes;
+}
+}
+
+uint64_t hashModelSource(const std::string& sourcePath)
+{
+    MappedFile source(sourcePath);
+    if (!source.isOpen()) {
+        return 0;
+    }
+    uint64_t hash = hashBytes(source.data(), source.size());
+    // materials, and with them the texture references, live in the .mtl
+    MappedFile material(std::filesystem::path(sourcePath).replace_extension(".mtl").string());
+    if (material.isOpen()) {
+        hash = hashBytes(material.data(), material.size(), hash);
+    }
+    return hash;
+}
+
+bool loadBakedModel(const std::string& sourcePath, uint64_t sourceHash, ModelData& data)
+{
+    if (sourceHash == 0) {
+        return false;
+    }
+    MappedFile file(cachePath(sourcePath));
+    if (!file.isOpen() || file.size() < sizeof(BakedHeader)) {
+        return false;
+    }
+    BakedHeader header {};
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, MODEL_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != MODEL_CACHE_VERSION
+        || header.vertexSize != sizeof(vertex) || header.sourceHash != sourceHash
+        || sizeof(header) + (uint64_t)header.meshCount * sizeof(BakedMesh) > file.size()) {
+        return false;
+    }
+
+    const unsigned char* base = file.data();
+    auto inFile = [&](uint64_t offset, uint64_t bytes) { return offset <= file.size() && bytes <= file.size() - offset; };
+    std::vector<MeshData> meshes(header.meshCount);
+    for (uint32_t i = 0; i < header.meshCount; i++) {
+        BakedMesh record {};
+        memcpy(&record, base + sizeof(header) + (size_t)i * sizeof(BakedMesh), sizeof(record));
+        uint64_t vertexBytes = (uint64_t)record.vertexCount * sizeof(vertex);
+        uint64_t indexBytes = (uint64_t)record.indexCount * sizeof(unsigned int);
+        if (!inFile(record.vertexOffset, vertexBytes) || !inFile(record.indexOffset, indexBytes)
+            || !inFile(record.textureOffset, record.textureBytes)) {
+            std::cerr << "Ignoring truncated model cache for " << sourcePath << std::endl;
+            return false;
+        }
+        if (record.lodCount == 0 || record.lodCount > MAX_MESH_LODS) {
+            return false;
+        }
+        for (uint32_t l = 0; l < record.lodCount; l++) {
+            if ((uint64_t)record.lods[l].firstIndex + record.lods[l].indexCount > record.indexCount) {
+                return false;
+            }
+        }
+
+        // whole blobs straight out of the mapping, no per-vertex work
+        MeshData& mesh = meshes[i];
+        mesh.vertices.resize(record.vertexCount);
+        memcpy(mesh.vertices.data(), base + record.vertexOffset, vertexBytes);
+        mesh.indices.resize(record.indexCount);
+        memcpy(mesh.indices.data(), base + record.indexOffset, indexBytes);
+        mesh.boundingbox = readBounds(record.bounds);
+        mesh.lods.assign(record.lods, record.lods + record.lodCount);
+
+        const unsigned char* cursor = base + record.textureOffset;
+        const unsigned char* end = cursor + record.textureBytes;
+        for (uint32_t t = 0; t < record.textureCount; t++) {
+            uint32_t lengths[2];
+            if (end - cursor < (ptrdiff_t)sizeof(lengths)) {
+                return false;
+            }
+            memcpy(lengths, cursor, sizeof(lengths));
+            cursor += sizeof(lengths);
+            if ((uint64_t)(end - cursor) < (uint64_t)lengths[0] + lengths[1]) {
+                return false;
+            }
+            texture ref { 0, std::string((const char*)cursor, lengths[0]), std::string((const char*)cursor + lengths[0], lengths[1]) };
+            cursor += lengths[0] + lengths[1];
+            mesh.textures.push_back(std::move(ref));
+        }
+    }
+    data.meshes = std::move(meshes);
+    data.boundingbox = readBounds(header.bounds);
+    data.acmrBefore = header.acmrBefore;
+    data.acmrAfter = header.acmrAfter;
+    data.loaded = true;
+    return true;
+}
+
+void bakeModel(const std::string& sourcePath, uint64_t sourceHash, const ModelData& data)
+{
+    if (sourceHash == 0 || !data.loaded) {
+        return;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(MODEL_CACHE_DIR, error);
+
+    BakedHeader header {};
+    memcpy(header.magic, MODEL_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MODEL_CACHE_VERSION;
+    header.vertexSize = sizeof(vertex);
+    header.sourceHash = sourceHash;
+    header.meshCount = (uint32_t)data.meshes.size();
+    writeBounds(data.boundingbox, header.bounds);
+    header.acmrBefore = data.acmrBefore;
+    header.acmrAfter = data.acmrAfter;
+
+    std::vector<BakedMesh> records(data.meshes.size());
+    uint64_t offset = sizeof(header) + records.size() * sizeof(BakedMesh);
+    for (size_t i = 0; i < data.meshes.size(); i++) {
+        const MeshData& mesh = data.meshes[i];
+        BakedMesh& record = records[i];
+        record.vertexCount = (uint32_t)mesh.vertices.size();
+        record.indexCount = (uint32_t)mesh.indices.size();
+        record.textureCount = (uint32_t)mesh.textures.size();
+        record.textureBytes = (uint32_t)textureBytes(mesh.textures);
+        writeBounds(mesh.boundingbox, record.bounds);
+        record.lodCount = (uint32_t)std::min(mesh.lods.size(), (size_t)MAX_MESH_LODS);
+        std::copy(mesh.lods.begin(), mesh.lods.begin() + record.lodCount, record.lods);
+        record.vertexOffset = offset = align16(offset);
+        offset += (uint64_t)record.vertexCount * sizeof(vertex);
+        record.indexOffset = offset = align16(offset);
+        offset += (uint64_t)record.indexCount * sizeof(unsigned int);
+        record.textureOffset = offset = align16(offset);
+        offset += record.textureBytes;
+    }
+
+    static const unsigned char padding[16] = {};
+    std::vector<FileChunk> chunks;
+    // lengths are kept here so the chunks pointing at them stay valid
+    std::deque<std::array<uint32_t, 2>> lengths;
+    uint64_t written = 0;
+    auto write = [&](const void* bytes, uint64_t size) {
+        chunks.push_back({ bytes, (size_t)size });
+        written += size;
+    };
+    auto pad = [&](uint64_t target) { write(padding, target - written); };
+
+    write(&header, sizeof(header));
+    write(records.data(), records.size() * sizeof(BakedMesh));
+    for (size_t i = 0; i < data.meshes.size(); i++) {
+        const MeshData& mesh = data.meshes[i];
+        const BakedMesh& record = records[i];
+        pad(record.vertexOffset);
+        write(mesh.vertices.data(), mesh.vertices.size() * sizeof(vertex));
+        pad(record.indexOffset);
+        write(mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+        pad(record.textureOffset);
+        for (const texture& ref : mesh.textures) {
+            lengths.push_back({ (uint32_t)ref.type.size(), (uint32_t)ref.path.size() });
+            write(lengths.back().data(), sizeof(uint32_t) * 2);
+            write(ref.type.data(), ref.type.size());
+            write(ref.path.data(), ref.path.size());
+        }
+    }
+    std::string path = cachePath(sourcePath);
+    if (!writeFileAtomically(path, chunks)) {
+        std::cerr << "Could not write model cache " << path << std::endl;
+    }
+}
@@ -0,0 +1,582 @@
+#include "MeshOptimizer.h"
+#include "utils/Hash.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+namespace {
+const int FORSYTH_CACHE_SIZE = 32;
+// overdraw clusters end wherever the simulated cache has flushed completely
+const int OVERDRAW_CACHE_SIZE = 16;
+
+struct VertexKey {
+    const vertex* v;
+    bool operator==(const VertexKey& other) const { return memcmp(v, other.v, sizeof(vertex)) == 0; }
+};
+
+struct VertexKeyHash {
+    size_t operator()(const VertexKey& key) const { return (size_t)hashBytes(key.v, sizeof(vertex)); }
+};
+
+struct PositionHash {
+    size_t operator()(const glm::vec3& p) const { return (size_t)hashValue(p); }
+};
+
+float forsythVertexScore(int cachePosition, int remainingTriangles)
+{
+    if (remainingTriangles == 0) {
+        return -1.0f;
+    }
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // the last triangle's vertices: deliberately not the best, to avoid strips
+            score = 0.75f;
+        } else {
+            float scaled = 1.0f - (float)(cachePosition - 3) / (float)(FORSYTH_CACHE_SIZE - 3);
+            score = std::pow(scaled, 1.5f);
+        }
+    }
+    // favour finishing vertices with few triangles left
+    return score + 2.0f / std::sqrt((float)remainingTriangles);
+}
+
+glm::vec3 triangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    return glm::cross(b - a, c - a);
+}
+
+// Symmetric 4x4 plane quadric, stored as its upper triangle, plus the total
+// plane weight so error() comes out as a squared distance.
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+    double weight = 0;
+
+    void addPlane(const glm::vec3& normal, double d, double weight)
+    {
+        double nx = normal.x, ny = normal.y, nz = normal.z;
+        a2 += weight * nx * nx;
+        ab += weight * nx * ny;
+        ac += weight * nx * nz;
+        ad += weight * nx * d;
+        b2 += weight * ny * ny;
+        bc += weight * ny * nz;
+        bd += weight * ny * d;
+        c2 += weight * nz * nz;
+        cd += weight * nz * d;
+        d2 += weight * d * d;
+        this->weight += weight;
+    }
+
+    void add(const Quadric& q)
+    {
+        a2 += q.a2;
+        ab += q.ab;
+        ac += q.ac;
+        ad += q.ad;
+        b2 += q.b2;
+        bc += q.bc;
+        bd += q.bd;
+        c2 += q.c2;
+        cd += q.cd;
+        d2 += q.d2;
+        weight += q.weight;
+    }
+
+    double error(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+            + c2 * z * z + 2 * cd * z + d2;
+        return weight > 0 ? std::max(e, 0.0) / weight : 0.0;
+    }
+};
+
+struct Collapse {
+    unsigned int from;
+    unsigned int to;
+    double cost;
+};
+}
+
+float computeACMR(const std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize)
+{
+    if (indices.size() < 3) {
+        return 0.0f;
+    }
+    // timestamp FIFO: a vertex is cached if it entered within the last cacheSize misses
+    std::vector<size_t> entered(vertexCount, 0);
+    size_t misses = 0;
+    for (unsigned int index : indices) {
+        if (entered[index] == 0 || misses - entered[index] + 1 > (size_t)cacheSize) {
+            misses++;
+            entered[index] = misses;
+        }
+    }
+    return (float)misses / (float)(indices.size() / 3);
+}
+
+void weldVertices(std::vector<vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    std::vector<vertex> welded;
+    welded.reserve(vertices.size());
+    std::vector<unsigned int> remap(vertices.size());
+    std::unordered_map<VertexKey, unsigned int, VertexKeyHash> seen;
+    seen.reserve(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        auto found = seen.find({ &vertices[i] });
+        if (found != seen.end()) {
+            remap[i] = found->second;
+        } else {
+            remap[i] = (unsigned int)i;
+            seen.emplace(VertexKey { &vertices[i] }, (unsigned int)i);
+        }
+    }
+    // keys point into the input, so compact only once the map is done with
+    std::vector<unsigned int> compact(vertices.size(), ~0u);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        if (remap[i] == i) {
+            compact[i] = (unsigned int)welded.size();
+            welded.push_back(vertices[i]);
+        }
+    }
+    for (auto& index : indices) {
+        index = compact[remap[index]];
+    }
+    vertices = std::move(welded);
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // vertex -> triangles, as offsets into one flat array
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int index : indices) {
+        remaining[index]++;
+    }
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) {
+            adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    std::vector<unsigned int> cache;
+    std::vector<unsigned int> nextCache;
+    size_t scanCursor = 0;
+    long best = -1;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+        if (best < 0) {
+            // Nothing adjacent to the cache is left, so restart from the first
+            // unemitted triangle; a full rescan here goes quadratic on meshes
+            // made of many separate pieces, like foliage cards.
+            best = (long)scanCursor;
+        }
+        size_t t = (size_t)best;
+        emitted[t] = true;
+        while (scanCursor < triangleCount && emitted[scanCursor]) {
+            scanCursor++;
+        }
+
+        // emit, and drop the triangle from its vertices' adjacency lists
+        nextCache.clear();
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = indices[t * 3 + k];
+            output.push_back(v);
+            nextCache.push_back(v);
+            unsigned int* begin = &adjacency[offsets[v]];
+            unsigned int* end = begin + remaining[v];
+            std::iter_swap(std::find(begin, end, (unsigned int)t), end - 1);
+            remaining[v]--;
+        }
+        for (unsigned int v : cache) {
+            if (v != nextCache[0] && v != nextCache[1] && v != nextCache[2]) {
+                nextCache.push_back(v);
+            }
+        }
+        std::swap(cache, nextCache);
+
+        // rescore everything in, or just pushed out of, the cache
+        for (size_t i = 0; i < cache.size(); i++) {
+            cachePosition[cache[i]] = i < (size_t)FORSYTH_CACHE_SIZE ? (int)i : -1;
+        }
+        best = -1;
+        float bestScore = -1e30f;
+        for (unsigned int v : cache) {
+            vertexScore[v] = forsythVertexScore(cachePosition[v], remaining[v]);
+        }
+        for (unsigned int v : cache) {
+            for (unsigned int a = offsets[v]; a < offsets[v] + remaining[v]; a++) {
+                unsigned int candidate = adjacency[a];
+                float score = vertexScore[indices[candidate * 3]] + vertexScore[indices[candidate * 3 + 1]]
+                    + vertexScore[indices[candidate * 3 + 2]];
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = (long)candidate;
+                }
+            }
+        }
+        if (cache.size() > (size_t)FORSYTH_CACHE_SIZE) {
+            cache.resize(FORSYTH_CACHE_SIZE);
+        }
+    }
+    indices = std::move(output);
+}
+
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<vertex>& vertices)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2) {
+        return;
+    }
+
+    // split wherever a triangle misses the cache on all three vertices
+    std::vector<size_t> clusterStart;
+    std::vector<size_t> entered(vertices.size(), 0);
+    size_t misses = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        int triangleMisses = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int index = indices[t * 3 + k];
+            if (entered[index] == 0 || misses - entered[index] + 1 > (size_t)OVERDRAW_CACHE_SIZE) {
+                misses++;
+                entered[index] = misses;
+                triangleMisses++;
+            }
+        }
+        if (t == 0 || triangleMisses == 3) {
+            clusterStart.push_back(t);
+        }
+    }
+    clusterStart.push_back(triangleCount);
+    size_t clusterCount = clusterStart.size() - 1;
+    if (clusterCount < 2) {
+        return;
+    }
+
+    glm::vec3 meshCentre(0.0f);
+    float meshArea = 0.0f;
+    std::vector<float> sortKey(clusterCount);
+    std::vector<glm::vec3> clusterCentre(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+    for (size_t c = 0; c < clusterCount; c++) {
+        float clusterArea = 0.0f;
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++) {
+            const glm::vec3& a = vertices[indices[t * 3]].position;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3& p = vertices[indices[t * 3 + 2]].position;
+            glm::vec3 normal = triangleNormal(a, b, p);
+            float area = glm::length(normal);
+            glm::vec3 centre = (a + b + p) / 3.0f;
+            clusterCentre[c] += centre * area;
+            clusterNormal[c] += normal;
+            clusterArea += area;
+        }
+        meshCentre += clusterCentre[c];
+        meshArea += clusterArea;
+        clusterCentre[c] = clusterArea > 0.0f ? clusterCentre[c] / clusterArea : vertices[indices[clusterStart[c] * 3]].position;
+    }
+    if (meshArea > 0.0f) {
+        meshCentre /= meshArea;
+    }
+    for (size_t c = 0; c < clusterCount; c++) {
+        float length = glm::length(clusterNormal[c]);
+        glm::vec3 normal = length > 0.0f ? clusterNormal[c] / length : glm::vec3(0.0f);
+        sortKey[c] = glm::dot(clusterCentre[c] - meshCentre, normal);
+    }
+
+    // most outward-facing first: those are the clusters that occlude the rest
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (size_t c : order) {
+        output.insert(output.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+    }
+    indices = std::move(output);
+}
+
+void optimizeVertexFetch(std::vector<vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    std::vector<unsigned int> remap(vertices.size(), ~0u);
+    std::vector<vertex> ordered;
+    ordered.reserve(vertices.size());
+    for (auto& index : indices) {
+        if (remap[index] == ~0u) {
+            remap[index] = (unsigned int)ordered.size();
+            ordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    // vertices no triangle uses are dropped
+    vertices = std::move(ordered);
+}
+
+std::vector<unsigned int> simplifyMesh(const std::vector<vertex>& vertices, const std::vector<unsigned int>& indices,
+    size_t targetIndexCount, float targetError, float* resultError)
+{
+    std::vector<unsigned int> result = indices;
+    if (resultError != nullptr) {
+        *resultError = 0.0f;
+    }
+    if (indices.size() <= targetIndexCount || vertices.empty()) {
+        return result;
+    }
+
+    // Group vertices that share a position; a group of more than one is an
+    // attribute seam. Collapses work on the group representatives.
+    std::vector<unsigned int> group(vertices.size());
+    std::vector<unsigned int> groupSize(vertices.size(), 0);
+    std::unordered_map<glm::vec3, unsigned int, PositionHash> byPosition;
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        auto inserted = byPosition.emplace(vertices[i].position, (unsigned int)i);
+        group[i] = inserted.first->second;
+        groupSize[group[i]]++;
+        lo = glm::min(lo, vertices[i].position);
+        hi = glm::max(hi, vertices[i].position);
+    }
+    float extent = glm::length(hi - lo);
+    double maxError = (double)targetError * extent * targetError * extent;
+
+    std::vector<bool> locked(vertices.size(), false);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        locked[i] = groupSize[group[i]] > 1;
+    }
+    // open borders: edges only one triangle uses
+    std::unordered_map<uint64_t, int> edgeUse;
+    auto edgeKey = [](unsigned int a, unsigned int b) { return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a; };
+    for (size_t t = 0; t + 2 < result.size(); t += 3) {
+        for (int k = 0; k < 3; k++) {
+            edgeUse[edgeKey(group[result[t + k]], group[result[t + (k + 1) % 3]])]++;
+        }
+    }
+    for (const auto& edge : edgeUse) {
+        if (edge.second == 1) {
+            locked[edge.first >> 32] = true;
+            locked[edge.first & 0xffffffffu] = true;
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertices.size());
+    for (size_t t = 0; t + 2 < result.size(); t += 3) {
+        glm::vec3 a = vertices[result[t]].position;
+        glm::vec3 normal = triangleNormal(a, vertices[result[t + 1]].position, vertices[result[t + 2]].position);
+        float area = glm::length(normal);
+        if (area <= 0.0f) {
+            continue;
+        }
+        normal /= area;
+        for (int k = 0; k < 3; k++) {
+            quadrics[group[result[t + k]]].addPlane(normal, -glm::dot(normal, a), area);
+        }
+    }
+
+    auto position = [&](unsigned int v) { return vertices[v].position; };
+    std::vector<unsigned int> collapseTo(vertices.size());
+    std::vector<bool> touched(vertices.size());
+    std::vector<std::vector<unsigned int>> around(vertices.size());
+    std::vector<Collapse> collapses;
+    double worstCost = 0.0;
+    while (result.size() > targetIndexCount) {
+        for (auto& triangles : around) {
+            triangles.clear();
+        }
+        for (size_t t = 0; t < result.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                around[group[result[t + k]]].push_back((unsigned int)t);
+            }
+        }
+        collapses.clear();
+        for (size_t t = 0; t < result.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int a = group[result[t + k]];
+                unsigned int b = group[result[t + (k + 1) % 3]];
+                Quadric sum = quadrics[a];
+                sum.add(quadrics[b]);
+                if (!locked[a]) {
+                    collapses.push_back({ a, b, sum.error(position(b)) });
+                }
+                if (!locked[b]) {
+                    collapses.push_back({ b, a, sum.error(position(a)) });
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+        std::iota(collapseTo.begin(), collapseTo.end(), 0);
+        std::fill(touched.begin(), touched.end(), false);
+        size_t removed = 0;
+        size_t wanted = (result.size() - targetIndexCount) / 3;
+        for (const Collapse& collapse : collapses) {
+            if (collapse.cost > maxError || removed >= wanted) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+            // refuse collapses that would flip a surviving triangle
+            bool flips = false;
+            size_t dying = 0;
+            for (unsigned int t : around[collapse.from]) {
+                unsigned int corners[3] = { group[result[t]], group[result[t + 1]], group[result[t + 2]] };
+                if (corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to) {
+                    dying++;
+                    continue;
+                }
+                glm::vec3 before = triangleNormal(position(corners[0]), position(corners[1]), position(corners[2]));
+                for (auto& corner : corners) {
+                    if (corner == collapse.from) {
+                        corner = collapse.to;
+                    }
+                }
+                glm::vec3 after = triangleNormal(position(corners[0]), position(corners[1]), position(corners[2]));
+                if (glm::dot(before, after) <= 0.0f) {
+                    flips = true;
+                    break;
+                }
+            }
+            if (flips) {
+                continue;
+            }
+            collapseTo[collapse.from] = collapse.to;
+            worstCost = std::max(worstCost, collapse.cost);
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            removed += dying;
+            touched[collapse.from] = true;
+            touched[collapse.to] = true;
+            for (unsigned int t : around[collapse.from]) {
+                for (int k = 0; k < 3; k++) {
+                    touched[group[result[t + k]]] = true;
+                }
+            }
+        }
+        if (removed == 0) {
+            break;
+        }
+
+        // Rewrite: a collapsed vertex is unlocked so it has no seam copies;
+        // it takes the target group's copy with the nearest uv.
+        std::vector<unsigned int> next;
+        next.reserve(result.size());
+        for (size_t t = 0; t < result.size(); t += 3) {
+            unsigned int corners[3];
+            for (int k = 0; k < 3; k++) {
+                unsigned int original = result[t + k];
+                unsigned int target = collapseTo[group[original]];
+                if (target == group[original]) {
+                    corners[k] = original;
+                    continue;
+                }
+                unsigned int bestCopy = target;
+                float bestDistance = 1e30f;
+                for (size_t c = 0; c < 3 * around[target].size(); c++) {
+                    unsigned int candidate = result[around[target][c / 3] + c % 3];
+                    if (group[candidate] != target) {
+                        continue;
+                    }
+                    glm::vec2 d = vertices[candidate].textureCoordinates - vertices[original].textureCoordinates;
+                    float distance = glm::dot(d, d);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        bestCopy = candidate;
+                    }
+                }
+                corners[k] = bestCopy;
+            }
+            if (group[corners[0]] == group[corners[1]] || group[corners[1]] == group[corners[2]]
+                || group[corners[0]] == group[corners[2]]) {
+                continue;
+            }
+            next.insert(next.end(), corners, corners + 3);
+        }
+        result = std::move(next);
+    }
+    if (resultError != nullptr && extent > 0.0f) {
+        *resultError = (float)(std::sqrt(worstCost) / extent);
+    }
+    return result;
+}
+
+std::vector<MeshLod> buildLods(const std::vector<vertex>& vertices, std::vector<unsigned int>& indices, int maxLods)
+{
+    std::vector<MeshLod> lods;
+    const unsigned int fullCount = (unsigned int)indices.size();
+    lods.push_back({ 0, fullCount, 0.0f });
+    if (vertices.empty() || fullCount == 0) {
+        return lods;
+    }
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (const auto& v : vertices) {
+        lo = glm::min(lo, v.position);
+        hi = glm::max(hi, v.position);
+    }
+    float extent = glm::length(hi - lo);
+
+    // Every level simplifies the full mesh rather than the level before, so
+    // the quadrics always measure against the real surface.
+    const std::vector<unsigned int> full(indices.begin(), indices.end());
+    float ratio = 1.0f;
+    float errorFraction = 0.005f;
+    for (int level = 1; level < maxLods; level++) {
+        ratio *= 0.5f;
+        errorFraction *= 2.0f;
+        size_t target = (size_t)(fullCount / 3 * ratio) * 3;
+        float achieved = 0.0f;
+        std::vector<unsigned int> simplified = simplifyMesh(vertices, full, target, errorFraction, &achieved);
+        if (simplified.empty() || simplified.size() * 10 > (size_t)lods.back().indexCount * 9) {
+            break;
+        }
+        optimizeVertexCache(simplified, vertices.size());
+        // the error actually reached, never less than the level before
+        float error = std::max(achieved * extent, lods.back().error);
+        lods.push_back({ (unsigned int)indices.size(), (unsigned int)simplified.size(), error });
+        indices.insert(indices.end(), simplified.begin(), simplified.end());
+    }
+    return lods;
+}
+
+MeshOptimizeStats optimizeMesh(std::vector<vertex>& vertices, std::vector<unsigned int>& indices,
+    const MeshOptimizeOptions& options)
+{
+    MeshOptimizeStats stats;
+    stats.verticesBefore = vertices.size();
+    stats.trianglesBefore = indices.size() / 3;
+    stats.acmrBefore = computeACMR(indices, vertices.size());
+
+    weldVertices(vertices, indices);
+    if (options.simplify) {
+        size_t target = (size_t)(indices.size() / 3 * options.simplifyRatio) * 3;
+        indices = simplifyMesh(vertices, indices, target, options.simplifyError);
+    }
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices);
+    optimizeVertexFetch(vertices, indices);
+
+    stats.verticesAfter = vertices.size();
+    stats.trianglesAfter = indices.size() / 3;
+    stats.acmrAfter = computeACMR(indices, vertices.size());
+    return stats;
+}
@@ -8,9 +8,33 @@
 #define CONTEXT_H
 #define MINIAUDIO_IMPLEMENTATION
 #include "Model.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <lib/miniaudo.h>
 
-Model::Model(const std::string& path, glm::mat4 translation, glm::vec3 position, int id, float pitch, float yaw, float roll, bool gamma)
+namespace {
+// largest simplification error allowed on screen, in pixels
+const float LOD_PIXEL_ERROR = 1.0f;
+// a coarser level has to get this far under the limit before it is taken
+const float LOD_HYSTERESIS = 0.75f;
+
+size_t triangleCount(const Mesh& mesh, int lod)
+{
+    return mesh.level(lod).indexCount / 3;
+}
+}
+
+Model::Model(const std::string& path, glm::mat4 translation, glm::vec3 position, int id, float pitch, float yaw, float roll, bool gamma,
+    MeshResidency residency)
+    : Model(parse(path), translation, position, id, pitch, yaw, roll, gamma, residency)
+{
+}
+
+Model::Model(ModelData data, glm::mat4 translation, glm::vec3 position, int id, float pitch, float yaw, float roll, bool gamma,
+    MeshResidency residency)
     : gammaCorrection(gamma)
     , translation(translation)
     , position(position)
@@ -19,28 +43,142 @@ Model::Model(const std::string& path, glm::mat4 translation, glm::vec3 position,
     , yaw(yaw)
     , roll(roll)
 {
-    loadModel(path);
+    if (!data.loaded) {
+        return;
+    }
+    directory = data.directory;
+    this->boundingbox = std::make_shared<BoundingBox>(data.boundingbox, position, pitch, yaw, roll);
+    meshes.reserve(data.meshes.size());
+    for (auto& mesh : data.meshes) {
+        meshes.emplace_back(std::move(mesh.vertices), std::move(mesh.indices), loadMaterialTextures(mesh.textures),
+            mesh.boundingbox, this->position, this->pitch, this->yaw, this->roll, residency, std::move(mesh.lods));
+    }
     this->boundingbox->updateRotation();
     this->boundingbox->translate(position);
     this->boundingbox->updateAABB();
+    computeLodBounds();
+}
+
+void Model::computeLodBounds()
+{
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (const auto& mesh : meshes) {
+        // mesh boxes stay in model space
+        lo = glm::min(lo, mesh.boundingbox->position - mesh.boundingbox->extents);
+        hi = glm::max(hi, mesh.boundingbox->position + mesh.boundingbox->extents);
+        lodErrors.resize(std::max(lodErrors.size(), mesh.lods.size()), 0.0f);
+        for (size_t l = 0; l < mesh.lods.size(); l++) {
+            lodErrors[l] = std::max(lodErrors[l], mesh.lods[l].error);
+        }
+    }
+    if (!meshes.empty()) {
+        localCentre = (lo + hi) * 0.5f;
+        localExtent = (hi - lo) * 0.5f;
+        lodRadius = glm::length(localExtent);
+    }
+}
+
+int Model::chooseLod(float distance, float pixelsPerUnit, int current) const
+{
+    // anything touching the camera's near side stays at full detail
+    if (distance <= 0.0f) {
+        return 0;
+    }
+    int level = 0;
+    for (int l = 1; l < lodCount(); l++) {
+        float limit = l > current ? LOD_PIXEL_ERROR * LOD_HYSTERESIS : LOD_PIXEL_ERROR;
+        if (lodErrors[l] * pixelsPerUnit / distance > limit) {
+            break;
+        }
+        level = l;
+    }
+    return level;
+}
+
+void Model::selectLod(const glm::vec3& eye, float pixelsPerUnit)
+{
+    // drawn as translate and rotate only, so model units are world units
+    float distance = glm::length(position + localCentre - eye) - lodRadius;
+    lod = chooseLod(distance, pixelsPerUnit, lod);
+}
+
+void Model::updateInstances(const Frustum& frustum, const glm::vec3& eye, float pixelsPerUnit)
+{
+    if (!isInstanced) {
+        return;
+    }
+    visibleInstances = cullBoxes(frustum, instanceBoxes, instanceVisible);
+    int levels = std::max(lodCount(), 1);
+    bool changed = false;
+    std::vector<unsigned int> counts(levels, 0);
+    for (size_t i = 0; i < instanceTransforms.size(); i++) {
+        uint8_t state = INSTANCE_HIDDEN;
+        if (instanceVisible[i]) {
+            const glm::mat4& transform = instanceTransforms[i];
+            float scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])),
+                glm::length(glm::vec3(transform[2])) });
+            glm::vec3 centre(instanceBoxes.centreX[i], instanceBoxes.centreY[i], instanceBoxes.centreZ[i]);
+            // errors scale with the instance, so compare in model units
+            float distance = (glm::length(centre - eye) - lodRadius * scale) / scale;
+            int current = instanceLod[i] == INSTANCE_HIDDEN ? 0 : instanceLod[i];
+            state = (uint8_t)chooseLod(distance, pixelsPerUnit, current);
+            counts[state]++;
+        }
+        changed = changed || state != instanceLod[i];
+        instanceLod[i] = state;
+    }
+    if (!changed && !instancesMoved) {
+        return;
+    }
+    instancesMoved = false;
+    // drawInstanced reads only these, so the simulation may move instances
+    // while the previous frame is still drawing
+    bucketsStreamed = streamedInstances;
+    bucketedAmount = instanceTransforms.size();
+
+    // counting sort so each level's visible instances sit together at the
+    // front of the buffer; culled ones are left out
+    lodBuckets.assign(levels, { 0, 0 });
+    unsigned int first = 0;
+    for (int l = 0; l < levels; l++) {
+        lodBuckets[l] = { first, 0 };
+        first += counts[l];
+    }
+    bucketedTransforms.resize(first);
+    for (size_t i = 0; i < instanceTransforms.size(); i++) {
+        if (instanceLod[i] == INSTANCE_HIDDEN) {
+            continue;
+        }
+        LodBucket& bucket = lodBuckets[instanceLod[i]];
+        bucketedTransforms[bucket.first + bucket.count++] = instanceTransforms[i];
+    }
+    instancesChanged = true;
+}
+
+size_t Model::residentBytes() const
+{
+    size_t bytes = textures_loaded.capacity() * sizeof(texture);
+    for (const auto& mesh : meshes) {
+        bytes += mesh.residentBytes();
+    }
+    return bytes;
 }
 
 void Model::initInstanced(size_t amount, std::vector<glm::mat4> trans)
 {
-    unsigned int buffer;
-    glGenBuffers(1, &buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glBufferData(GL_ARRAY_BUFFER, amount * sizeof(glm::mat4), trans.data(), GL_STATIC_DRAW);
+    // replaces, and so frees, any previous instance buffer
+    instanceBuffer = GLBuffer::create();
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer.id());
+    // rewritten whenever instances change level or visibility
+    glBufferData(GL_ARRAY_BUFFER, amount * sizeof(glm::mat4), trans.data(), GL_DYNAMIC_DRAW);
     for (unsigned int i = 0; i < this->meshes.size(); i++) {
-        unsigned int VAO = this->meshes[i].VAO;
-        glBindVertexArray(VAO);
-        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
+        glBindVertexArray(this->meshes[i].VAO.id());
+        // static-lit meshes never enable location 3 themselves
+        glEnableVertexAttribArray(3);
         glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4)));
         glEnableVertexAttribArray(5);
-        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
         glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
+        bindInstanceAttributes(0);
         glVertexAttribDivisor(3, 1);
         glVertexAttribDivisor(4, 1);
         glVertexAttribDivisor(5, 1);
@@ -49,9 +187,73 @@ void Model::initInstanced(size_t amount, std::vector<glm::mat4> trans)
         isInstanced = true;
         instanceAmount = amount;
     }
+    instanceTransforms = std::move(trans);
+    instanceTransforms.resize(amount);
+    instanceLod.assign(amount, 0);
+    bucketedAmount = amount;
+    // everything starts visible at level 0, in the order given
+    lodBuckets.assign(1, { 0, (unsigned int)amount });
+    visibleInstances = amount;
+    // the forest never moves, so the world boxes are built once
+    buildInstanceBoxes();
 }
 
-void Model::drawInstanced(Shader& shader)
+void Model::buildInstanceBoxes()
+{
+    instanceBoxes.clear();
+    instanceBoxes.reserve(instanceTransforms.size());
+    for (const auto& transform : instanceTransforms) {
+        glm::vec3 centre, extent;
+        transformBox(transform, localCentre, localExtent, centre, extent);
+        instanceBoxes.add(centre, extent);
+    }
+}
+
+void Model::setInstanceTransforms(std::vector<glm::mat4> transforms)
+{
+    if (!isInstanced) {
+        std::cerr << "Model is not instanced" << std::endl;
+        return;
+    }
+    instanceTransforms = std::move(transforms);
+    instanceAmount = (int)instanceTransforms.size();
+    // new instances have no level yet, so they count as a change
+    instanceLod.resize(instanceTransforms.size(), INSTANCE_HIDDEN);
+    buildInstanceBoxes();
+    streamedInstances = true;
+    instancesMoved = true;
+}
+
+size_t Model::streamedBytes() const
+{
+    return bucketsStreamed ? bucketedTransforms.size() * sizeof(glm::mat4) : 0;
+}
+
+void Model::bindInstanceAttributes(size_t offset)
+{
+    // GL 4.1 has no base instance, so a bucket is drawn by moving the
+    // pointers to where its matrices start
+    for (unsigned int column = 0; column < 4; column++) {
+        glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+            (void*)(offset + column * sizeof(glm::vec4)));
+    }
+}
+
+void Model::streamInstances(StreamBuffer& stream)
+{
+    streamOffset = StreamRing::NO_SPACE;
+    if (!isInstanced || !bucketsStreamed || bucketedTransforms.empty()) {
+        return;
+    }
+    // moving instances are rewritten every frame into the ring
+    StreamAllocation streamed = stream.allocate(bucketedTransforms.size() * sizeof(glm::mat4), sizeof(glm::vec4));
+    if (streamed.data) {
+        memcpy(streamed.data, bucketedTransforms.data(), streamed.size);
+        streamOffset = streamed.offset;
+    }
+}
+
+void Model::drawInstanced(Shader& shader, const StreamBuffer* stream)
 {
     if (!isInstanced) {
         std::cerr << "Model is not instanced" << std::endl;
@@ -64,14 +266,45 @@ void Model::drawInstanced(Shader& shader)
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, this->textures_loaded[1].id);
 
+    drawnTriangles = 0;
+    fullTriangles = 0;
+    size_t base = 0;
+    if (stream && streamOffset != StreamRing::NO_SPACE) {
+        glBindBuffer(GL_ARRAY_BUFFER, stream->buffer());
+        base = streamOffset;
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer.id());
+        if (bucketsStreamed && !bucketedTransforms.empty()) {
+            // no room in the ring this frame; orphan so the count can change
+            glBufferData(GL_ARRAY_BUFFER, bucketedTransforms.size() * sizeof(glm::mat4), bucketedTransforms.data(),
+                GL_DYNAMIC_DRAW);
+        } else if (instancesChanged && !bucketedTransforms.empty()) {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bucketedTransforms.size() * sizeof(glm::mat4), bucketedTransforms.data());
+        }
+    }
+    instancesChanged = false;
+    // the offset was for this frame's region only
+    streamOffset = StreamRing::NO_SPACE;
     for (unsigned int i = 0; i < this->meshes.size(); i++) {
         shader.setInt("texture_diffuse1", 0);
         shader.setInt("texture_specular1", 1);
-        glBindVertexArray(this->meshes[i].VAO);
-        glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(this->meshes[i].indices.size()),
-            GL_UNSIGNED_INT, nullptr, instanceAmount);
+        Mesh& mesh = this->meshes[i];
+        glBindVertexArray(mesh.VAO.id());
+        for (size_t l = 0; l < lodBuckets.size(); l++) {
+            const LodBucket& bucket = lodBuckets[l];
+            if (bucket.count == 0) {
+                continue;
+            }
+            const MeshLod& range = mesh.level((int)l);
+            bindInstanceAttributes(base + bucket.first * sizeof(glm::mat4));
+            glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(range.indexCount), GL_UNSIGNED_INT,
+                (void*)(range.firstIndex * sizeof(unsigned int)), bucket.count);
+            drawnTriangles += triangleCount(mesh, (int)l) * bucket.count;
+        }
+        fullTriangles += triangleCount(mesh, 0) * bucketedAmount;
         glBindVertexArray(0);
     }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void Model::setScale(float scale)
@@ -96,8 +329,13 @@ void Model::setOrigin(glm::vec3 origin)
 
 void Model::draw(Shader& shader)
 {
-    for (auto& mesh : meshes)
-        mesh.draw(shader);
+    drawnTriangles = 0;
+    fullTriangles = 0;
+    for (auto& mesh : meshes) {
+        mesh.draw(shader, lod);
+        drawnTriangles += triangleCount(mesh, lod);
+        fullTriangles += triangleCount(mesh, 0);
+    }
 }
 
 glm::vec3& Model::getPosition()
@@ -110,39 +348,71 @@ void Model::setPosition(glm::vec3 position)
     this->position = position;
 }
 
-void Model::loadModel(const std::string& path)
+ModelData Model::parse(const std::string& path, bool cached)
 {
+    auto start = std::chrono::steady_clock::now();
+    ModelData data;
+    data.path = path;
+    data.directory = path.substr(0, path.find_last_of('/'));
+    // the bake calls treat a zero hash as no usable source and do nothing
+    uint64_t sourceHash = cached ? hashModelSource(path) : 0;
+    if (loadBakedModel(path, sourceHash, data)) {
+        data.fromCache = true;
+        data.parseMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return data;
+    }
+
+    // one importer per call, so parses on different threads never share state
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_GenBoundingBoxes);
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
     {
         std::cerr << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
-        return;
+        return data;
+    }
+    data.boundingbox = scene->mMeshes[0]->mAABB;
+    processNode(scene->mRootNode, scene, data);
+    // Assimp hands .obj faces over unwelded and in file order; clean them up
+    // once here so the bake stores the optimised buffers.
+    size_t triangles = 0;
+    for (auto& mesh : data.meshes) {
+        MeshOptimizeStats stats = optimizeMesh(mesh.vertices, mesh.indices);
+        data.acmrBefore += stats.acmrBefore * stats.trianglesBefore;
+        data.acmrAfter += stats.acmrAfter * stats.trianglesAfter;
+        triangles += stats.trianglesAfter;
+        mesh.lods = buildLods(mesh.vertices, mesh.indices);
     }
-    directory = path.substr(0, path.find_last_of('/'));
-    this->boundingbox = std::make_shared<BoundingBox>(scene->mMeshes[0]->mAABB, position, pitch, yaw, roll);
-    processNode(scene->mRootNode, scene);
+    if (triangles > 0) {
+        data.acmrBefore /= (float)triangles;
+        data.acmrAfter /= (float)triangles;
+    }
+    data.loaded = true;
+    bakeModel(path, sourceHash, data);
+    data.parseMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return data;
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene)
+void Model::processNode(aiNode* node, const aiScene* scene, ModelData& data)
 {
     for (unsigned int i = 0; i < node->mNumMeshes; i++) {
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(mesh, scene));
+        data.meshes.emplace_back(processMesh(mesh, scene));
     }
     for (unsigned int i = 0; i < node->mNumChildren; i++) {
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], scene, data);
     }
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
+MeshData Model::processMesh(aiMesh* mesh, const aiScene* scene)
 {
-    std::vector<vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<texture> textures;
+    MeshData data;
+    std::vector<vertex>& vertices = data.vertices;
+    std::vector<unsigned int>& indices = data.indices;
+    vertices.reserve(mesh->mNumVertices);
+    indices.reserve((size_t)mesh->mNumFaces * 3);
 
     for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-        vertex vertex;
+        vertex vertex {};
         glm::vec3 vector;
         vector.x = mesh->mVertices[i].x;
         vector.y = mesh->mVertices[i].y;
@@ -162,6 +432,10 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
         } else {
             vertex.textureCoordinates = glm::vec2(0.0f, 0.0f);
         }
+        if (mesh->HasTangentsAndBitangents()) {
+            vertex.tangent = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
+            vertex.bitangent = glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
+        }
         vertices.push_back(vertex);
     }
     for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
@@ -171,40 +445,41 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
     }
     aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 
-    std::vector<texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-    textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-    std::vector<texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-    textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-    std::vector<texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-    textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-    std::vector<texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-    textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+    collectMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data.textures);
+    collectMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", data.textures);
+    collectMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", data.textures);
+    collectMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", data.textures);
 
-    return Mesh { vertices, indices, textures, mesh->mAABB, this->position, this->pitch, this->yaw, this->roll };
+    data.boundingbox = mesh->mAABB;
+    return data;
 }
 
-std::vector<texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, const std::string& typeName)
+void Model::collectMaterialTextures(aiMaterial* mat, aiTextureType type, const std::string& typeName, std::vector<texture>& textures)
 {
-    std::vector<texture> textures;
     for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
         aiString str;
         mat->GetTexture(type, i, &str);
-        // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-        bool skip = false;
-        for (auto& j : textures_loaded) {
-            if (std::strcmp(j.path.data(), str.C_Str()) == 0) {
-                textures.push_back(j);
-                skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                break;
-            }
+        textures.push_back({ 0, typeName, str.C_Str() });
+    }
+}
+
+std::vector<texture> Model::loadMaterialTextures(const std::vector<texture>& refs)
+{
+    std::vector<texture> textures;
+    for (const auto& ref : refs) {
+        // the process-wide cache hands back the same GL texture for the same file,
+        // whichever model asked for it first
+        texture texture = ref;
+        texture.handle = textureCache().acquire(this->directory + '/' + ref.path);
+        texture.id = texture.handle->id;
+        textures.push_back(texture);
+
+        bool known = false;
+        for (auto& loaded : textures_loaded) {
+            known = known || loaded.handle == texture.handle;
         }
-        if (!skip) { // if texture hasn't been loaded already, load it
-            texture texture;
-            texture.id = TextureFromFile(str.C_Str(), this->directory);
-            texture.type = typeName;
-            texture.path = str.C_Str();
-            textures.push_back(texture);
-            textures_loaded.push_back(texture); // store it as texture loaded for entire model, to ensure we won't unnecessarily load duplicate textures.
+        if (!known) {
+            textures_loaded.push_back(texture);
         }
     }
     return textures;
@@ -0,0 +1,57 @@
+#include "ModelLoader.h"
+#include <chrono>
+#include <iostream>
+
+namespace {
+float millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+}
+
+ModelLoader::ModelLoader(JobSystem& jobSystem)
+    : m_jobs(jobSystem)
+{
+}
+
+ModelLoader::Handle ModelLoader::request(const std::string& path)
+{
+    requested++;
+    return m_jobs.submit([path] { return Model::parse(path); });
+}
+
+std::shared_ptr<Model> ModelLoader::create(Handle& handle, glm::mat4 translation, glm::vec3 position, int id,
+    float pitch, float yaw, float roll, bool gamma, MeshResidency residency)
+{
+    auto start = std::chrono::steady_clock::now();
+    ModelData data = handle.get();
+    std::string path = data.path;
+    float acmrBefore = data.acmrBefore;
+    float acmrAfter = data.acmrAfter;
+    waitMilliseconds += millisecondsSince(start);
+    parseMilliseconds += data.parseMilliseconds;
+    cacheHits += data.fromCache ? 1 : 0;
+
+    start = std::chrono::steady_clock::now();
+    auto model = std::make_shared<Model>(std::move(data), translation, position, id, pitch, yaw, roll, gamma, residency);
+    uploadMilliseconds += millisecondsSince(start);
+    created++;
+
+    size_t packed = 0;
+    size_t full = 0;
+    for (const auto& mesh : model->meshes) {
+        packed += mesh.vertexBytes();
+        full += mesh.fullVertexBytes();
+    }
+    vertexBytes += packed;
+    fullVertexBytes += full;
+    residentBytes += model->residentBytes();
+    if (!model->meshes.empty()) {
+        const VertexFormat& format = model->meshes[0].format;
+        std::cout << path << ": " << vertexLayoutName(format.layout) << " vertices, " << format.stride << " bytes each"
+                  << (format.halfTexCoords ? " (half uvs)" : "") << ", " << full / 1024 << " KB -> " << packed / 1024
+                  << " KB on the GPU, " << model->residentBytes() / 1024 << " KB kept on the CPU, ACMR " << acmrBefore
+                  << " -> " << acmrAfter << ", " << model->lodCount() << " LODs" << std::endl;
+    }
+    return model;
+}
@@ -31,7 +31,14 @@ namespace physics {
             boundingBox->pitch = pitch;
             boundingBox->yaw = yaw;
             boundingBox->roll = roll;
-            boundingBox->updateRotation();
+            if (model) {
+                // the renderer rebuilds the matrix in its batched pass; the
+                // box only needs the same rotation now
+                model->transform.set(position, pitch, yaw, roll);
+                boundingBox->setRotation(transformRotation(pitch, yaw, roll));
+            } else {
+                boundingBox->updateRotation();
+            }
             boundingBox->translate(position - boundingBox->position);
             boundingBox->updateAABB();
             boundingBox->position = position;
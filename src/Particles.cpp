@@ -0,0 +1,211 @@
+#include "Particles.h"
+#include "utils/JobSystem.h"
+#include "utils/Simd.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <future>
+
+ParticleSystem::ParticleSystem(size_t capacity, uint64_t seed)
+    : m_capacity(capacity)
+    , m_random(rng::stream(rng::Subsystem::Particles, seed))
+{
+    // the last SIMD group may run past the live particles, never past the end
+    size_t padded = (capacity + 3) & ~(size_t)3;
+    for (auto* array : { &m_posX, &m_posY, &m_posZ, &m_velX, &m_velY, &m_velZ, &m_life }) {
+        array->assign(padded, 0.0f);
+    }
+    m_instances.assign(padded, glm::vec4(0.0f));
+}
+
+void ParticleSystem::simulate(size_t begin, size_t end, float dt, std::vector<uint32_t>& dead)
+{
+    // semi-implicit Euler; drag pulls the velocity towards the wind
+    const simd::Float4 step = simd::set1(dt);
+    const simd::Float4 keep = simd::set1(std::max(0.0f, 1.0f - forces.drag * dt));
+    const simd::Float4 pushX = simd::set1((forces.gravity.x + forces.drag * forces.wind.x) * dt);
+    const simd::Float4 pushY = simd::set1((forces.gravity.y + forces.drag * forces.wind.y) * dt);
+    const simd::Float4 pushZ = simd::set1((forces.gravity.z + forces.drag * forces.wind.z) * dt);
+    const simd::Float4 zero = simd::set1(0.0f);
+    const simd::Float4 ground = simd::set1(forces.killBelow);
+    for (size_t i = begin; i < end; i += 4) {
+        simd::Float4 vx = simd::add(simd::mul(simd::load(&m_velX[i]), keep), pushX);
+        simd::Float4 vy = simd::add(simd::mul(simd::load(&m_velY[i]), keep), pushY);
+        simd::Float4 vz = simd::add(simd::mul(simd::load(&m_velZ[i]), keep), pushZ);
+        simd::Float4 px = simd::add(simd::load(&m_posX[i]), simd::mul(vx, step));
+        simd::Float4 py = simd::add(simd::load(&m_posY[i]), simd::mul(vy, step));
+        simd::Float4 pz = simd::add(simd::load(&m_posZ[i]), simd::mul(vz, step));
+        simd::Float4 life = simd::sub(simd::load(&m_life[i]), step);
+        simd::store(&m_velX[i], vx);
+        simd::store(&m_velY[i], vy);
+        simd::store(&m_velZ[i], vz);
+        simd::store(&m_posX[i], px);
+        simd::store(&m_posY[i], py);
+        simd::store(&m_posZ[i], pz);
+        simd::store(&m_life[i], life);
+        int alive = simd::mask(simd::bitAnd(simd::greater(life, zero), simd::greater(py, ground)));
+        for (size_t lane = 0; lane < 4; lane++) {
+            m_instances[i + lane] = glm::vec4(m_posX[i + lane], m_posY[i + lane], m_posZ[i + lane], m_life[i + lane]);
+            if (!(alive & (1 << lane)) && i + lane < end) {
+                dead.push_back((uint32_t)(i + lane));
+            }
+        }
+    }
+}
+
+void ParticleSystem::removeAt(size_t index)
+{
+    size_t last = --m_size;
+    if (index == last) {
+        return;
+    }
+    for (auto* array : { &m_posX, &m_posY, &m_posZ, &m_velX, &m_velY, &m_velZ, &m_life }) {
+        (*array)[index] = (*array)[last];
+    }
+    m_instances[index] = m_instances[last];
+}
+
+size_t ParticleSystem::emit(const ParticleEmitter& emitter, size_t count)
+{
+    size_t fits = std::min(count, m_capacity - m_size);
+    m_stats.dropped += count - fits;
+    for (size_t n = 0; n < fits; n++) {
+        size_t i = m_size++;
+        m_posX[i] = emitter.position.x + emitter.extent.x * m_random.range(-1.0f, 1.0f);
+        m_posY[i] = emitter.position.y + emitter.extent.y * m_random.range(-1.0f, 1.0f);
+        m_posZ[i] = emitter.position.z + emitter.extent.z * m_random.range(-1.0f, 1.0f);
+        m_velX[i] = emitter.velocity.x + emitter.velocityJitter.x * m_random.range(-1.0f, 1.0f);
+        m_velY[i] = emitter.velocity.y + emitter.velocityJitter.y * m_random.range(-1.0f, 1.0f);
+        m_velZ[i] = emitter.velocity.z + emitter.velocityJitter.z * m_random.range(-1.0f, 1.0f);
+        m_life[i] = m_random.range(emitter.minLife, emitter.maxLife);
+        m_instances[i] = glm::vec4(m_posX[i], m_posY[i], m_posZ[i], m_life[i]);
+    }
+    m_stats.spawned += fits;
+    return fits;
+}
+
+void ParticleSystem::update(float dt)
+{
+    auto start = std::chrono::steady_clock::now();
+    m_stats = {};
+    size_t chunks = (m_size + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK;
+    if (m_dead.size() < chunks) {
+        m_dead.resize(chunks);
+    }
+    for (size_t c = 0; c < chunks; c++) {
+        m_dead[c].clear();
+    }
+    // the calling thread takes the first chunk, like parallelFor
+    std::vector<std::future<void>> workers;
+    for (size_t c = 1; c < chunks; c++) {
+        workers.push_back(jobs().submit([this, c, dt] {
+            simulate(c * PARTICLE_CHUNK, std::min(m_size, (c + 1) * PARTICLE_CHUNK), dt, m_dead[c]);
+        }));
+    }
+    if (chunks > 0) {
+        simulate(0, std::min(m_size, PARTICLE_CHUNK), dt, m_dead[0]);
+    }
+    for (auto& worker : workers) {
+        worker.get();
+    }
+
+    // Highest index first: whatever is swapped down from the end has
+    // already been checked and is alive.
+    for (size_t c = chunks; c-- > 0;) {
+        const std::vector<uint32_t>& dead = m_dead[c];
+        for (size_t d = dead.size(); d-- > 0;) {
+            removeAt(dead[d]);
+        }
+        m_stats.died += dead.size();
+    }
+
+    for (auto& emitter : emitters) {
+        if (!emitter.enabled) {
+            continue;
+        }
+        emitter.pending += emitter.rate * dt;
+        auto count = (size_t)emitter.pending;
+        emitter.pending -= (float)count;
+        emit(emitter, count);
+    }
+    m_stats.alive = m_size;
+    m_stats.chunks = chunks;
+    m_stats.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+ParticleSprites::ParticleSprites()
+    : m_vao(GLVertexArray::create())
+    , m_corners(GLBuffer::create())
+    , m_instances(GLBuffer::create())
+{
+    const float corners[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+    glBindVertexArray(m_vao.id());
+    glBindBuffer(GL_ARRAY_BUFFER, m_corners.id());
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)nullptr);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instances.id());
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)nullptr);
+    glVertexAttribDivisor(1, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+size_t ParticleSprites::upload(const ParticleSystem& system, StreamBuffer& stream)
+{
+    if (system.size() == 0) {
+        return StreamRing::NO_SPACE;
+    }
+    StreamAllocation streamed = stream.allocate(system.size() * sizeof(glm::vec4), sizeof(glm::vec4));
+    if (!streamed.data) {
+        return StreamRing::NO_SPACE;
+    }
+    memcpy(streamed.data, system.instances(), streamed.size);
+    return streamed.offset;
+}
+
+void ParticleSprites::begin(Shader& shader, const glm::mat4& projection, const glm::mat4& view)
+{
+    shader.use();
+    shader.setMat4("projection", projection);
+    shader.setMat4("view", view);
+    // tested against the scene, but sprites do not hide each other
+    glEnable(GL_BLEND);
+    glDepthMask(GL_FALSE);
+    glBindVertexArray(m_vao.id());
+}
+
+void ParticleSprites::draw(const ParticleSystem& system, Shader& shader, const StreamBuffer& stream, size_t offset)
+{
+    if (system.size() == 0) {
+        return;
+    }
+    const ParticleLook& look = system.look;
+    shader.setVec4("colour", look.colour);
+    shader.setFloat("size", look.size);
+    shader.setVec3("streak", look.streak);
+    shader.setFloat("fade", look.fade);
+    glBlendFunc(GL_SRC_ALPHA, look.additive ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+    // the attribute keeps the buffer bound when it was pointed, so it is
+    // pointed again for every system
+    if (offset != StreamRing::NO_SPACE) {
+        glBindBuffer(GL_ARRAY_BUFFER, stream.buffer());
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)offset);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, m_instances.id());
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(system.size() * sizeof(glm::vec4)), system.instances(),
+            GL_STREAM_DRAW);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)nullptr);
+    }
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)system.size());
+}
+
+void ParticleSprites::end()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+}
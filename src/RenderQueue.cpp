@@ -0,0 +1,278 @@
+#include "RenderQueue.h"
+#include "utils/Hash.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const int DEPTH_BITS = 24;
+const int VAO_BITS = 16;
+const int MATERIAL_BITS = 16;
+const int PROGRAM_BITS = 8;
+// texture units a material may touch; the shadow map lives above these
+const unsigned int MAX_MATERIAL_UNITS = 4;
+
+unsigned int keyMaterial(uint64_t key)
+{
+    return (unsigned int)((key >> (DEPTH_BITS + VAO_BITS)) & ((1u << MATERIAL_BITS) - 1));
+}
+
+// each matrix gets its own aligned slot so it can be bound as a range
+size_t transformStride(size_t uniformAlignment)
+{
+    return (sizeof(glm::mat4) + uniformAlignment - 1) / uniformAlignment * uniformAlignment;
+}
+}
+
+void GLRenderBackend::useProgram(const Shader& shader)
+{
+    shader.use();
+}
+
+int GLRenderBackend::uniformLocation(const Shader& shader, UniformKey key)
+{
+    return shader.location(key);
+}
+
+void GLRenderBackend::setInt(int location, int value)
+{
+    glUniform1i(location, value);
+}
+
+void GLRenderBackend::setMat4(int location, const glm::mat4& value)
+{
+    glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
+}
+
+void GLRenderBackend::bindTexture(unsigned int unit, unsigned int texture)
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void GLRenderBackend::bindVertexArray(unsigned int vao)
+{
+    glBindVertexArray(vao);
+}
+
+void GLRenderBackend::bindUniformRange(unsigned int binding, unsigned int buffer, size_t offset, size_t size)
+{
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, (GLintptr)offset, (GLsizeiptr)size);
+}
+
+void GLRenderBackend::drawElements(unsigned int indexCount, unsigned int firstIndex)
+{
+    glDrawElements(GL_TRIANGLES, (GLsizei)indexCount, GL_UNSIGNED_INT, (void*)(firstIndex * sizeof(unsigned int)));
+}
+
+uint64_t makeDrawKey(unsigned int program, unsigned int material, unsigned int vao, float depth)
+{
+    // non-negative floats sort the same as their bit patterns
+    uint32_t depthBits;
+    depth = std::max(depth, 0.0f);
+    memcpy(&depthBits, &depth, sizeof(depthBits));
+    uint64_t key = program & ((1u << PROGRAM_BITS) - 1);
+    key = (key << MATERIAL_BITS) | (material & ((1u << MATERIAL_BITS) - 1));
+    key = (key << VAO_BITS) | (vao & ((1u << VAO_BITS) - 1));
+    key = (key << DEPTH_BITS) | (depthBits >> (32 - DEPTH_BITS));
+    return key;
+}
+
+void radixSortDraws(std::vector<DrawCommand>& commands, std::vector<DrawCommand>& scratch)
+{
+    scratch.resize(commands.size());
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {};
+        for (const auto& command : commands) {
+            counts[(command.key >> shift) & 0xff]++;
+        }
+        // every key shares this byte, so the pass would not move anything
+        if (commands.empty() || counts[(commands[0].key >> shift) & 0xff] == commands.size()) {
+            continue;
+        }
+        size_t offset = 0;
+        for (auto& count : counts) {
+            size_t n = count;
+            count = offset;
+            offset += n;
+        }
+        for (const auto& command : commands) {
+            scratch[counts[(command.key >> shift) & 0xff]++] = command;
+        }
+        commands.swap(scratch);
+    }
+}
+
+void RenderQueue::clear()
+{
+    m_commands.clear();
+    m_transforms.clear();
+    m_programs.clear();
+    m_materials.clear();
+    m_streamBase = StreamRing::NO_SPACE;
+    m_streamedBytes = 0;
+}
+
+unsigned int RenderQueue::addTransform(const glm::mat4& transform)
+{
+    m_transforms.push_back(transform);
+    return (unsigned int)m_transforms.size() - 1;
+}
+
+unsigned int RenderQueue::programIndex(unsigned int program)
+{
+    auto found = std::find(m_programs.begin(), m_programs.end(), program);
+    if (found != m_programs.end()) {
+        return (unsigned int)(found - m_programs.begin());
+    }
+    m_programs.push_back(program);
+    return (unsigned int)m_programs.size() - 1;
+}
+
+unsigned int RenderQueue::materialIndex(const Mesh& mesh)
+{
+    // meshes with the same textures under the same sampler names share a material
+    uint64_t hash = FNV_OFFSET;
+    const auto& samplers = mesh.samplerNames();
+    for (size_t i = 0; i < mesh.textures.size(); i++) {
+        hash = hashValue(mesh.textures[i].id, hash);
+        hash = hashValue(i < samplers.size() ? samplers[i].hash : 0, hash);
+    }
+    return m_materials.emplace(hash, (unsigned int)m_materials.size()).first->second;
+}
+
+void RenderQueue::add(const Shader& shader, const Mesh& mesh, int lod, unsigned int transform, float depth)
+{
+    const MeshLod& range = mesh.level(lod);
+    DrawCommand command {};
+    command.key = makeDrawKey(programIndex(shader.id()), materialIndex(mesh), mesh.VAO.id(), depth);
+    command.shader = &shader;
+    command.mesh = &mesh;
+    command.firstIndex = range.firstIndex;
+    command.indexCount = range.indexCount;
+    command.transform = transform;
+    m_commands.push_back(command);
+}
+
+void RenderQueue::sort()
+{
+    radixSortDraws(m_commands, m_scratch);
+}
+
+size_t RenderQueue::streamBytes(size_t uniformAlignment) const
+{
+    return m_transforms.size() * transformStride(uniformAlignment);
+}
+
+void RenderQueue::upload(StreamBuffer& stream)
+{
+    m_streamBase = StreamRing::NO_SPACE;
+    m_streamedBytes = 0;
+    bool wanted = std::any_of(m_commands.begin(), m_commands.end(),
+        [](const DrawCommand& command) { return command.shader->objectBlock(); });
+    if (!wanted || m_transforms.empty()) {
+        return;
+    }
+    m_streamStride = transformStride(stream.uniformAlignment());
+    StreamAllocation block = stream.allocate(m_transforms.size() * m_streamStride, stream.uniformAlignment());
+    if (!block.data) {
+        return;
+    }
+    for (size_t i = 0; i < m_transforms.size(); i++) {
+        memcpy(block.data + i * m_streamStride, &m_transforms[i], sizeof(glm::mat4));
+    }
+    m_streamBase = block.offset;
+    m_streamedBytes = block.size;
+}
+
+RenderQueueStats RenderQueue::submit(RenderBackend& backend, const FrameUniforms& frame,
+    const StreamBuffer* stream) const
+{
+    RenderQueueStats stats;
+    bool packed = stream != nullptr && m_streamBase != StreamRing::NO_SPACE;
+    if (packed) {
+        stats.streamedBytes = m_streamedBytes;
+    }
+    // other passes touch GL state between frames, so nothing is assumed bound
+    const Shader* program = nullptr;
+    unsigned int material = ~0u;
+    unsigned int vao = ~0u;
+    unsigned int transform = ~0u;
+    unsigned int boundTextures[MAX_MATERIAL_UNITS];
+    std::fill(std::begin(boundTextures), std::end(boundTextures), ~0u);
+    int modelLocation = -1;
+
+    for (const DrawCommand& command : m_commands) {
+        const Mesh& mesh = *command.mesh;
+        bool newProgram = program == nullptr || program->id() != command.shader->id();
+        if (newProgram) {
+            program = command.shader;
+            backend.useProgram(*program);
+            backend.setMat4(backend.uniformLocation(*program, "projection"), frame.projection);
+            backend.setMat4(backend.uniformLocation(*program, "view"), frame.view);
+            backend.setMat4(backend.uniformLocation(*program, "lightSpaceMatrix"), frame.lightSpaceMatrix);
+            backend.setInt(backend.uniformLocation(*program, "isInstanced"), 0);
+            modelLocation = backend.uniformLocation(*program, "model");
+            stats.programChanges++;
+            stats.uniformSets += 4;
+            // sampler uniforms and the model matrix are per program
+            material = ~0u;
+            transform = ~0u;
+        } else {
+            stats.avoided++;
+        }
+
+        unsigned int drawMaterial = keyMaterial(command.key);
+        const auto& samplers = mesh.samplerNames();
+        unsigned int units = (unsigned int)std::min(mesh.textures.size(), (size_t)MAX_MATERIAL_UNITS);
+        if (drawMaterial != material) {
+            material = drawMaterial;
+            stats.materialChanges++;
+            for (unsigned int unit = 0; unit < units; unit++) {
+                backend.setInt(backend.uniformLocation(*program, UniformKey(samplers[unit].name.c_str(), samplers[unit].hash)),
+                    (int)unit);
+                stats.uniformSets++;
+                if (boundTextures[unit] != mesh.textures[unit].id) {
+                    boundTextures[unit] = mesh.textures[unit].id;
+                    backend.bindTexture(unit, boundTextures[unit]);
+                    stats.textureBinds++;
+                } else {
+                    stats.avoided++;
+                }
+            }
+        } else {
+            stats.avoided += 2 * (int)units;
+        }
+
+        if (command.transform != transform) {
+            transform = command.transform;
+            if (packed && program->objectBlock()) {
+                backend.bindUniformRange(OBJECT_BLOCK_BINDING, stream->buffer(),
+                    m_streamBase + transform * m_streamStride, sizeof(glm::mat4));
+            } else {
+                backend.setMat4(modelLocation, m_transforms[transform]);
+            }
+            stats.uniformSets++;
+        } else {
+            stats.avoided++;
+        }
+
+        if (mesh.VAO.id() != vao) {
+            vao = mesh.VAO.id();
+            backend.bindVertexArray(vao);
+            stats.vaoChanges++;
+        } else {
+            stats.avoided++;
+        }
+        backend.drawElements(command.indexCount, command.firstIndex);
+        stats.draws++;
+    }
+    if (!m_commands.empty()) {
+        backend.bindVertexArray(0);
+        if (boundTextures[0] != ~0u) {
+            // leave unit 0 active, as Mesh::draw does
+            backend.bindTexture(0, boundTextures[0]);
+        }
+    }
+    return stats;
+}
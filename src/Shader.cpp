@@ -1,49 +1,339 @@
 #include "Shader.h"
+#include "Lighting.h"
+#include "ShaderCache.h"
+#include "ShadowCascades.h"
+#include "utils/JobSystem.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <vector>
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+namespace {
+struct WatchedShader {
+    std::weak_ptr<ShaderProgram> program;
+    std::filesystem::file_time_type vertexTime;
+    std::filesystem::file_time_type fragmentTime;
+    // replacement still compiling, 0 when there is none
+    unsigned int reload = 0;
+    unsigned int reloadVertex = 0;
+    unsigned int reloadFragment = 0;
+    uint64_t reloadKey = 0;
+    // frames the replacement has had, for drivers that cannot say when it is done
+    int reloadFrames = 0;
+    // the last replacement swapped in; the Shader's own ID is never deleted
+    unsigned int swapped = 0;
+};
+
+std::vector<WatchedShader>& watchedShaders()
 {
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    static std::vector<WatchedShader> shaders;
+    return shaders;
+}
+
+std::string readSource(const std::string& path)
+{
+    std::ifstream file;
+    file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
     try {
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        vShaderFile.close();
-        fShaderFile.close();
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+        file.open(path);
+        std::stringstream stream;
+        stream << file.rdbuf();
+        return stream.str();
     } catch (std::ifstream::failure& e) {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << " " << e.what() << std::endl;
     }
+    return std::string();
+}
+
+std::filesystem::file_time_type modifiedTime(const std::string& path)
+{
+    std::error_code error;
+    return std::filesystem::last_write_time(path, error);
+}
+
+bool parallelCompile()
+{
+    static const bool enabled = [] {
+        if (!GLEW_KHR_parallel_shader_compile) {
+            return false;
+        }
+        // as many compiler threads as the driver likes
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        return true;
+    }();
+    return enabled;
+}
+
+// Queues the compile and link without asking how they went; any status
+// query would wait for the driver.
+void startCompile(unsigned int program, const std::string& vertexCode, const std::string& fragmentCode,
+    unsigned int& vertex, unsigned int& fragment)
+{
+    parallelCompile();
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
-    unsigned int vertex, fragment;
     vertex = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertex, 1, &vShaderCode, NULL);
     glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
-    // fragment Shader
     fragment = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragment, 1, &fShaderCode, NULL);
     glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
-    // shader Program
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    glLinkProgram(ID);
-    checkCompileErrors(ID, "PROGRAM");
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    if (programBinariesSupported()) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(program);
+}
+
+bool compiled(unsigned int program, unsigned int vertex, unsigned int fragment)
+{
+    bool ok = Shader::checkCompileErrors(vertex, "VERTEX");
+    ok = Shader::checkCompileErrors(fragment, "FRAGMENT") && ok;
+    return Shader::checkCompileErrors(program, "PROGRAM") && ok;
+}
+
+void releaseShaders(unsigned int program, unsigned int vertex, unsigned int fragment)
+{
+    glDetachShader(program, vertex);
+    glDetachShader(program, fragment);
     glDeleteShader(vertex);
     glDeleteShader(fragment);
 }
 
-void Shader::checkCompileErrors(unsigned int shader, const std::string& type)
+void bindBlocks(ShaderProgram& program)
+{
+    // GLSL 3.30 cannot give blocks a binding itself
+    unsigned int lighting = glGetUniformBlockIndex(program.id, LIGHTING_BLOCK_NAME);
+    if (lighting != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program.id, lighting, LIGHTING_BLOCK_BINDING);
+    }
+    unsigned int shadows = glGetUniformBlockIndex(program.id, SHADOW_BLOCK_NAME);
+    if (shadows != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program.id, shadows, SHADOW_BLOCK_BINDING);
+    }
+    unsigned int object = glGetUniformBlockIndex(program.id, OBJECT_BLOCK_NAME);
+    if (object != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program.id, object, OBJECT_BLOCK_BINDING);
+    }
+    program.objectBlock = object != GL_INVALID_INDEX;
+}
+
+#ifndef NDEBUG
+const std::chrono::milliseconds RELOAD_SCAN_INTERVAL(500);
+// without KHR_parallel_shader_compile a replacement is only checked after
+// this many frames, by when the driver has usually linked it
+const int RELOAD_SETTLE_FRAMES = 30;
+
+struct SourceStamp {
+    size_t index;
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::filesystem::file_time_type vertexTime;
+    std::filesystem::file_time_type fragmentTime;
+};
+
+struct ChangedSource {
+    size_t index;
+    std::string vertexCode;
+    std::string fragmentCode;
+    std::filesystem::file_time_type vertexTime;
+    std::filesystem::file_time_type fragmentTime;
+};
+
+// Without the extension there is no way to ask, so the replacement is given
+// a number of frames instead; the status check can still wait on a slow link.
+bool linkFinished(WatchedShader& watched)
+{
+    if (!parallelCompile()) {
+        return ++watched.reloadFrames >= RELOAD_SETTLE_FRAMES;
+    }
+    GLint done = GL_FALSE;
+    glGetProgramiv(watched.reload, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+void dropReload(WatchedShader& watched)
+{
+    releaseShaders(watched.reload, watched.reloadVertex, watched.reloadFragment);
+    glDeleteProgram(watched.reload);
+    watched.reload = 0;
+    watched.reloadVertex = 0;
+    watched.reloadFragment = 0;
+    watched.reloadFrames = 0;
+}
+
+void applyReload(WatchedShader& watched)
+{
+    std::shared_ptr<ShaderProgram> program = watched.program.lock();
+    if (program && compiled(watched.reload, watched.reloadVertex, watched.reloadFragment)) {
+        if (program->pending) {
+            finishShaderProgram(*program);
+        }
+        // Every copy of the Shader picks the replacement up through the shared
+        // program. Uniform values start over from their defaults.
+        releaseShaders(watched.reload, watched.reloadVertex, watched.reloadFragment);
+        if (watched.swapped != 0) {
+            glDeleteProgram(watched.swapped);
+        }
+        watched.swapped = watched.reload;
+        program->id = watched.reload;
+        program->key = watched.reloadKey;
+        program->locations.clear();
+        storeProgramBinary(program->id, program->vertexPath, program->fragmentPath, program->key);
+        bindBlocks(*program);
+        std::cout << "Reloaded " << program->vertexPath << " and " << program->fragmentPath << std::endl;
+        watched.reload = 0;
+        watched.reloadVertex = 0;
+        watched.reloadFragment = 0;
+        watched.reloadFrames = 0;
+        return;
+    }
+    if (program) {
+        std::cout << "Keeping the previous " << program->vertexPath << " program until it compiles" << std::endl;
+    }
+    dropReload(watched);
+}
+
+std::future<std::vector<ChangedSource>>& reloadScan()
+{
+    static std::future<std::vector<ChangedSource>> scan;
+    return scan;
+}
+#endif
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath)
+    : program(std::make_shared<ShaderProgram>())
+{
+    program->vertexPath = vertexPath;
+    program->fragmentPath = fragmentPath;
+    WatchedShader watched;
+    watched.program = program;
+    watched.vertexTime = modifiedTime(vertexPath);
+    watched.fragmentTime = modifiedTime(fragmentPath);
+    std::string vertexCode = readSource(vertexPath);
+    std::string fragmentCode = readSource(fragmentPath);
+
+    ID = glCreateProgram();
+    program->id = ID;
+    program->key = shaderCacheKey(vertexCode, fragmentCode);
+    if (loadProgramBinary(ID, vertexPath, fragmentPath, program->key)) {
+        bindBlocks(*program);
+    } else {
+        startCompile(ID, vertexCode, fragmentCode, program->vertex, program->fragment);
+        program->pending = true;
+    }
+#ifdef NDEBUG
+    // nothing reloads, so only programs still compiling need finding again
+    if (!program->pending) {
+        return;
+    }
+#endif
+    watchedShaders().push_back(std::move(watched));
+}
+
+void finishShaderProgram(ShaderProgram& program)
+{
+    program.pending = false;
+    if (compiled(program.id, program.vertex, program.fragment)) {
+        storeProgramBinary(program.id, program.vertexPath, program.fragmentPath, program.key);
+    }
+    releaseShaders(program.id, program.vertex, program.fragment);
+    program.vertex = 0;
+    program.fragment = 0;
+    bindBlocks(program);
+}
+
+void finishPendingShaders()
+{
+    for (WatchedShader& watched : watchedShaders()) {
+        std::shared_ptr<ShaderProgram> program = watched.program.lock();
+        if (program && program->pending) {
+            finishShaderProgram(*program);
+        }
+    }
+#ifdef NDEBUG
+    // every entry is finished now and there are no reloads to watch for
+    watchedShaders().clear();
+#endif
+}
+
+void pollShaderReloads()
+{
+#ifndef NDEBUG
+    std::vector<WatchedShader>& shaders = watchedShaders();
+    for (WatchedShader& watched : shaders) {
+        if (watched.reload != 0 && linkFinished(watched)) {
+            applyReload(watched);
+        }
+    }
+
+    // the scan only ever sees shaders already in the list, and the list is
+    // pruned only between scans, so its indices still hold
+    std::future<std::vector<ChangedSource>>& scan = reloadScan();
+    if (scan.valid() && scan.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        for (ChangedSource& changed : scan.get()) {
+            WatchedShader& watched = shaders[changed.index];
+            watched.vertexTime = changed.vertexTime;
+            watched.fragmentTime = changed.fragmentTime;
+            std::shared_ptr<ShaderProgram> program = watched.program.lock();
+            uint64_t key = shaderCacheKey(changed.vertexCode, changed.fragmentCode);
+            // saved without a change, or read mid-write
+            if (!program || key == program->key || changed.vertexCode.empty() || changed.fragmentCode.empty()) {
+                continue;
+            }
+            if (watched.reload != 0) {
+                dropReload(watched);
+            }
+            watched.reload = glCreateProgram();
+            watched.reloadKey = key;
+            startCompile(watched.reload, changed.vertexCode, changed.fragmentCode, watched.reloadVertex,
+                watched.reloadFragment);
+        }
+    }
+
+    static std::chrono::steady_clock::time_point lastScan;
+    auto now = std::chrono::steady_clock::now();
+    if (scan.valid() || now - lastScan < RELOAD_SCAN_INTERVAL) {
+        return;
+    }
+    lastScan = now;
+    for (size_t i = shaders.size(); i-- > 0;) {
+        if (shaders[i].program.expired()) {
+            if (shaders[i].reload != 0) {
+                dropReload(shaders[i]);
+            }
+            if (shaders[i].swapped != 0) {
+                glDeleteProgram(shaders[i].swapped);
+            }
+            shaders.erase(shaders.begin() + (ptrdiff_t)i);
+        }
+    }
+    std::vector<SourceStamp> stamps;
+    for (size_t i = 0; i < shaders.size(); i++) {
+        std::shared_ptr<ShaderProgram> program = shaders[i].program.lock();
+        stamps.push_back({ i, program->vertexPath, program->fragmentPath, shaders[i].vertexTime, shaders[i].fragmentTime });
+    }
+    scan = jobs().submit([stamps = std::move(stamps)] {
+        std::vector<ChangedSource> changed;
+        for (const SourceStamp& stamp : stamps) {
+            auto vertexTime = modifiedTime(stamp.vertexPath);
+            auto fragmentTime = modifiedTime(stamp.fragmentPath);
+            if (vertexTime == stamp.vertexTime && fragmentTime == stamp.fragmentTime) {
+                continue;
+            }
+            changed.push_back({ stamp.index, readSource(stamp.vertexPath), readSource(stamp.fragmentPath), vertexTime,
+                fragmentTime });
+        }
+        return changed;
+    });
+#endif
+}
+
+bool Shader::checkCompileErrors(unsigned int shader, const std::string& type)
 {
     int success;
     char infoLog[1024];
@@ -62,4 +352,5 @@ void Shader::checkCompileErrors(unsigned int shader, const std::string& type)
                       << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
         }
     }
+    return success != 0;
 }
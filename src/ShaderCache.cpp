@@ -0,0 +1,134 @@
+#include "ShaderCache.h"
+#include "utils/Hash.h"
+#include "utils/MappedFile.h"
+#include <GL/glew.h>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#define SHADER_CACHE_DIR "../cache/shaders"
+#define SHADER_CACHE_VERSION 1
+
+namespace {
+// Layout: header, then length bytes of driver binary.
+struct ProgramHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint64_t key;
+    uint64_t length;
+};
+
+const char SHADER_CACHE_MAGIC[8] = { 'S', 'P', 'K', 'P', 'R', 'O', 'G', '\0' };
+
+std::string cachePath(const std::string& vertexPath, const std::string& fragmentPath)
+{
+    std::string stem = std::filesystem::path(vertexPath).stem().string();
+    return std::string(SHADER_CACHE_DIR) + "/" + stem + "-" + hashToHex(hashString(fragmentPath, hashString(vertexPath)))
+        + ".spkprog";
+}
+
+uint64_t driverHash()
+{
+    static const uint64_t hash = [] {
+        uint64_t value = FNV_OFFSET;
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            const auto* text = reinterpret_cast<const char*>(glGetString(name));
+            if (text != nullptr) {
+                value = hashBytes(text, strlen(text) + 1, value);
+            }
+        }
+        return value;
+    }();
+    return hash;
+}
+}
+
+bool programBinariesSupported()
+{
+    // core since 4.1, but a driver may still offer no formats at all
+    static const bool supported = [] {
+        if (!GLEW_ARB_get_program_binary) {
+            return false;
+        }
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }();
+    return supported;
+}
+
+uint64_t shaderCacheKey(const std::string& vertexSource, const std::string& fragmentSource)
+{
+    // the driver only matters to a stored binary
+    uint64_t hash = hashString(vertexSource, programBinariesSupported() ? driverHash() : FNV_OFFSET);
+    // keeps "ab" + "c" apart from "a" + "bc"
+    hash = hashValue(vertexSource.size(), hash);
+    return hashString(fragmentSource, hash);
+}
+
+bool loadProgramBinary(unsigned int program, const std::string& vertexPath, const std::string& fragmentPath,
+    uint64_t key)
+{
+    if (!programBinariesSupported()) {
+        return false;
+    }
+    MappedFile file(cachePath(vertexPath, fragmentPath));
+    if (!file.isOpen() || file.size() < sizeof(ProgramHeader)) {
+        return false;
+    }
+    ProgramHeader header {};
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, SHADER_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != SHADER_CACHE_VERSION
+        || header.key != key || header.length != file.size() - sizeof(header)) {
+        return false;
+    }
+    glProgramBinary(program, header.format, file.data() + sizeof(header), (GLsizei)header.length);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        std::cerr << "Driver rejected the cached binary for " << vertexPath << ", compiling it" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool readProgramBinary(unsigned int program, unsigned int& format, std::vector<unsigned char>& blob)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return false;
+    }
+    blob.resize((size_t)length);
+    GLsizei written = 0;
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(program, length, &written, &binaryFormat, blob.data());
+    blob.resize((size_t)written);
+    format = binaryFormat;
+    return written > 0;
+}
+
+void storeProgramBinary(unsigned int program, const std::string& vertexPath, const std::string& fragmentPath,
+    uint64_t key)
+{
+    if (!programBinariesSupported()) {
+        return;
+    }
+    ProgramHeader header {};
+    std::vector<unsigned char> blob;
+    if (!readProgramBinary(program, header.format, blob)) {
+        return;
+    }
+    memcpy(header.magic, SHADER_CACHE_MAGIC, sizeof(header.magic));
+    header.version = SHADER_CACHE_VERSION;
+    header.key = key;
+    header.length = blob.size();
+
+    std::error_code error;
+    std::filesystem::create_directories(SHADER_CACHE_DIR, error);
+    std::string path = cachePath(vertexPath, fragmentPath);
+    if (!writeFileAtomically(path, { { &header, sizeof(header) }, { blob.data(), blob.size() } })) {
+        std::cerr << "Could not write shader cache " << path << std::endl;
+    }
+}
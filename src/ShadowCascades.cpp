@@ -0,0 +1,168 @@
+#include "ShadowCascades.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/ext/matrix_clip_space.hpp>
+
+CameraLens lensFromProjection(const glm::mat4& projection)
+{
+    CameraLens lens;
+    lens.nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+    lens.farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+    lens.tanHalfFovY = 1.0f / projection[1][1];
+    lens.aspect = projection[1][1] / projection[0][0];
+    return lens;
+}
+
+void fitCascades(const glm::mat4& view, const CameraLens& lens, const glm::vec3& lightDirection,
+    Cascade cascades[SHADOW_CASCADES])
+{
+    glm::mat4 cameraWorld = glm::inverse(view);
+    glm::vec3 eye(cameraWorld[3]);
+    glm::vec3 right = glm::normalize(glm::vec3(cameraWorld[0]));
+    glm::vec3 up = glm::normalize(glm::vec3(cameraWorld[1]));
+    glm::vec3 forward = -glm::normalize(glm::vec3(cameraWorld[2]));
+
+    // light space without translation: z points at the light
+    glm::vec3 towardLight = -glm::normalize(lightDirection);
+    glm::vec3 helper = std::abs(towardLight.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::vec3 lightX = glm::normalize(glm::cross(helper, towardLight));
+    glm::vec3 lightY = glm::cross(towardLight, lightX);
+    glm::mat4 lightRotation(1.0f);
+    for (int i = 0; i < 3; i++) {
+        lightRotation[i][0] = lightX[i];
+        lightRotation[i][1] = lightY[i];
+        lightRotation[i][2] = towardLight[i];
+    }
+
+    float nearPlane = lens.nearPlane;
+    float farPlane = std::min(lens.farPlane, SHADOW_DISTANCE);
+    float splitNear = nearPlane;
+    for (int c = 0; c < SHADOW_CASCADES; c++) {
+        float t = (float)(c + 1) / SHADOW_CASCADES;
+        float logarithmic = nearPlane * std::pow(farPlane / nearPlane, t);
+        float even = nearPlane + (farPlane - nearPlane) * t;
+        float splitFar = SHADOW_SPLIT_LAMBDA * logarithmic + (1.0f - SHADOW_SPLIT_LAMBDA) * even;
+
+        glm::vec3 corners[8];
+        int corner = 0;
+        for (float depth : { splitNear, splitFar }) {
+            glm::vec3 centre = eye + forward * depth;
+            float halfHeight = depth * lens.tanHalfFovY;
+            float halfWidth = halfHeight * lens.aspect;
+            for (float sx : { -1.0f, 1.0f }) {
+                for (float sy : { -1.0f, 1.0f }) {
+                    corners[corner++] = centre + right * (sx * halfWidth) + up * (sy * halfHeight);
+                }
+            }
+        }
+        glm::vec3 centre(0.0f);
+        for (const auto& point : corners) {
+            centre += point / 8.0f;
+        }
+        float radius = 0.0f;
+        for (const auto& point : corners) {
+            radius = std::max(radius, glm::length(point - centre));
+        }
+        // only the lens sets the radius; rounding hides float noise as the camera turns
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        // The box is a snap step wider than the sphere, so the sphere stays
+        // inside while its centre moves within a step.
+        float halfSize = radius * SHADOW_RESOLUTION / (SHADOW_RESOLUTION - 2.0f * SHADOW_SNAP_TEXELS);
+        float step = 2.0f * halfSize / SHADOW_RESOLUTION * SHADOW_SNAP_TEXELS;
+        glm::vec3 lightCentre(lightRotation * glm::vec4(centre, 1.0f));
+        for (int i = 0; i < 3; i++) {
+            lightCentre[i] = (std::floor(lightCentre[i] / step) + 0.5f) * step;
+        }
+        float halfDepth = radius + step;
+        glm::mat4 projection = glm::ortho(lightCentre.x - halfSize, lightCentre.x + halfSize, lightCentre.y - halfSize,
+            lightCentre.y + halfSize, -(lightCentre.z + halfDepth + SHADOW_CASTER_DISTANCE), -(lightCentre.z - halfDepth));
+
+        cascades[c].lightSpace = projection * lightRotation;
+        cascades[c].nearDepth = splitNear;
+        cascades[c].farDepth = splitFar;
+        splitNear = splitFar;
+    }
+}
+
+ShadowCascades::ShadowCascades(int resolution)
+    : m_resolution(resolution)
+{
+    for (unsigned int* texture : { &m_live, &m_static }) {
+        glGenTextures(1, texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, *texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, SHADOW_CASCADES, 0,
+            GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(SHADOW_CASCADES, m_liveFramebuffers);
+    glGenFramebuffers(SHADOW_CASCADES, m_staticFramebuffers);
+    for (int c = 0; c < SHADOW_CASCADES; c++) {
+        for (auto [framebuffer, texture] : { std::make_pair(m_liveFramebuffers[c], m_live),
+                 std::make_pair(m_staticFramebuffers[c], m_static) }) {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, c);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowCascades::~ShadowCascades()
+{
+    glDeleteFramebuffers(SHADOW_CASCADES, m_liveFramebuffers);
+    glDeleteFramebuffers(SHADOW_CASCADES, m_staticFramebuffers);
+    glDeleteTextures(1, &m_live);
+    glDeleteTextures(1, &m_static);
+}
+
+void ShadowCascades::beginStatic(int cascade)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, m_staticFramebuffers[cascade]);
+    glViewport(0, 0, m_resolution, m_resolution);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void ShadowCascades::beginCascade(int cascade)
+{
+    // GL 3.3 has no image copy; a depth blit between the layers does the same
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_staticFramebuffers[cascade]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_liveFramebuffers[cascade]);
+    glBlitFramebuffer(0, 0, m_resolution, m_resolution, 0, 0, m_resolution, m_resolution, GL_DEPTH_BUFFER_BIT,
+        GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_liveFramebuffers[cascade]);
+    glViewport(0, 0, m_resolution, m_resolution);
+}
+
+void ShadowCascades::end()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadowCascades::bindTexture(unsigned int unit) const
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_live);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void bindShadows(StreamBuffer& stream, const ShadowBlock& block)
+{
+    StreamAllocation range = stream.allocate(sizeof(ShadowBlock), stream.uniformAlignment());
+    if (!range.data) {
+        return;
+    }
+    memcpy(range.data, &block, sizeof(ShadowBlock));
+    glBindBufferRange(GL_UNIFORM_BUFFER, SHADOW_BLOCK_BINDING, stream.buffer(), (GLintptr)range.offset,
+        sizeof(ShadowBlock));
+}
@@ -0,0 +1,219 @@
+#include "StreamBuffer.h"
+#include <GL/glew.h>
+#include <iostream>
+
+namespace {
+const size_t REGION_ALIGNMENT = 256;
+// one second; a fence that takes longer means the GPU is hung, not busy
+const GLuint64 FENCE_TIMEOUT = 1000000000;
+
+size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+}
+
+StreamRing::StreamRing(size_t regionSize, unsigned int frames)
+    : m_regionSize(alignUp(regionSize, REGION_ALIGNMENT))
+    , m_frames(std::max(frames, 1u))
+    , m_region(m_frames - 1)
+{
+}
+
+void StreamRing::beginFrame()
+{
+    m_region = (m_region + 1) % m_frames;
+    m_head = 0;
+}
+
+size_t StreamRing::allocate(size_t bytes, size_t alignment)
+{
+    // regions start aligned, so aligning the head aligns the offset
+    size_t head = alignUp(m_head, alignment);
+    if (head + bytes > m_regionSize) {
+        return NO_SPACE;
+    }
+    m_head = head + bytes;
+    return regionOffset() + head;
+}
+
+GLStreamBackend::~GLStreamBackend()
+{
+    release();
+}
+
+void GLStreamBackend::release()
+{
+    if (m_buffer == 0) {
+        return;
+    }
+    if (m_persistent) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_persistent = nullptr;
+    }
+    glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+}
+
+void GLStreamBackend::create(size_t bytes)
+{
+    release();
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    m_uniformAlignment = (size_t)std::max(alignment, 1);
+
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, (GLsizeiptr)bytes, nullptr, flags);
+        m_persistent = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, (GLsizeiptr)bytes, flags));
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)bytes, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+unsigned char* GLStreamBackend::map(size_t offset, size_t bytes)
+{
+    if (m_persistent) {
+        return m_persistent + offset;
+    }
+    // the fence already kept the GPU off this range, so no implicit sync
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    void* memory = glMapBufferRange(GL_ARRAY_BUFFER, (GLintptr)offset, (GLsizeiptr)bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return static_cast<unsigned char*>(memory);
+}
+
+void GLStreamBackend::unmap(size_t, size_t bytesWritten)
+{
+    if (m_persistent) {
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    if (bytesWritten > 0) {
+        // relative to the mapped range
+        glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, (GLsizeiptr)bytesWritten);
+    }
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+uintptr_t GLStreamBackend::fence()
+{
+    return reinterpret_cast<uintptr_t>(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+}
+
+bool GLStreamBackend::wait(uintptr_t fence)
+{
+    GLsync sync = reinterpret_cast<GLsync>(fence);
+    GLenum result = glClientWaitSync(sync, 0, 0);
+    bool blocked = result == GL_TIMEOUT_EXPIRED;
+    if (blocked) {
+        result = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+    }
+    if (result == GL_WAIT_FAILED || result == GL_TIMEOUT_EXPIRED) {
+        std::cerr << "Stream buffer fence did not signal" << std::endl;
+    }
+    glDeleteSync(sync);
+    return blocked;
+}
+
+StreamBuffer::StreamBuffer(std::unique_ptr<StreamBackend> backend, size_t regionSize, unsigned int frames)
+    : m_backend(std::move(backend))
+    , m_ring(regionSize, frames)
+    , m_fences(m_ring.frames(), 0)
+{
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    finishWrites();
+    waitAll();
+}
+
+void StreamBuffer::waitAll()
+{
+    for (auto& fence : m_fences) {
+        if (fence != 0) {
+            m_backend->wait(fence);
+            fence = 0;
+        }
+    }
+}
+
+void StreamBuffer::beginFrame(size_t bytesNeeded)
+{
+    if (m_inFrame) {
+        endFrame();
+    }
+    size_t regionSize = m_ring.regionSize();
+    if (bytesNeeded > regionSize || m_overflowed) {
+        // half again over the estimate, so a slowly growing scene does not
+        // rebuild the buffer every frame
+        regionSize = std::max(regionSize * 2, bytesNeeded + bytesNeeded / 2);
+    }
+    if (!m_created || regionSize != m_ring.regionSize()) {
+        if (m_created) {
+            waitAll();
+            m_stats.grows++;
+        }
+        m_ring = StreamRing(regionSize, m_ring.frames());
+        m_backend->create(m_ring.regionSize() * m_ring.frames());
+        m_created = true;
+        m_overflowed = false;
+    }
+
+    m_ring.beginFrame();
+    uintptr_t& fence = m_fences[m_ring.region()];
+    if (fence != 0) {
+        if (m_backend->wait(fence)) {
+            m_stats.stalls++;
+        }
+        fence = 0;
+    }
+    m_mapped = m_backend->map(m_ring.regionOffset(), m_ring.regionSize());
+    m_inFrame = true;
+}
+
+StreamAllocation StreamBuffer::allocate(size_t bytes, size_t alignment)
+{
+    StreamAllocation allocation;
+    if (!m_mapped) {
+        return allocation;
+    }
+    size_t offset = m_ring.allocate(bytes, alignment);
+    if (offset == StreamRing::NO_SPACE) {
+        m_overflowed = true;
+        m_stats.overflows++;
+        return allocation;
+    }
+    allocation.data = m_mapped + (offset - m_ring.regionOffset());
+    allocation.offset = offset;
+    allocation.size = bytes;
+    return allocation;
+}
+
+void StreamBuffer::finishWrites()
+{
+    if (!m_mapped) {
+        return;
+    }
+    m_backend->unmap(m_ring.regionOffset(), m_ring.used());
+    m_mapped = nullptr;
+}
+
+void StreamBuffer::endFrame()
+{
+    if (!m_inFrame) {
+        return;
+    }
+    finishWrites();
+    m_inFrame = false;
+    m_fences[m_ring.region()] = m_backend->fence();
+    m_stats.lastFrameBytes = m_ring.used();
+}
@@ -1,60 +1,93 @@
 
 #include "Terrain.h"
+#include "./utils/Hash.h"
+#include "./utils/MappedFile.h"
+#include "./utils/Parallel.h"
+#include "./utils/Random.h"
+#include "./utils/Simd.h"
+#include "./utils/TextureCache.h"
 #include "./utils/Utilities.h"
 #include "./utils/Vertex.h"
 #include "Shader.h"
 #include <GL/glew.h>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/matrix.hpp>
 #include <initializer_list>
 
-void getRandomPoint(TerrainPoint& p1, TerrainPoint& p2, int terrainSize)
+#define TERRAIN_CACHE_DIR "../cache"
+#define TERRAIN_CACHE_VERSION 2
+
+namespace {
+// Layout: header, heights (size * size floats, row by row), normals
+// (size * size vec3), then indexCount unsigned ints.
+struct TerrainCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;
+    uint64_t key;
+    uint64_t indexCount;
+};
+const char TERRAIN_CACHE_MAGIC[8] = { 'S', 'P', 'K', 'T', 'E', 'R', 'R', '\0' };
+}
+
+void getRandomPoint(TerrainPoint& p1, TerrainPoint& p2, int terrainSize, rng::Stream& stream)
 {
-    p1.x = rand() % terrainSize;
-    p1.z = rand() % terrainSize;
-    p2.x = rand() % terrainSize;
-    p2.z = rand() % terrainSize;
-    int count = 0;
+    p1.x = stream.nextInt(0, terrainSize);
+    p1.z = stream.nextInt(0, terrainSize);
     do {
-        p2.x = rand() % terrainSize;
-        p2.z = rand() % terrainSize;
-        count++;
+        p2.x = stream.nextInt(0, terrainSize);
+        p2.z = stream.nextInt(0, terrainSize);
     } while (p1.isEqual(p2));
 }
 
 void Terrain::faultFormationTerrain(int iterations, float minHeight, float maxHeight)
 {
+    struct Fault {
+        TerrainPoint p1;
+        int dirx;
+        int dirz;
+        float height;
+    };
     float deltaHeight = maxHeight - minHeight;
 
+    // Every fault line draws from its own stream, so the lines are fixed by
+    // the seed alone and the accumulation below can run in any order.
+    std::vector<Fault> faults(iterations);
     for (int i = 0; i < iterations; i++) {
-
         float iterationRatio = ((float)i / (float)iterations);
-        float height = maxHeight - iterationRatio * deltaHeight;
-        int center = terrainSize / 2;
-
-        TerrainPoint p1;
+        rng::Stream stream(params.seed, rng::Subsystem::Terrain, i);
         TerrainPoint p2;
-        getRandomPoint(p1, p2, this->terrainSize);
-        int dirx = p2.x - p1.x;
-        int dirz = p2.z - p1.z;
-        for (int x = 0; x < this->terrainSize; x++) {
-            for (int z = 0; z < this->terrainSize; z++) {
-                int dirx_in = x - p1.x;
-                int dirz_in = z - p1.z;
-                int cross = dirx_in * dirz - dirx * dirz_in;
-                if (cross > 0) {
-                    float currentHeight = heightMap(x, z);
-                    heightMap(x, z) = currentHeight + height;
+        getRandomPoint(faults[i].p1, p2, this->terrainSize, stream);
+        faults[i].dirx = p2.x - faults[i].p1.x;
+        faults[i].dirz = p2.z - faults[i].p1.z;
+        faults[i].height = maxHeight - iterationRatio * deltaHeight;
+    }
+
+    parallelFor(0, terrainSize, 16, [&](int xBegin, int xEnd) {
+        for (int x = xBegin; x < xEnd; x++) {
+            float* row = heightMap.rowData(x);
+            for (const auto& fault : faults) {
+                int dirx_in = x - fault.p1.x;
+                for (int z = 0; z < terrainSize; z++) {
+                    int cross = dirx_in * fault.dirz - fault.dirx * (z - fault.p1.z);
+                    row[z] += cross > 0 ? fault.height : 0.0f;
                 }
             }
         }
-    }
+    });
 
-    ApplyFirFilter(0.9);
+    ApplyFirFilter(params.filter);
 }
 
 void Terrain::CreateFaultFormation(int terrainSize, int iterations, float minHeight, float maxHeight)
 {
+    params.size = terrainSize;
+    params.iterations = iterations;
+    params.minHeight = minHeight;
+    params.maxHeight = maxHeight;
     this->terrainSize = terrainSize;
     this->minHeight = minHeight;
     this->maxHeight = maxHeight;
@@ -73,9 +106,11 @@ void Terrain::CreateFaultFormation(int terrainSize, int iterations, float minHei
     }
 }
 
-Terrain::Terrain(float scale, std::initializer_list<const std::string> textureFiles, float textureScale)
+Terrain::Terrain(float scale, std::initializer_list<const std::string> textureFiles, float textureScale,
+    const TerrainParams& generator, bool cached)
     : scale(scale)
     , textureScale(textureScale)
+    , params(generator)
 {
 
     terposition = glm::vec3(0.0);
@@ -98,14 +133,19 @@ Terrain::Terrain(float scale, std::initializer_list<const std::string> textureFi
     glEnableVertexAttribArray(normal);
     glVertexAttribPointer(normal, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(numfloats * sizeof(float)));
     numfloats += 3;
-    CreateFaultFormation(1000, 300, 0, 120);
-    normalMap = Array2D<glm::vec3>(terrainSize, terrainSize, glm::vec3(0.0f));
-    populateBuffer();
+    std::string cacheFile = cachePath();
+    if (!cached || !loadCache(cacheFile)) {
+        CreateFaultFormation(params.size, params.iterations, params.minHeight, params.maxHeight);
+        normalMap = Array2D<glm::vec3>(terrainSize, terrainSize, glm::vec3(0.0f));
+        populateBuffer();
+        if (cached) {
+            saveCache(cacheFile);
+        }
+    }
+    heightPyramid.build(heightMap, width, height);
 
     for (auto& textureFile : textureFiles) {
-        Texture texture(GL_TEXTURE_2D, textureFile);
-        texture.Load();
-        textures.push_back(std::make_shared<Texture>(texture));
+        textures.push_back(std::make_shared<Texture>(textureCache().acquire(textureFile)));
     }
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -147,74 +187,263 @@ float Terrain::FIRFilterSinglePoint(int x, int z, float preval, float filter)
 
 void Terrain::ApplyFirFilter(float filter)
 {
-    for (int z = 0; z < terrainSize; z++) {
-        float PrevVal = heightMap(0, z);
+    // The left/right passes run along x, so columns are independent: each tile
+    // owns a band of z and walks the rows carrying one running value per column.
+    parallelFor(0, terrainSize, 64, [&](int zBegin, int zEnd) {
+        std::vector<float> prev(zEnd - zBegin);
+        const float* first = heightMap.rowData(0);
+        std::copy(first + zBegin, first + zEnd, prev.begin());
         for (int x = 1; x < terrainSize; x++) {
-            PrevVal = FIRFilterSinglePoint(x, z, PrevVal, filter);
+            float* row = heightMap.rowData(x);
+            for (int z = zBegin; z < zEnd; z++) {
+                prev[z - zBegin] = row[z] = filter * prev[z - zBegin] + (1 - filter) * row[z];
+            }
         }
-    }
 
-    // right to left
-    for (int z = 0; z < terrainSize; z++) {
-        float PrevVal = heightMap(terrainSize - 1, z);
+        // right to left
+        const float* last = heightMap.rowData(terrainSize - 1);
+        std::copy(last + zBegin, last + zEnd, prev.begin());
         for (int x = terrainSize - 2; x >= 0; x--) {
-            PrevVal = FIRFilterSinglePoint(x, z, PrevVal, filter);
+            float* row = heightMap.rowData(x);
+            for (int z = zBegin; z < zEnd; z++) {
+                prev[z - zBegin] = row[z] = filter * prev[z - zBegin] + (1 - filter) * row[z];
+            }
         }
-    }
+    });
 
-    // bottom to top
-    for (int x = 0; x < terrainSize; x++) {
-        float PrevVal = heightMap(x, 0);
-        for (int z = 1; z < terrainSize; z++) {
-            PrevVal = FIRFilterSinglePoint(x, z, PrevVal, filter);
+    // bottom to top, then top to bottom; rows are independent
+    parallelFor(0, terrainSize, 16, [&](int xBegin, int xEnd) {
+        for (int x = xBegin; x < xEnd; x++) {
+            float* row = heightMap.rowData(x);
+            float prevVal = row[0];
+            for (int z = 1; z < terrainSize; z++) {
+                prevVal = row[z] = filter * prevVal + (1 - filter) * row[z];
+            }
+            prevVal = row[terrainSize - 1];
+            for (int z = terrainSize - 2; z >= 0; z--) {
+                prevVal = row[z] = filter * prevVal + (1 - filter) * row[z];
+            }
+        }
+    });
+}
+
+namespace {
+// Same result as Vertex::init for a cell whose four neighbours are known to be
+// in range: cross((2, dx, 0), (0, dz, 2)) normalised and flipped.
+void writeInteriorVertex(Vertex& vertex, int x, int z, float centre, float dx, float dz, float texStep)
+{
+    float invLength = 1.0f / std::sqrt(dx * dx + dz * dz + 4.0f);
+    vertex.position = glm::vec3(x, -centre, z);
+    vertex.tex = glm::vec2(z * texStep, x * texStep);
+    vertex.normal = glm::vec3(-dx * invLength, 2.0f * invLength, -dz * invLength);
+}
+}
+
+void Terrain::buildVertexRow(int x, int zBegin, int zEnd, Vertex* out)
+{
+    const float texStep = textureScale / (float)terrainSize;
+    glm::vec3* normals = normalMap.rowData(x);
+    auto clamped = [&](int z) {
+        Vertex& vertex = out[z - zBegin];
+        vertex.init(*this, x, z);
+        normals[z] = vertex.normal;
+    };
+
+    // Border rows and the first/last cell of every row need clamping.
+    if (x == 0 || x == width - 1 || height < 3) {
+        for (int z = zBegin; z < zEnd; z++) {
+            clamped(z);
         }
+        return;
+    }
+    if (zBegin == 0) {
+        clamped(0);
+    }
+    if (zEnd == height) {
+        clamped(height - 1);
     }
 
-    // top to bottom
-    for (int x = 0; x < terrainSize; x++) {
-        float PrevVal = heightMap(x, terrainSize - 1);
-        for (int z = terrainSize - 2; z >= 0; z--) {
-            PrevVal = FIRFilterSinglePoint(x, z, PrevVal, filter);
+    const float* left = heightMap.rowData(x - 1);
+    const float* centre = heightMap.rowData(x);
+    const float* right = heightMap.rowData(x + 1);
+    const int interiorEnd = std::min(zEnd, height - 1);
+
+    const simd::Float4 zero = simd::set1(0.0f);
+    const simd::Float4 one = simd::set1(1.0f);
+    const simd::Float4 two = simd::set1(2.0f);
+    const simd::Float4 four = simd::set1(4.0f);
+    int z = std::max(zBegin, 1);
+    for (; z + 4 <= interiorEnd; z += 4) {
+        simd::Float4 dx = simd::sub(simd::load(right + z), simd::load(left + z));
+        simd::Float4 dz = simd::sub(simd::load(centre + z + 1), simd::load(centre + z - 1));
+        simd::Float4 lengthSq = simd::add(simd::add(simd::mul(dx, dx), simd::mul(dz, dz)), four);
+        simd::Float4 invLength = simd::div(one, simd::sqrt(lengthSq));
+
+        float nx[4], ny[4], nz[4];
+        simd::store(nx, simd::mul(simd::sub(zero, dx), invLength));
+        simd::store(ny, simd::mul(two, invLength));
+        simd::store(nz, simd::mul(simd::sub(zero, dz), invLength));
+        for (int lane = 0; lane < 4; lane++) {
+            int cz = z + lane;
+            Vertex& vertex = out[cz - zBegin];
+            vertex.position = glm::vec3(x, -centre[cz], cz);
+            vertex.tex = glm::vec2(cz * texStep, x * texStep);
+            vertex.normal = glm::vec3(nx[lane], ny[lane], nz[lane]);
+            normals[cz] = vertex.normal;
         }
     }
+    for (; z < interiorEnd; z++) {
+        Vertex& vertex = out[z - zBegin];
+        writeInteriorVertex(vertex, x, z, centre[z], right[z] - left[z], centre[z + 1] - centre[z - 1], texStep);
+        normals[z] = vertex.normal;
+    }
+}
+
+void Terrain::buildVertices(int xBegin, int xEnd, Vertex* vertices)
+{
+    for (int x = xBegin; x < xEnd; x++) {
+        buildVertexRow(x, 0, height, vertices + (size_t)x * height);
+    }
+}
+
+void Terrain::buildIndices(std::vector<unsigned int>& indices) const
+{
+    int numQuads = (width - 1) * (height - 1);
+    indices.resize(numQuads * 6);
+    parallelFor(0, width - 1, 64, [&](int xBegin, int xEnd) {
+        for (int x = xBegin; x < xEnd; x++) {
+            size_t i = (size_t)x * (height - 1) * 6;
+            for (int z = 0; z < height - 1; z++) {
+                unsigned int topLeft = (z * width) + x;
+                unsigned int topRight = topLeft + 1;
+                unsigned int bottomLeft = ((z + 1) * width) + x;
+                unsigned int bottomRight = bottomLeft + 1;
+                indices[i++] = topLeft;
+                indices[i++] = bottomLeft;
+                indices[i++] = topRight;
+                indices[i++] = topRight;
+                indices[i++] = bottomLeft;
+                indices[i++] = bottomRight;
+            }
+        }
+    });
 }
 
 void Terrain::populateBuffer()
 {
     std::vector<Vertex> vertices;
     vertices.resize(height * width);
+    parallelFor(0, width, 16, [&](int xBegin, int xEnd) {
+        buildVertices(xBegin, xEnd, vertices.data());
+    });
 
-    int index = 0;
-    for (int x = 0; x < width; x++) {
-        for (int z = 0; z < height; z++) {
-            Vertex vertex;
-            vertex.init(*this, x, z);
-            normalMap(x, z) = vertex.getNormal();
-            vertices[index] = vertex;
-            index++;
-        }
+    std::vector<unsigned int> indices;
+    buildIndices(indices);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+}
+
+void Terrain::buildVertexRowFromMaps(int x, Vertex* out) const
+{
+    const float texStep = textureScale / (float)terrainSize;
+    const float* heights = heightMap.rowData(x);
+    const glm::vec3* normals = normalMap.rowData(x);
+    for (int z = 0; z < height; z++) {
+        out[z].position = glm::vec3(x, -heights[z], z);
+        out[z].tex = glm::vec2(z * texStep, x * texStep);
+        out[z].normal = normals[z];
     }
+}
 
-    std::vector<unsigned int> indices;
-    int numQuads = (width - 1) * (height - 1);
-    indices.resize(numQuads * 6);
-    int i = 0;
-    for (int x = 0; x < width - 1; x++) {
-        for (int z = 0; z < height - 1; z++) {
-            unsigned int topLeft = (z * width) + x;
-            unsigned int topRight = topLeft + 1;
-            unsigned int bottomLeft = ((z + 1) * width) + x;
-            unsigned int bottomRight = bottomLeft + 1;
-            indices[i++] = topLeft;
-            indices[i++] = bottomLeft;
-            indices[i++] = topRight;
-            indices[i++] = topRight;
-            indices[i++] = bottomLeft;
-            indices[i++] = bottomRight;
-        }
+uint64_t Terrain::cacheKey() const
+{
+    uint64_t key = hashValue((uint32_t)TERRAIN_CACHE_VERSION);
+    key = hashValue((uint32_t)sizeof(Vertex), key);
+    key = hashValue(params.size, key);
+    key = hashValue(params.iterations, key);
+    key = hashValue(params.minHeight, key);
+    key = hashValue(params.maxHeight, key);
+    key = hashValue(params.filter, key);
+    key = hashValue(params.seed, key);
+    return key;
+}
+
+std::string Terrain::cachePath() const
+{
+    return std::string(TERRAIN_CACHE_DIR) + "/terrain-" + hashToHex(cacheKey()) + ".bin";
+}
+
+bool Terrain::loadCache(const std::string& path)
+{
+    MappedFile file(path);
+    if (!file.isOpen() || file.size() < sizeof(TerrainCacheHeader)) {
+        return false;
     }
+    TerrainCacheHeader header {};
+    memcpy(&header, file.data(), sizeof(header));
+    const size_t cells = (size_t)header.size * header.size;
+    const size_t expected = sizeof(header) + cells * (sizeof(float) + sizeof(glm::vec3)) + header.indexCount * sizeof(unsigned int);
+    if (memcmp(header.magic, TERRAIN_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != TERRAIN_CACHE_VERSION
+        || header.key != cacheKey() || (int)header.size != params.size || file.size() != expected) {
+        std::cerr << "Ignoring stale terrain cache " << path << std::endl;
+        return false;
+    }
+
+    const unsigned char* cursor = file.data() + sizeof(header);
+    const auto* heights = reinterpret_cast<const float*>(cursor);
+    cursor += cells * sizeof(float);
+    const auto* normals = reinterpret_cast<const glm::vec3*>(cursor);
+    cursor += cells * sizeof(glm::vec3);
+    const auto* indices = reinterpret_cast<const unsigned int*>(cursor);
+
+    terrainSize = params.size;
+    width = terrainSize;
+    height = terrainSize;
+    minHeight = params.minHeight;
+    maxHeight = params.maxHeight;
+    heightMap = Array2D<float>(terrainSize, terrainSize);
+    normalMap = Array2D<glm::vec3>(terrainSize, terrainSize);
+
+    std::vector<Vertex> vertices;
+    vertices.resize(cells);
+    parallelFor(0, width, 16, [&](int xBegin, int xEnd) {
+        for (int x = xBegin; x < xEnd; x++) {
+            memcpy(heightMap.rowData(x), heights + (size_t)x * height, height * sizeof(float));
+            memcpy(normalMap.rowData(x), normals + (size_t)x * height, height * sizeof(glm::vec3));
+            buildVertexRowFromMaps(x, vertices.data() + (size_t)x * height);
+        }
+    });
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, header.indexCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+    std::cout << "Loaded terrain from cache " << path << std::endl;
+    return true;
+}
+
+void Terrain::saveCache(const std::string& path) const
+{
+    std::error_code error;
+    std::filesystem::create_directories(TERRAIN_CACHE_DIR, error);
+    std::vector<unsigned int> indices;
+    buildIndices(indices);
+
+    TerrainCacheHeader header {};
+    memcpy(header.magic, TERRAIN_CACHE_MAGIC, sizeof(header.magic));
+    header.version = TERRAIN_CACHE_VERSION;
+    header.size = (uint32_t)terrainSize;
+    header.key = cacheKey();
+    header.indexCount = indices.size();
+
+    std::vector<FileChunk> chunks { { &header, sizeof(header) } };
+    for (int x = 0; x < width; x++) {
+        chunks.push_back({ heightMap.rowData(x), sizeof(float) * height });
+    }
+    for (int x = 0; x < width; x++) {
+        chunks.push_back({ normalMap.rowData(x), sizeof(glm::vec3) * height });
+    }
+    chunks.push_back({ indices.data(), sizeof(unsigned int) * indices.size() });
+    if (!writeFileAtomically(path, chunks)) {
+        std::cerr << "Could not write terrain cache " << path << std::endl;
+    }
 }
 
 float Terrain::getTerPosition(int x, int z)
@@ -222,6 +451,134 @@ float Terrain::getTerPosition(int x, int z)
     return getHeight(x, z);
 }
 
+TerrainRect Terrain::clampRect(TerrainRect rect) const
+{
+    rect.x0 = std::max(rect.x0, 0);
+    rect.z0 = std::max(rect.z0, 0);
+    rect.x1 = std::min(rect.x1, width);
+    rect.z1 = std::min(rect.z1, height);
+    return rect;
+}
+
+void Terrain::markDirty(TerrainRect rect)
+{
+    heightPyramid.update(rect.x0, rect.z0, rect.x1, rect.z1);
+    for (auto& dirty : dirtyRects) {
+        if (dirty.touches(rect)) {
+            dirty = dirty.merged(rect);
+            return;
+        }
+    }
+    dirtyRects.push_back(rect);
+}
+
+void Terrain::flattenArea(int x, int z, int size, float height)
+{
+    int half = size / 2;
+    TerrainRect rect = clampRect({ x - half, z - half, x - half + size, z - half + size });
+    if (rect.empty()) {
+        return;
+    }
+    for (int cx = rect.x0; cx < rect.x1; cx++) {
+        float* row = heightMap.rowData(cx);
+        for (int cz = rect.z0; cz < rect.z1; cz++) {
+            row[cz] = -height;
+        }
+    }
+    markDirty(rect);
+}
+
+void Terrain::raiseArea(float x, float z, float radius, float amount)
+{
+    TerrainRect rect = clampRect({ (int)std::floor(x - radius), (int)std::floor(z - radius),
+        (int)std::ceil(x + radius) + 1, (int)std::ceil(z + radius) + 1 });
+    if (rect.empty() || radius <= 0.0f) {
+        return;
+    }
+    float radiusSq = radius * radius;
+    for (int cx = rect.x0; cx < rect.x1; cx++) {
+        float* row = heightMap.rowData(cx);
+        float dx = cx - x;
+        for (int cz = rect.z0; cz < rect.z1; cz++) {
+            float dz = cz - z;
+            float falloff = 1.0f - (dx * dx + dz * dz) / radiusSq;
+            if (falloff > 0.0f) {
+                // heights are stored negated, so raising the surface subtracts
+                row[cz] -= amount * falloff * falloff;
+            }
+        }
+    }
+    markDirty(rect);
+}
+
+void Terrain::crater(float x, float z, float radius, float depth)
+{
+    raiseArea(x, z, radius, -depth);
+}
+
+TerrainHit Terrain::raycast(const TerrainRay& ray) const
+{
+    TerrainRay local = ray;
+    local.origin -= terposition;
+    TerrainHit hit = heightPyramid.raycast(local);
+    hit.point += terposition;
+    return hit;
+}
+
+void Terrain::raycast(const TerrainRay* rays, TerrainHit* hits, size_t count) const
+{
+    std::vector<TerrainRay> local(rays, rays + count);
+    for (auto& ray : local) {
+        ray.origin -= terposition;
+    }
+    heightPyramid.raycast(local.data(), hits, count);
+    for (size_t i = 0; i < count; i++) {
+        hits[i].point += terposition;
+    }
+}
+
+void Terrain::applyEdits()
+{
+    if (dirtyRects.empty()) {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    editStats = {};
+    editRevision++;
+    std::vector<Vertex> editScratch;
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    for (auto rect : dirtyRects) {
+        // normals read one cell either side of the edited heights
+        rect = clampRect({ rect.x0 - 1, rect.z0 - 1, rect.x1 + 1, rect.z1 + 1 });
+        int rows = rect.x1 - rect.x0;
+        int cols = rect.z1 - rect.z0;
+        editScratch.resize((size_t)rows * cols);
+        parallelFor(rect.x0, rect.x1, 32, [&](int xBegin, int xEnd) {
+            for (int x = xBegin; x < xEnd; x++) {
+                buildVertexRow(x, rect.z0, rect.z1, editScratch.data() + (size_t)(x - rect.x0) * cols);
+            }
+        });
+
+        // Vertices are laid out row by row, so whole rows form one contiguous range.
+        if (cols == height) {
+            glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)rect.x0 * height * sizeof(Vertex),
+                editScratch.size() * sizeof(Vertex), editScratch.data());
+            editStats.uploads++;
+        } else {
+            for (int x = rect.x0; x < rect.x1; x++) {
+                glBufferSubData(GL_ARRAY_BUFFER, ((GLintptr)x * height + rect.z0) * sizeof(Vertex),
+                    cols * sizeof(Vertex), editScratch.data() + (size_t)(x - rect.x0) * cols);
+                editStats.uploads++;
+            }
+        }
+        editStats.rects++;
+        editStats.vertices += editScratch.size();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    dirtyRects.clear();
+    editStats.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
 void Terrain::renderShadow() {
     glBindVertexArray(vao);
     glDrawElements(GL_TRIANGLES, (width - 1) * (height - 1) * 6, GL_UNSIGNED_INT, 0);
@@ -233,10 +590,10 @@ void Terrain::render()
     unsigned int b = 1;
     unsigned int c = 2;
     unsigned int d = 3;
-    glUniform1i(glGetUniformLocation(terrainShader.ID, "gTextureHeight0"), a);
-    glUniform1i(glGetUniformLocation(terrainShader.ID, "gTextureHeight1"), b);
-    glUniform1i(glGetUniformLocation(terrainShader.ID, "gTextureHeight2"), c);
-    glUniform1i(glGetUniformLocation(terrainShader.ID, "gTextureHeight3"), d);
+    glUniform1i(glGetUniformLocation(terrainShader.id(), "gTextureHeight0"), a);
+    glUniform1i(glGetUniformLocation(terrainShader.id(), "gTextureHeight1"), b);
+    glUniform1i(glGetUniformLocation(terrainShader.id(), "gTextureHeight2"), c);
+    glUniform1i(glGetUniformLocation(terrainShader.id(), "gTextureHeight3"), d);
     textures[0]->Bind(GL_TEXTURE0);
     textures[1]->Bind(GL_TEXTURE1);
     textures[2]->Bind(GL_TEXTURE2);
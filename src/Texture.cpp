@@ -33,6 +33,17 @@ Texture::Texture(GLenum TextureTarget)
     m_textureTarget = TextureTarget;
 }
 
+Texture::Texture(std::shared_ptr<CachedTexture> cached)
+    : m_fileName(cached->path)
+    , m_textureTarget(GL_TEXTURE_2D)
+    , m_textureObj(cached->id)
+    , m_imageWidth(cached->width)
+    , m_imageHeight(cached->height)
+    , m_imageBPP(cached->channels)
+    , m_cached(std::move(cached))
+{
+}
+
 void Texture::Load(unsigned int a, void* pData)
 {
     void* pImageData = stbi_load_from_memory((const stbi_uc*)pData, a, &m_imageWidth, &m_imageHeight, &m_imageBPP, 0);
@@ -0,0 +1,132 @@
+#include "utils/TextureCache.h"
+#include "TextureUtils.h"
+#include <GL/glew.h>
+#include <chrono>
+#include <filesystem>
+
+namespace {
+std::string canonicalPath(const std::string& path)
+{
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    return error ? std::filesystem::path(path).lexically_normal().string() : canonical.string();
+}
+
+size_t textureBytes(int width, int height, int channels)
+{
+    // a full mip chain adds a third on top of the base level
+    size_t base = (size_t)width * height * channels;
+    return base + base / 3;
+}
+}
+
+std::shared_ptr<CachedTexture> TextureCache::acquire(const std::string& path, bool async)
+{
+    std::string key = canonicalPath(path);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_entries.find(key);
+    if (found != m_entries.end()) {
+        if (auto texture = found->second.lock()) {
+            m_stats.hits++;
+            if (texture->ready) {
+                m_stats.bytesSaved += texture->bytes;
+            } else {
+                texture->pendingHits++;
+            }
+            return texture;
+        }
+    }
+
+    auto* texture = new CachedTexture;
+    texture->path = key;
+    glGenTextures(1, &texture->id);
+    std::shared_ptr<CachedTexture> handle(texture, [this](CachedTexture* released) { release(released); });
+    m_entries[key] = handle;
+    m_stats.misses++;
+    m_stats.live++;
+
+    if (async) {
+        UploadPlaceholderTexture(texture->id);
+        m_pending.push_back({ handle, m_decoders.submit([key] { return DecodeImageFile(key); }) });
+        m_stats.pending++;
+    } else {
+        finishUpload(*texture, DecodeImageFile(key));
+    }
+    return handle;
+}
+
+void TextureCache::finishUpload(CachedTexture& texture, const DecodedImage& image)
+{
+    UploadTexture(texture.id, image);
+    texture.width = image.width;
+    texture.height = image.height;
+    texture.channels = image.channels;
+    texture.bytes = image.isBaked() ? image.bytes() : textureBytes(image.width, image.height, image.channels);
+    texture.ready = true;
+    m_stats.residentBytes += texture.bytes;
+    m_stats.bytesSaved += texture.bytes * texture.pendingHits;
+    texture.pendingHits = 0;
+}
+
+int TextureCache::pumpUploads(float budgetMilliseconds, size_t budgetBytes)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int uploads = 0;
+    size_t bytes = 0;
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        std::shared_ptr<CachedTexture> texture = it->texture.lock();
+        if (!texture) {
+            // every handle went away before the decode finished
+            it = m_pending.erase(it);
+            m_stats.pending--;
+            continue;
+        }
+        if (it->image.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+        DecodedImage image = it->image.get();
+        it = m_pending.erase(it);
+        m_stats.pending--;
+        finishUpload(*texture, image);
+        uploads++;
+        bytes += image.bytes();
+
+        float elapsed = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= budgetMilliseconds || bytes >= budgetBytes) {
+            break;
+        }
+    }
+    m_stats.lastPumpUploads = uploads;
+    m_stats.lastPumpMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return uploads;
+}
+
+void TextureCache::release(CachedTexture* texture)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto found = m_entries.find(texture->path);
+        if (found != m_entries.end() && found->second.expired()) {
+            m_entries.erase(found);
+        }
+        m_stats.live--;
+        m_stats.residentBytes -= texture->bytes;
+    }
+    glDeleteTextures(1, &texture->id);
+    delete texture;
+}
+
+TextureCacheStats TextureCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+TextureCache& textureCache()
+{
+    // Never destroyed: handles held by globals can outlive any static here.
+    static TextureCache* cache = new TextureCache;
+    return *cache;
+}
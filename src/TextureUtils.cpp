@@ -1,42 +1,131 @@
 
 #include "TextureUtils.h"
 #include "stb_image.h"
+#include <filesystem>
 #include <gl/glew.h>
 #include <iostream>
 
-unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma)
+namespace {
+void setSampling()
 {
-    std::string filename = std::string(path);
-    filename = directory + '/' + filename;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    } else {
-        std::cerr << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+GLenum compressedFormat(BlockFormat format)
+{
+    switch (format) {
+    case BlockFormat::BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BlockFormat::BC5:
+        return GL_COMPRESSED_RG_RGTC2;
+    default:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+}
+
+void uploadBaked(const BakedTexture& baked)
+{
+    // RGTC is core, but S3TC is still an extension; without it decode on the CPU
+    bool supported = baked.format == BlockFormat::BC5 || GLEW_EXT_texture_compression_s3tc;
+    for (size_t i = 0; i < baked.levels.size(); i++) {
+        const BakedLevel& level = baked.levels[i];
+        if (supported) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, compressedFormat(baked.format), level.width, level.height, 0,
+                (GLsizei)level.blocks.size(), level.blocks.data());
+        } else {
+            std::vector<unsigned char> rgba = decompressLevel(level, baked.format);
+            glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                rgba.data());
+        }
     }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)baked.levels.size() - 1);
+}
+}
+
+void ImageFree::operator()(unsigned char* pixels) const
+{
+    stbi_image_free(pixels);
+}
 
-    return textureID;
+DecodedImage DecodeImageFile(const std::string& filename)
+{
+    DecodedImage image;
+    image.filename = filename;
+    std::string bakedPath = bakedTexturePath(filename);
+    std::error_code error;
+    if (std::filesystem::exists(bakedPath, error) && readBakedTexture(bakedPath, hashTextureSource(filename), image.baked)) {
+        image.width = image.baked.width();
+        image.height = image.baked.height();
+        image.channels = image.baked.format == BlockFormat::BC5 ? 2 : 4;
+        return image;
+    }
+    image.pixels.reset(stbi_load(filename.c_str(), &image.width, &image.height, &image.channels, 0));
+    if (!image.ok()) {
+        std::cerr << "Texture failed to load at path: " << filename << std::endl;
+        image.width = image.height = image.channels = 0;
+    }
+    return image;
+}
+
+void UploadTexture(unsigned int id, const DecodedImage& image)
+{
+    if (!image.ok()) {
+        return;
+    }
+    if (image.isBaked()) {
+        glBindTexture(GL_TEXTURE_2D, id);
+        uploadBaked(image.baked);
+        setSampling();
+        return;
+    }
+    GLenum format = GL_RGBA;
+    if (image.channels == 1)
+        format = GL_RED;
+    else if (image.channels == 2)
+        format = GL_RG;
+    else if (image.channels == 3)
+        format = GL_RGB;
+    else if (image.channels == 4)
+        format = GL_RGBA;
+
+    // rows of 1 and 3 channel images are not 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+    // the id may have held a baked chain before, or the placeholder
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    setSampling();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void UploadPlaceholderTexture(unsigned int id)
+{
+    const unsigned char grey[4] = { 128, 128, 128, 255 };
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    setSampling();
+}
+
+TextureInfo LoadTextureFile(const std::string& filename)
+{
+    TextureInfo info;
+    glGenTextures(1, &info.id);
+    DecodedImage image = DecodeImageFile(filename);
+    UploadTexture(info.id, image);
+    info.width = image.width;
+    info.height = image.height;
+    info.channels = image.channels;
+    return info;
+}
+
+unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma)
+{
+    std::string filename = std::string(path);
+    filename = directory + '/' + filename;
+    return LoadTextureFile(filename).id;
 }
@@ -0,0 +1,71 @@
+#include "Transform.h"
+#include <cmath>
+#include <vector>
+
+namespace {
+const float TO_RADIANS = 3.14159265358979f / 180.0f;
+
+// Ry(yaw) * Rx(pitch) * Rz(roll) written out, column by column
+glm::mat3 rotationFromTrig(float sp, float cp, float sy, float cy, float sr, float cr)
+{
+    glm::mat3 rotation;
+    rotation[0] = glm::vec3(cy * cr + sy * sp * sr, cp * sr, -sy * cr + cy * sp * sr);
+    rotation[1] = glm::vec3(-cy * sr + sy * sp * cr, cp * cr, sy * sr + cy * sp * cr);
+    rotation[2] = glm::vec3(sy * cp, -sp, cy * cp);
+    return rotation;
+}
+}
+
+glm::mat3 transformRotation(float pitch, float yaw, float roll)
+{
+    float p = pitch * TO_RADIANS, y = yaw * TO_RADIANS, r = roll * TO_RADIANS;
+    return rotationFromTrig(std::sin(p), std::cos(p), std::sin(y), std::cos(y), std::sin(r), std::cos(r));
+}
+
+size_t updateTransforms(Transform* const* transforms, size_t count)
+{
+    thread_local std::vector<Transform*> dirty;
+    thread_local std::vector<float> angles;
+    thread_local std::vector<float> sines;
+    thread_local std::vector<float> cosines;
+    dirty.clear();
+    for (size_t i = 0; i < count; i++) {
+        if (transforms[i]->dirty) {
+            dirty.push_back(transforms[i]);
+        }
+    }
+    if (dirty.empty()) {
+        return 0;
+    }
+
+    // pitch, yaw, roll per transform, packed so the trig is one flat loop
+    angles.resize(dirty.size() * 3);
+    for (size_t i = 0; i < dirty.size(); i++) {
+        angles[i * 3] = dirty[i]->pitch;
+        angles[i * 3 + 1] = dirty[i]->yaw;
+        angles[i * 3 + 2] = dirty[i]->roll;
+    }
+    sines.resize(angles.size());
+    cosines.resize(angles.size());
+    for (size_t i = 0; i < angles.size(); i++) {
+        float radians = angles[i] * TO_RADIANS;
+        sines[i] = std::sin(radians);
+        cosines[i] = std::cos(radians);
+    }
+
+    for (size_t i = 0; i < dirty.size(); i++) {
+        float sp = sines[i * 3], cp = cosines[i * 3];
+        float sy = sines[i * 3 + 1], cy = cosines[i * 3 + 1];
+        float sr = sines[i * 3 + 2], cr = cosines[i * 3 + 2];
+        glm::mat3 rotation = rotationFromTrig(sp, cp, sy, cy, sr, cr);
+
+        Transform& transform = *dirty[i];
+        transform.normal = rotation;
+        transform.world[0] = glm::vec4(rotation[0], 0.0f);
+        transform.world[1] = glm::vec4(rotation[1], 0.0f);
+        transform.world[2] = glm::vec4(rotation[2], 0.0f);
+        transform.world[3] = glm::vec4(transform.position, 1.0f);
+        transform.dirty = false;
+    }
+    return dirty.size();
+}
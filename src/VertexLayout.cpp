@@ -0,0 +1,144 @@
+#include "VertexLayout.h"
+#include "Mesh.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+
+namespace {
+// A quarter texel of a 1024 texture; uvs that round-trip through half
+// precision closer than this are stored as halves.
+const float HALF_UV_TOLERANCE = 1.0f / 4096.0f;
+
+bool fitsHalf(float value)
+{
+    return std::abs(glm::unpackHalf1x16(glm::packHalf1x16(value)) - value) <= HALF_UV_TOLERANCE;
+}
+
+void putHalves(unsigned char* out, float x, float y, float z, float w)
+{
+    const uint16_t halves[4] = { glm::packHalf1x16(x), glm::packHalf1x16(y), glm::packHalf1x16(z), glm::packHalf1x16(w) };
+    memcpy(out, halves, sizeof(halves));
+}
+}
+
+const char* vertexLayoutName(VertexLayout layout)
+{
+    switch (layout) {
+    case VertexLayout::NormalMapped:
+        return "normal-mapped";
+    case VertexLayout::Skinned:
+        return "skinned";
+    default:
+        return "static-lit";
+    }
+}
+
+VertexFormat chooseVertexFormat(const std::vector<vertex>& vertices, const std::vector<texture>& textures)
+{
+    bool skinned = false;
+    bool tangents = false;
+    bool halfTexCoords = true;
+    for (const auto& v : vertices) {
+        skinned = skinned || v.weights[0] + v.weights[1] + v.weights[2] + v.weights[3] > 0.0f;
+        tangents = tangents || v.tangent != glm::vec3(0.0f);
+        halfTexCoords = halfTexCoords && fitsHalf(v.textureCoordinates.x) && fitsHalf(v.textureCoordinates.y);
+    }
+    bool normalMap = std::any_of(textures.begin(), textures.end(), [](const texture& t) { return t.type == "texture_normal"; });
+
+    VertexFormat format;
+    format.layout = skinned ? VertexLayout::Skinned : (normalMap && tangents ? VertexLayout::NormalMapped : VertexLayout::StaticLit);
+    format.halfTexCoords = halfTexCoords;
+
+    // Locations match the full layout so shaders do not care which one they get.
+    unsigned int offset = 0;
+    format.attributes.push_back({ 0, 3, GL_FLOAT, false, false, offset });
+    offset += 3 * sizeof(float);
+    // the fourth half is padding so the next attribute stays 4-byte aligned
+    format.attributes.push_back({ 1, 3, GL_HALF_FLOAT, false, false, offset });
+    offset += 4 * sizeof(uint16_t);
+    if (halfTexCoords) {
+        format.attributes.push_back({ 2, 2, GL_HALF_FLOAT, false, false, offset });
+        offset += 2 * sizeof(uint16_t);
+    } else {
+        format.attributes.push_back({ 2, 2, GL_FLOAT, false, false, offset });
+        offset += 2 * sizeof(float);
+    }
+    if (format.layout != VertexLayout::StaticLit) {
+        format.attributes.push_back({ 3, 4, GL_HALF_FLOAT, false, false, offset });
+        offset += 4 * sizeof(uint16_t);
+    }
+    if (format.layout == VertexLayout::Skinned) {
+        format.attributes.push_back({ 5, 4, GL_UNSIGNED_SHORT, false, true, offset });
+        offset += 4 * sizeof(uint16_t);
+        format.attributes.push_back({ 6, 4, GL_UNSIGNED_SHORT, true, false, offset });
+        offset += 4 * sizeof(uint16_t);
+    }
+    format.stride = offset;
+    return format;
+}
+
+std::vector<unsigned char> packVertices(const std::vector<vertex>& vertices, const VertexFormat& format)
+{
+    std::vector<unsigned char> packed(vertices.size() * format.stride);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const vertex& v = vertices[i];
+        unsigned char* out = &packed[i * format.stride];
+        for (const auto& attribute : format.attributes) {
+            unsigned char* field = out + attribute.offset;
+            switch (attribute.location) {
+            case 0:
+                memcpy(field, &v.position, sizeof(v.position));
+                break;
+            case 1:
+                putHalves(field, v.normal.x, v.normal.y, v.normal.z, 0.0f);
+                break;
+            case 2:
+                if (attribute.type == GL_HALF_FLOAT) {
+                    const uint16_t uv[2] = { glm::packHalf1x16(v.textureCoordinates.x), glm::packHalf1x16(v.textureCoordinates.y) };
+                    memcpy(field, uv, sizeof(uv));
+                } else {
+                    memcpy(field, &v.textureCoordinates, sizeof(v.textureCoordinates));
+                }
+                break;
+            case 3: {
+                // the shader rebuilds the bitangent as cross(normal, tangent) * w
+                float handedness = glm::dot(glm::cross(v.normal, v.tangent), v.bitangent) < 0.0f ? -1.0f : 1.0f;
+                putHalves(field, v.tangent.x, v.tangent.y, v.tangent.z, handedness);
+                break;
+            }
+            case 5: {
+                uint16_t ids[4];
+                for (int b = 0; b < 4; b++) {
+                    ids[b] = (uint16_t)std::clamp(v.boneid[b], 0, 65535);
+                }
+                memcpy(field, ids, sizeof(ids));
+                break;
+            }
+            case 6: {
+                uint16_t weights[4];
+                for (int b = 0; b < 4; b++) {
+                    weights[b] = (uint16_t)(std::clamp(v.weights[b], 0.0f, 1.0f) * 65535.0f + 0.5f);
+                }
+                memcpy(field, weights, sizeof(weights));
+                break;
+            }
+            }
+        }
+    }
+    return packed;
+}
+
+void bindVertexFormat(const VertexFormat& format)
+{
+    for (const auto& attribute : format.attributes) {
+        glEnableVertexAttribArray(attribute.location);
+        if (attribute.integer) {
+            glVertexAttribIPointer(attribute.location, attribute.components, attribute.type, format.stride,
+                (void*)(size_t)attribute.offset);
+        } else {
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.type,
+                attribute.normalized ? GL_TRUE : GL_FALSE, format.stride, (void*)(size_t)attribute.offset);
+        }
+    }
+}
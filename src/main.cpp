@@ -2,20 +2,33 @@
 #include "../imgui/backends/imgui_impl_opengl3.h"
 #include "Camera.h"
 #include "CameraHolder.h"
+#include "ClusteredLights.h"
 #include "Cube.h"
+#include "Frustum.h"
 #include "GL/glew.h"
 #include "GLFW/glfw3.h"
 #include "Instance.h"
 #include "Model.h"
+#include "ModelLoader.h"
+#include "Particles.h"
 #include "Physics.h"
 #include "PlayerState.h"
 #include "Renderer.h"
 #include "Terrain.h"
 #include "imgui.h"
+#include "utils/GLHandle.h"
+#include "utils/JobSystem.h"
+#include "utils/Random.h"
 #include "utils/Spline.h"
+#include "utils/TextureCache.h"
 #include <glm/ext/matrix_clip_space.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <future>
 #include <iostream>
 
 #define GLM_ENABLE_EXPERIMENTAL
@@ -262,7 +275,366 @@ void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
     }
 }
 
-int main() {
+// Bullets that hit the ground dig a small dent in it.
+const float BULLET_CRATER_RADIUS = 2.5f;
+const float BULLET_CRATER_DEPTH = 0.4f;
+
+// Mean life of a rain drop; the emitter keeps rate * life drops falling.
+const float RAIN_LIFE = 2.75f;
+
+void configureRain(ParticleSystem &rain) {
+    rain.forces.wind = glm::vec3(3.0f, 0.0f, 1.0f);
+    rain.forces.drag = 0.5f;
+    rain.look.colour = glm::vec4(0.7f, 0.75f, 0.85f, 0.35f);
+    rain.look.size = 0.02f;
+    // the tail trails up and against the wind
+    rain.look.streak = glm::vec3(-0.09f, 0.6f, -0.03f);
+    rain.look.fade = 0.1f;
+    ParticleEmitter layer;
+    layer.extent = glm::vec3(120.0f, 0.0f, 120.0f);
+    layer.velocity = glm::vec3(3.0f, -20.0f, 1.0f);
+    layer.velocityJitter = glm::vec3(0.5f, 2.0f, 0.5f);
+    layer.minLife = RAIN_LIFE - 0.25f;
+    layer.maxLife = RAIN_LIFE + 0.25f;
+    rain.emitters.push_back(layer);
+}
+
+// Keeps the rain layer over the eye, dropping about drops at a time.
+void followRain(ParticleSystem &rain, const glm::vec3 &eye, int drops) {
+    rain.emitters[0].position = eye + glm::vec3(0.0f, 40.0f, 0.0f);
+    rain.emitters[0].rate = static_cast<float>(drops) / RAIN_LIFE;
+    rain.forces.killBelow = eye.y - 30.0f;
+}
+
+// Fills the whole column under the layer at once, instead of waiting a
+// drop's life for the first ones to land.
+void prewarmRain(ParticleSystem &rain, int drops) {
+    ParticleEmitter column = rain.emitters[0];
+    column.position.y -= 30.0f;
+    column.extent.y = 30.0f;
+    column.minLife = 0.0f;
+    rain.emit(column, static_cast<size_t>(drops));
+}
+
+// Times the rain simulation on its own, with no window or context:
+// spooky --particle-benchmark [drops]
+int runParticleBenchmark(int drops) {
+    ParticleSystem rain(static_cast<size_t>(drops) + drops / 8);
+    configureRain(rain);
+    followRain(rain, glm::vec3(0.0f), drops);
+    prewarmRain(rain, drops);
+    const int frames = 600;
+    double total = 0.0;
+    double alive = 0.0;
+    float worst = 0.0f;
+    for (int frame = 0; frame < frames; frame++) {
+        rain.update(1.0f / 60.0f);
+        total += rain.stats().milliseconds;
+        worst = std::max(worst, rain.stats().milliseconds);
+        alive += static_cast<double>(rain.size());
+    }
+    std::cout << "Rain: " << drops << " drops requested, " << static_cast<size_t>(alive / frames)
+              << " alive on average, " << jobs().workerCount() + 1 << " threads" << std::endl;
+    std::cout << "Update: " << total / frames << " ms mean, " << worst << " ms worst over " << frames
+              << " frames" << std::endl;
+    return 0;
+}
+
+// Times bullet-sized craters on a big map: the height and pyramid edits,
+// then applyEdits rebuilding and uploading the dirty rectangles. Needs a GL
+// context, so it opens a hidden window; the map is generated, not cached.
+// spooky --terrain-benchmark [size]
+int runTerrainBenchmark(int size) {
+    if (!glfwInit())
+        return 1;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "Spooky House", nullptr, nullptr);
+    if (window == nullptr)
+        return 1;
+    glfwMakeContextCurrent(window);
+    if (glewInit() != GLEW_OK)
+        return 1;
+    {
+        TerrainParams generator;
+        generator.size = size;
+        // the edits are what is timed; fewer faults keep generation short
+        generator.iterations = 32;
+        auto start = std::chrono::steady_clock::now();
+        Terrain map(1, {}, 5.0f, generator, false);
+        std::cout << "Terrain: " << size << "x" << size << " generated in "
+                  << std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count() << " s"
+                  << std::endl;
+
+        rng::Stream stream = rng::stream(rng::Subsystem::Physics);
+        const int frames = 600;
+        const int cratersPerFrame = 8;
+        double editTotal = 0.0;
+        double applyTotal = 0.0;
+        double frameTotal = 0.0;
+        float worst = 0.0f;
+        size_t uploads = 0;
+        size_t vertices = 0;
+        for (int frame = 0; frame < frames; frame++) {
+            auto frameStart = std::chrono::steady_clock::now();
+            for (int i = 0; i < cratersPerFrame; i++) {
+                map.crater(stream.range(8.0f, size - 8.0f), stream.range(8.0f, size - 8.0f), BULLET_CRATER_RADIUS,
+                           BULLET_CRATER_DEPTH);
+            }
+            auto editEnd = std::chrono::steady_clock::now();
+            map.applyEdits();
+            // count the upload itself, not just handing it to the driver
+            glFinish();
+            auto frameEnd = std::chrono::steady_clock::now();
+            float milliseconds = std::chrono::duration<float, std::milli>(frameEnd - frameStart).count();
+            editTotal += std::chrono::duration<double, std::milli>(editEnd - frameStart).count();
+            applyTotal += map.editStats.milliseconds;
+            frameTotal += milliseconds;
+            worst = std::max(worst, milliseconds);
+            uploads += map.editStats.uploads;
+            vertices += map.editStats.vertices;
+        }
+        std::cout << cratersPerFrame << " craters a frame, " << uploads / frames << " uploads and "
+                  << vertices / frames << " vertices rebuilt a frame, " << jobs().workerCount() + 1 << " threads"
+                  << std::endl;
+        std::cout << "Edits: " << editTotal / frames << " ms, applyEdits: " << applyTotal / frames
+                  << " ms, with the upload finished: " << frameTotal / frames << " ms mean, " << worst
+                  << " ms worst over " << frames << " frames" << std::endl;
+    }
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
+
+// Times every model under directory both ways: a full Assimp import with
+// mesh optimisation and LODs, then loads of the baked copy (made first if
+// it is missing). Headless.
+// spooky --model-benchmark [directory]
+int runModelBenchmark(const std::string &directory) {
+    std::vector<std::string> paths;
+    std::error_code error;
+    for (auto it = std::filesystem::recursive_directory_iterator(directory, error);
+         it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+        if (it->path().extension() == ".obj")
+            paths.push_back(it->path().generic_string());
+    }
+    if (paths.empty()) {
+        std::cerr << "No .obj files under " << directory << std::endl;
+        return 1;
+    }
+    std::sort(paths.begin(), paths.end());
+    const int loads = 5;
+    double importTotal = 0.0;
+    double cacheTotal = 0.0;
+    int measured = 0;
+    for (const auto &path: paths) {
+        ModelData imported = Model::parse(path, false);
+        if (!imported.loaded)
+            continue;
+        Model::parse(path);
+        double cached = 0.0;
+        bool fromCache = true;
+        for (int i = 0; i < loads; i++) {
+            ModelData data = Model::parse(path);
+            cached += data.parseMilliseconds;
+            fromCache = fromCache && data.fromCache;
+        }
+        cached /= loads;
+        importTotal += imported.parseMilliseconds;
+        cacheTotal += cached;
+        measured++;
+        std::cout << path << ": import " << imported.parseMilliseconds << " ms, "
+                  << (fromCache ? "cache " : "no cache, parse ") << cached << " ms" << std::endl;
+    }
+    std::cout << measured << " models: import " << importTotal << " ms, cache " << cacheTotal << " ms ("
+              << (cacheTotal > 0.0 ? importTotal / cacheTotal : 0.0) << "x)" << std::endl;
+    return 0;
+}
+
+// Times cullBoxes on boxes scattered around a turning camera, and checks
+// every box against Frustum::intersects. The two add in different orders, so
+// a box exactly on a plane may go either way; only disagreements away from
+// the planes fail. Headless.
+// spooky --cull-benchmark [boxes]
+int runCullBenchmark(int count) {
+    rng::Stream stream = rng::stream(rng::Subsystem::Trees);
+    BoxList boxes;
+    boxes.reserve(static_cast<size_t>(count));
+    for (int i = 0; i < count; i++) {
+        boxes.add(glm::vec3(stream.range(-500.0f, 500.0f), stream.range(-20.0f, 60.0f), stream.range(-500.0f, 500.0f)),
+                  glm::vec3(stream.range(0.5f, 8.0f), stream.range(0.5f, 8.0f), stream.range(0.5f, 8.0f)));
+    }
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    const glm::vec3 eye(0.0f, 10.0f, 0.0f);
+    const int frames = 600;
+    std::vector<uint8_t> visible;
+    double total = 0.0;
+    float worst = 0.0f;
+    size_t inside = 0;
+    size_t onPlane = 0;
+    size_t wrong = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        float yaw = glm::radians(frame * 0.6f);
+        glm::vec3 forward(std::cos(yaw), -0.1f, std::sin(yaw));
+        Frustum frustum = Frustum::fromMatrix(projection * glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+        auto start = std::chrono::steady_clock::now();
+        inside += cullBoxes(frustum, boxes, visible);
+        float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        total += milliseconds;
+        worst = std::max(worst, milliseconds);
+
+        for (size_t i = 0; i < boxes.size(); i++) {
+            glm::vec3 centre(boxes.centreX[i], boxes.centreY[i], boxes.centreZ[i]);
+            glm::vec3 extent(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+            if ((visible[i] != 0) == frustum.intersects(centre, extent))
+                continue;
+            bool nearPlane = false;
+            for (const auto &plane: frustum.planes) {
+                float margin = glm::dot(glm::vec3(plane), centre) + plane.w + glm::dot(glm::abs(glm::vec3(plane)), extent);
+                nearPlane = nearPlane || std::abs(margin) < 1e-3f;
+            }
+            if (nearPlane)
+                onPlane++;
+            else
+                wrong++;
+        }
+    }
+    std::cout << "Cull: " << count << " boxes, " << inside / frames << " visible on average" << std::endl;
+    std::cout << "cullBoxes: " << total / frames << " ms mean, " << worst << " ms worst over " << frames
+              << " frames" << std::endl;
+    std::cout << "Against Frustum::intersects: " << wrong << " disagreements, " << onPlane
+              << " more on a plane" << std::endl;
+    return wrong == 0 ? 0 : 1;
+}
+
+// Times ClusterBinner::bin with lights scattered in front of a turning
+// camera. Every 30th frame it also samples points in the view and checks
+// that each light whose sphere holds a point is in that point's cluster,
+// found the way modelLoading.frag.glsl finds it. Headless.
+// spooky --cluster-benchmark [lights]
+int runClusterBenchmark(int count) {
+    rng::Stream stream = rng::stream(rng::Subsystem::Lights);
+    std::vector<PointLight> lights(static_cast<size_t>(count));
+    for (auto &light: lights) {
+        light.position = glm::vec3(stream.range(-250.0f, 250.0f), stream.range(0.0f, 40.0f),
+                                   stream.range(-250.0f, 250.0f));
+        light.colour = glm::vec3(stream.range(0.2f, 1.0f), stream.range(0.2f, 1.0f), stream.range(0.2f, 1.0f));
+        light.ambient = 0.0f;
+        light.diffuse = 1.0f;
+        light.specular = 0.5f;
+        // the ghosts' falloff, spread so the radii run from about 15 to 50
+        light.linear = 0.35f;
+        light.quadratic = stream.range(0.1f, 1.0f);
+    }
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    CameraLens lens = lensFromProjection(projection);
+    const glm::vec3 eye(0.0f, 10.0f, 0.0f);
+    const int frames = 600;
+    const int checkEvery = 30;
+    const int samples = 4096;
+    ClusterBinner clusters;
+    double total = 0.0;
+    float worst = 0.0f;
+    size_t binned = 0;
+    size_t indices = 0;
+    size_t dropped = 0;
+    size_t checked = 0;
+    size_t missing = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        float yaw = glm::radians(frame * 0.6f);
+        glm::vec3 forward(std::cos(yaw), -0.1f, std::sin(yaw));
+        glm::mat4 view = glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+        clusters.bin(view, lens, lights.data(), lights.size());
+        const ClusterStats &stats = clusters.stats();
+        total += stats.milliseconds;
+        worst = std::max(worst, stats.milliseconds);
+        binned += stats.lightsBinned;
+        indices += stats.indices;
+        dropped += stats.dropped;
+        if (frame % checkEvery != 0)
+            continue;
+
+        std::vector<glm::vec3> centres;
+        for (const auto &light: lights)
+            centres.emplace_back(view * glm::vec4(light.position, 1.0f));
+        const auto &ranges = clusters.ranges();
+        const auto &list = clusters.indices();
+        for (int sample = 0; sample < samples; sample++) {
+            float x = stream.range(-1.0f, 1.0f);
+            float y = stream.range(-1.0f, 1.0f);
+            float depth = stream.range(lens.nearPlane, CLUSTER_FAR);
+            glm::vec3 point(x * lens.tanHalfFovY * lens.aspect * depth, y * lens.tanHalfFovY * depth, -depth);
+            int tileX = std::clamp(static_cast<int>((x + 1.0f) * 0.5f * CLUSTER_X), 0, CLUSTER_X - 1);
+            int tileY = std::clamp(static_cast<int>((y + 1.0f) * 0.5f * CLUSTER_Y), 0, CLUSTER_Y - 1);
+            int cluster = (clusterSlice(depth) * CLUSTER_Y + tileY) * CLUSTER_X + tileX;
+            uint32_t first = ranges[cluster * 2];
+            uint32_t last = first + ranges[cluster * 2 + 1];
+            for (size_t i = 0; i < lights.size(); i++) {
+                // a hair inside the sphere, so rounding on its surface does not count
+                if (glm::length(point - centres[i]) >= lightRadius(lights[i]) * 0.999f)
+                    continue;
+                checked++;
+                if (std::find(list.begin() + first, list.begin() + last, static_cast<uint16_t>(i)) ==
+                    list.begin() + last)
+                    missing++;
+            }
+        }
+    }
+    std::cout << "Clusters: " << count << " lights, " << binned / frames << " in the grid and " << indices / frames
+              << " indices a frame on average, " << dropped << " dropped" << std::endl;
+    std::cout << "bin: " << total / frames << " ms mean, " << worst << " ms worst over " << frames << " frames"
+              << std::endl;
+    std::cout << "Sampled: " << checked << " lit points, " << missing << " missing a light that reaches them"
+              << std::endl;
+    return missing == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    if (const char *seed = std::getenv("SPOOKY_SEED"))
+        rng::setSeed(std::strtoull(seed, nullptr, 10));
+    if (argc > 1 && std::string(argv[1]) == "--particle-benchmark")
+        return runParticleBenchmark(argc > 2 ? std::atoi(argv[2]) : 1000000);
+    if (argc > 1 && std::string(argv[1]) == "--terrain-benchmark")
+        return runTerrainBenchmark(argc > 2 ? std::atoi(argv[2]) : 4096);
+    if (argc > 1 && std::string(argv[1]) == "--model-benchmark")
+        return runModelBenchmark(argc > 2 ? argv[2] : "../assets");
+    if (argc > 1 && std::string(argv[1]) == "--cull-benchmark")
+        return runCullBenchmark(argc > 2 ? std::atoi(argv[2]) : 100000);
+    if (argc > 1 && std::string(argv[1]) == "--cluster-benchmark") {
+        if (argc > 2)
+            return runClusterBenchmark(std::atoi(argv[2]));
+        return runClusterBenchmark(256) | runClusterBenchmark(1024);
+    }
+    // Start parsing every model straight away; window, shader and terrain
+    // set-up overlap with it and each model is only waited for where it is
+    // first needed. The parses get their own half of the cores so jobs() stays
+    // free for the terrain tiles and, later, the per-frame work.
+    JobSystem parseJobs(std::max(1u, std::thread::hardware_concurrency() / 2));
+    ModelLoader loader(parseJobs);
+    auto treeOneModel = loader.request("../assets/tree/treeOne.obj");
+    auto treeTwoModel = loader.request("../assets/tree/treeTwo.obj");
+    auto treeThreeModel = loader.request("../assets/tree/treeThree.obj");
+    auto treeFourModel = loader.request("../assets/tree/treeFour.obj");
+    auto treeFiveModel = loader.request("../assets/tree/treeFive.obj");
+    auto treeSixModel = loader.request("../assets/tree/treeSix.obj");
+    auto leftModel = loader.request("../assets/player/nleft.obj");
+    auto rightModel = loader.request("../assets/player/nright.obj");
+    auto torchModel = loader.request("../assets/player/torch.obj");
+    auto headyModel = loader.request("../assets/Enemy/heady.obj");
+    auto heady2Model = loader.request("../assets/Enemy/heady2.obj");
+    auto slideyModel = loader.request("../assets/Enemy/slidey.obj");
+    auto gunModel = loader.request("../assets/player/pistolbut.obj");
+    auto scopeModel = loader.request("../assets/player/pistolscope.obj");
+    auto platformModel = loader.request("../assets/house/plane.obj");
+    auto houseModel = loader.request("../assets/house/hh.obj");
+    auto lampOneModel = loader.request("../assets/lamps/lampOne.obj");
+    auto lampTwoModel = loader.request("../assets/lamps/lampTwo.obj");
+    auto lampThreeModel = loader.request("../assets/lamps/lampThree.obj");
+    auto ladderModel = loader.request("../assets/house/ladder.obj");
+    auto trackModel = loader.request("../assets/track/track.obj");
+    auto cartModel = loader.request("../assets/cart/cart.obj");
     if (!glfwInit())
         return 1;
     const char *glsl_version = "#version 330";
@@ -298,6 +670,29 @@ int main() {
     ImGui::StyleColorsDark();
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init(glsl_version);
+    // Declared before anything that owns GL objects, so it runs after all of
+    // them are destroyed: drops what the globals still hold, checks nothing
+    // leaked, and only then tears the context down.
+    struct Shutdown {
+        GLFWwindow *window;
+        ~Shutdown() {
+            world = physics::PhysicsWorld();
+            player = PlayerState();
+            terrain.reset();
+            GLObjectStats live = glObjectStats();
+            int textures = textureCache().stats().live;
+            if (live.total() > 0 || textures > 0)
+                std::cerr << "Leaked GL objects: " << live.buffers << " buffers, " << live.vertexArrays
+                          << " vertex arrays, " << textures << " textures" << std::endl;
+            else
+                std::cout << "All GL objects released" << std::endl;
+            ImGui_ImplOpenGL3_Shutdown();
+            ImGui_ImplGlfw_Shutdown();
+            ImGui::DestroyContext();
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
+    } shutdown{window};
     glEnable(GL_DEPTH_TEST);
     auto fly = std::make_shared<Camera>(567);
     auto fps = std::make_shared<Camera>(566, true);
@@ -309,27 +704,8 @@ int main() {
     Shader shader("../src/modelLoading.vert.glsl", "../src/modelLoading.frag.glsl");
     Shader depth("../src/depthShader.vert.glsl", "../src/depthShader.frag.glsl");
     Shader basic("../src/basic.vert.glsl", "../src/basic.frag.glsl");
-    auto treeOne = std::make_shared<Model>("../assets/tree/treeOne.obj", glm::mat4(1.0f), glm::vec3(0.0), 202, 0.0,
-                                           9166, 0.0, 0.0);
-    auto treeTwo = std::make_shared<Model>("../assets/tree/treeTwo.obj", glm::mat4(1.0f), glm::vec3(0.0), 203, 0.0,
-                                           9166, 0.0, 0.0);
-    auto treeThree = std::make_shared<Model>("../assets/tree/treeThree.obj", glm::mat4(1.0f), glm::vec3(0.0), 204, 0.0,
-                                             9166, 0.0, 0.0);
-    auto treeFour = std::make_shared<Model>("../assets/tree/treeFour.obj", glm::mat4(1.0f), glm::vec3(0.0), 205, 0.0,
-                                            9166, 0.0, 0.0);
-    auto treeFive = std::make_shared<Model>("../assets/tree/treeFive.obj", glm::mat4(1.0f), glm::vec3(0.0), 206, 0.0,
-                                            9166, 0.0, 0.0);
-    auto treeSix = std::make_shared<Model>("../assets/tree/treeSix.obj", glm::mat4(1.0f), glm::vec3(0.0), 207, 0.0,
-                                           9166, 0.0, 0.0);
-    auto left = std::make_shared<Model>("../assets/player/nleft.obj", glm::mat4(1.0f), glm::vec3(0.0), 5, 0.0, 10.0,
-                                        0.0);
-    auto right = std::make_shared<Model>("../assets/player/nright.obj", glm::mat4(1.0f), glm::vec3(0.0), 6, 0.0, 10.0,
-                                         0.0);
-
-    auto torch = std::make_shared<Model>("../assets/player/torch.obj", glm::mat4(1.0f), glm::vec3(0.0), 5, 0.0, 0.0,
-                                         0.0);
-    std::vector<std::vector<glm::mat4> > translations{5};
-    world = physics::PhysicsWorld();
+    Shader particleShader("../src/particle.vert.glsl", "../src/particle.frag.glsl");
+    // Terrain tiles run on jobs() while parseJobs is still busy with the models.
     Terrain ter{
         1,
         {
@@ -339,55 +715,84 @@ int main() {
         5.0f
     };
     terrain = std::make_shared<Terrain>(ter);
-    auto heady = std::make_shared<Model>("../assets/Enemy/heady.obj", glm::mat4(1.0f),
-                                       glm::vec3(12, -terrain->GetHeightInterpolated(10, 10) + 1.0f, 12), 4100, 412, 0.0,
-                                       0.0, 0.0);
-
-    auto heady2 = std::make_shared<Model>("../assets/Enemy/heady2.obj", glm::mat4(1.0f),
-                                       glm::vec3(15, -terrain->GetHeightInterpolated(10, 10) + 1.0f, 15), 200, 413, 0.0,
-                                       0.0, 0.0);
-    auto slidey = std::make_shared<Model>("../assets/Enemy/slidey.obj", glm::mat4(1.0f),
-                                       camera->position, 414, 0.0,
-                                       0.0, 0.0);
-    auto gun = std::make_shared<Model>("../assets/player/pistolbut.obj", glm::mat4(1.0f),
-                                       glm::vec3(10, -terrain->GetHeightInterpolated(10, 10) + 1.0f, 10), 1, 0.0,
-                                       0.0, 0.0);
-    auto scope = std::make_shared<Model>("../assets/player/pistolscope.obj", glm::mat4(1.0f),
-                                         glm::vec3(10, -terrain->GetHeightInterpolated(375, 109) + 1.0f, 109), 10, 0.0,
-                                         0.0, 0.0);
-    auto platform = std::make_shared<Model>("../assets/house/plane.obj", glm::mat4(1.0f),
-                                            glm::vec3(300.0, (-terrain->GetHeightInterpolated(250.0, 200.0) + 60.0f),
-                                                      300),
-                                            101, 0, 0, 0.0);
-
-    auto house = std::make_shared<Model>("../assets/house/hh.obj", glm::mat4(1.0f),
-                                         glm::vec3(300.0, platform->position.y + 50.0f, 234),
-                                         60, 90, 90, 0.0);
-    auto lampOne = std::make_shared<Model>("../assets/lamps/lampOne.obj", glm::mat4(1.0f),
-                                           glm::vec3(416.0f, platform->position.y - 7.0f, 100.0f), 301, 0.0, 0.0,
-                                           0.0);
-    auto lampTwo = std::make_shared<Model>("../assets/lamps/lampTwo.obj", glm::mat4(1.0f),
-                                           glm::vec3(174.0f, platform->position.y - 7.0f, 324.0f), 302, 0.0, 0.0,
-                                           0.0);
-    auto lampThree = std::make_shared<Model>("../assets/lamps/lampThree.obj", glm::mat4(1.0f),
-                                             glm::vec3(217.0f, platform->position.y - 7.0f, 88.0f), 303, 0.0,
-                                             0.0, 0.0);
-
-    auto ladder = std::make_shared<Model>("../assets/house/ladder.obj", glm::mat4(1.0f),
-                                          glm::vec3(156, platform->position.y - 10.0f, 203), 65,
-                                          0.0, 90, 0.0f);
+    auto treeOne = loader.create(treeOneModel, glm::mat4(1.0f), glm::vec3(0.0), 202, 0.0,
+                                 9166, 0.0, 0.0);
+    auto treeTwo = loader.create(treeTwoModel, glm::mat4(1.0f), glm::vec3(0.0), 203, 0.0,
+                                 9166, 0.0, 0.0);
+    auto treeThree = loader.create(treeThreeModel, glm::mat4(1.0f), glm::vec3(0.0), 204, 0.0,
+                                   9166, 0.0, 0.0);
+    auto treeFour = loader.create(treeFourModel, glm::mat4(1.0f), glm::vec3(0.0), 205, 0.0,
+                                  9166, 0.0, 0.0);
+    auto treeFive = loader.create(treeFiveModel, glm::mat4(1.0f), glm::vec3(0.0), 206, 0.0,
+                                  9166, 0.0, 0.0);
+    auto treeSix = loader.create(treeSixModel, glm::mat4(1.0f), glm::vec3(0.0), 207, 0.0,
+                                 9166, 0.0, 0.0);
+    auto left = loader.create(leftModel, glm::mat4(1.0f), glm::vec3(0.0), 5, 0.0, 10.0,
+                              0.0);
+    auto right = loader.create(rightModel, glm::mat4(1.0f), glm::vec3(0.0), 6, 0.0, 10.0,
+                               0.0);
+
+    auto torch = loader.create(torchModel, glm::mat4(1.0f), glm::vec3(0.0), 5, 0.0, 0.0,
+                               0.0);
+    std::vector<std::vector<glm::mat4> > translations{5};
+    world = physics::PhysicsWorld();
+    auto heady = loader.create(headyModel, glm::mat4(1.0f),
+                               glm::vec3(12, -terrain->GetHeightInterpolated(10, 10) + 1.0f, 12), 4100, 412, 0.0,
+                               0.0, 0.0);
+
+    auto heady2 = loader.create(heady2Model, glm::mat4(1.0f),
+                                glm::vec3(15, -terrain->GetHeightInterpolated(10, 10) + 1.0f, 15), 200, 413, 0.0,
+                                0.0, 0.0);
+    auto slidey = loader.create(slideyModel, glm::mat4(1.0f),
+                                camera->position, 414, 0.0,
+                                0.0, 0.0);
+    auto gun = loader.create(gunModel, glm::mat4(1.0f),
+                             glm::vec3(10, -terrain->GetHeightInterpolated(10, 10) + 1.0f, 10), 1, 0.0,
+                             0.0, 0.0);
+    auto scope = loader.create(scopeModel, glm::mat4(1.0f),
+                               glm::vec3(10, -terrain->GetHeightInterpolated(375, 109) + 1.0f, 109), 10, 0.0,
+                               0.0, 0.0);
+    auto platform = loader.create(platformModel, glm::mat4(1.0f),
+                                  glm::vec3(300.0, (-terrain->GetHeightInterpolated(250.0, 200.0) + 60.0f),
+                                  300),
+                                  101, 0, 0, 0.0);
+
+    auto house = loader.create(houseModel, glm::mat4(1.0f),
+                               glm::vec3(300.0, platform->position.y + 50.0f, 234),
+                               60, 90, 90, 0.0);
+    auto lampOne = loader.create(lampOneModel, glm::mat4(1.0f),
+                                 glm::vec3(416.0f, platform->position.y - 7.0f, 100.0f), 301, 0.0, 0.0,
+                                 0.0);
+    auto lampTwo = loader.create(lampTwoModel, glm::mat4(1.0f),
+                                 glm::vec3(174.0f, platform->position.y - 7.0f, 324.0f), 302, 0.0, 0.0,
+                                 0.0);
+    auto lampThree = loader.create(lampThreeModel, glm::mat4(1.0f),
+                                   glm::vec3(217.0f, platform->position.y - 7.0f, 88.0f), 303, 0.0,
+                                   0.0, 0.0);
+
+    auto ladder = loader.create(ladderModel, glm::mat4(1.0f),
+                                glm::vec3(156, platform->position.y - 10.0f, 203), 65,
+                                0.0, 90, 0.0f);
 
     initMultiTree(amount, 6, 250, 560.0, translations, house->position, *terrain);
-    auto track = std::make_shared<Model>("../assets/track/track.obj", glm::mat4(1.0f),
-                                         glm::vec3(305.2f, house->position.y - 13.0, 177.5f), 111, 3.0, 82.5, -3.0);
-    auto cart = std::make_shared<Model>("../assets/cart/cart.obj", glm::mat4(1.0f),
-                                        glm::vec3(206.98, track->position.y + 10.0f, 127), 3, 0.0, 80.0, 0.0);
+    auto track = loader.create(trackModel, glm::mat4(1.0f),
+                               glm::vec3(305.2f, house->position.y - 13.0, 177.5f), 111, 3.0, 82.5, -3.0);
+    auto cart = loader.create(cartModel, glm::mat4(1.0f),
+                              glm::vec3(206.98, track->position.y + 10.0f, 127), 3, 0.0, 80.0, 0.0);
     treeOne->initInstanced(translations[0].size(), translations[0]);
     treeTwo->initInstanced(translations[1].size(), translations[1]);
     treeThree->initInstanced(translations[2].size(), translations[2]);
     treeFour->initInstanced(translations[3].size(), translations[3]);
     treeFive->initInstanced(translations[4].size(), translations[4]);
     treeSix->initInstanced(translations[5].size(), translations[5]);
+    TextureCacheStats textureStats = textureCache().stats();
+    std::cout << "Textures: " << textureStats.misses << " loaded, " << textureStats.hits << " shared ("
+              << textureStats.hitRate() * 100.0f << "% hit rate, " << textureStats.bytesSaved / 1048576.0
+              << " MB not re-uploaded), " << textureStats.pending << " still decoding" << std::endl;
+    std::cout << "Loaded " << loader.created << " models (" << loader.cacheHits << " baked): " << loader.parseMilliseconds << " ms parsing on workers, "
+              << loader.waitMilliseconds << " ms waited, " << loader.uploadMilliseconds << " ms uploading; vertex buffers "
+              << loader.fullVertexBytes / 1048576.0 << " MB -> " << loader.vertexBytes / 1048576.0 << " MB, "
+              << loader.residentBytes / 1024 << " KB of mesh data left on the CPU" << std::endl;
     world.addEnemy(heady, 20.0f, 10.0f, 9.8f);
 
     world.addEnemy(heady2, 20.0f, 10.0f, 9.8f);
@@ -447,14 +852,67 @@ int main() {
     glBufferData(GL_ARRAY_BUFFER, splinearray.size() * sizeof(glm::vec3), splinearray.data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) nullptr);
+    // scenery that never moves; its shadow depth is cached per cascade
+    for (const auto &model: {house, track, platform, ladder, lampOne, lampTwo, lampThree}) {
+        model->staticShadow = true;
+    }
     Renderer renderer{projection, camera, *terrain};
     renderer.enqueue(shader, {
                            slidey, heady, track, house, cart, left, right, gun, scope, platform, treeOne, treeTwo, treeFour, treeFive,
                          treeSix, lampOne, lampTwo, lampThree, ladder
                      });
     renderer.addLampPointLight(lampOne->position);
-    renderer.addLampPointLight(lampTwo->position);
+    // the second lamp falls off faster than the others
+    renderer.addLampPointLight(lampTwo->position, 0.09f);
     renderer.addLampPointLight(lampThree->position);
+    const size_t lampLights = renderer.pointLights.size();
+    // wandering lights around the house; the debug slider raises this to
+    // load the light clusters
+    int ghostLights = 0;
+
+    int rainDrops = 200000;
+    ParticleSystem rain(1 << 20, 0);
+    configureRain(rain);
+    followRain(rain, camera->position, rainDrops);
+    prewarmRain(rain, rainDrops);
+    // muzzle flashes and bullet impacts, only ever burst
+    ParticleSystem sparks(4096, 1);
+    sparks.look.colour = glm::vec4(1.0f, 0.7f, 0.3f, 1.0f);
+    sparks.look.size = 0.05f;
+    sparks.look.additive = true;
+    ParticleEmitter muzzleFlash;
+    muzzleFlash.extent = glm::vec3(0.05f);
+    muzzleFlash.velocityJitter = glm::vec3(3.0f);
+    muzzleFlash.minLife = 0.05f;
+    muzzleFlash.maxLife = 0.12f;
+    ParticleEmitter impact;
+    impact.extent = glm::vec3(0.1f);
+    impact.velocity = glm::vec3(0.0f, 4.0f, 0.0f);
+    impact.velocityJitter = glm::vec3(4.0f, 3.0f, 4.0f);
+    impact.minLife = 0.3f;
+    impact.maxLife = 0.6f;
+    // pale wisps rising off the ghosts
+    ParticleSystem wisps(2048, 2);
+    wisps.forces.gravity = glm::vec3(0.0f, 0.6f, 0.0f);
+    wisps.forces.drag = 1.0f;
+    wisps.look.colour = glm::vec4(0.6f, 1.0f, 0.8f, 0.25f);
+    wisps.look.size = 0.15f;
+    wisps.look.fade = 0.8f;
+    wisps.look.additive = true;
+    for (int ghost = 0; ghost < 2; ghost++) {
+        ParticleEmitter trail;
+        trail.extent = glm::vec3(0.6f, 1.0f, 0.6f);
+        trail.velocityJitter = glm::vec3(0.3f);
+        trail.minLife = 1.0f;
+        trail.maxLife = 2.0f;
+        trail.rate = 40.0f;
+        wisps.emitters.push_back(trail);
+    }
+    renderer.addParticles(rain);
+    renderer.addParticles(wisps);
+    renderer.addParticles(sparks);
+    // the driver has been compiling these since they were created
+    finishPendingShaders();
     player = {left, right, gun, scope, torch};
     glm::vec3 &lightPos = renderer.lightPos;
     auto lastFrameTime = static_cast<float>(glfwGetTime());
@@ -465,36 +923,31 @@ int main() {
     bool py = false;
     int controlMode = 0;
 
-    // Shadows setup
-    // -----------------------
-    const unsigned int SHADOW_WIDTH = 3000, SHADOW_HEIGHT = 3000;
-    unsigned int depthMapFBO;
-    glGenFramebuffers(1, &depthMapFBO);
-    // create depth texture
-    unsigned int depthMap;
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT,
-                 nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = {1.0f, 1.0f, 1.0f, 1.0f};
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
     int lightningCounter = 1;
     int lightning = 0;
+    // Simulation for the next frame, running while this one is submitted.
+    std::future<void> simulation;
     while (!glfwWindowShouldClose(window)) {
+        // it has to land before input or recording read the world again
+        if (simulation.valid()) {
+            simulation.get();
+        }
         glfwPollEvents();
+        processInput(window, terrain);
+        // finish textures decoded on the workers without stalling the frame
+        textureCache().pumpUploads(2.0f, 16 << 20);
+        pollShaderReloads();
         if (player.isShooting) {
             camera->update();
+            muzzleFlash.position = gun->position + camera->front * 1.5f;
+            muzzleFlash.velocity = camera->front * 15.0f;
+            sparks.emit(muzzleFlash, 16);
             player.isShooting = false;
         }
         camera = cameraHolder.getCam();
         renderer.cam = camera;
+        renderer.viewportWidth = static_cast<float>(width);
+        renderer.viewportHeight = static_cast<float>(height);
         renderer.torchPos = player.torch->position;
         renderer.torch = player.torchOn;
         /*
@@ -511,13 +964,6 @@ int main() {
             renderer.lightningSwitch();
         }
         */
-        glm::mat4 lightView = glm::lookAt(glm::vec3(-10.0f, 100.0f, -10), glm::vec3(0.0f, 0.0f, 0.0f),
-                                          glm::vec3(0.0f, 1.0f, 0.0f));
-
-        float near_plane = 1.0f, far_plane = 100.0f;
-        glm::mat4 lightProjection = glm::ortho(-20.0f, 20.0f, -20.0f, -20.0f, near_plane, far_plane);
-        glm::mat4 lightSpaceMatrix = lightProjection * lightView;
-        renderer.lightSpaceMatrix = lightSpaceMatrix;
         if (player.state == PlayerState::State::FLYING && player.changed) {
             renderer.removeModel(shader.ID, left);
             renderer.removeModel(shader.ID, right);
@@ -565,6 +1011,41 @@ int main() {
                         house->boundingbox->min.z);
             ImGui::Text("house bb max, X: %f Y: %f Z: %f", house->boundingbox->max.x, house->boundingbox->max.y,
                         house->boundingbox->max.z);
+            ImGui::Text("Terrain edits: %d rects, %d uploads, %zu vertices, %f ms", terrain->editStats.rects,
+                        terrain->editStats.uploads, terrain->editStats.vertices, terrain->editStats.milliseconds);
+            TextureCacheStats textureStats = textureCache().stats();
+            ImGui::Text("Textures: %d live, %.1f MB resident, %.1f MB saved, %.0f%% hit rate", textureStats.live,
+                        textureStats.residentBytes / 1048576.0, textureStats.bytesSaved / 1048576.0,
+                        textureStats.hitRate() * 100.0f);
+            ImGui::Text("Texture uploads: %d pending, %d last frame, %f ms", textureStats.pending,
+                        textureStats.lastPumpUploads, textureStats.lastPumpMilliseconds);
+            ImGui::Text("Triangles: %.2fM drawn, %.2fM at full detail", renderer.trianglesDrawn / 1e6,
+                        renderer.trianglesFull / 1e6);
+            ImGui::Text("Culling: %zu/%zu meshes, %zu/%zu tree instances visible, %f ms",
+                        renderer.cullStats.meshesVisible, renderer.cullStats.meshesTested,
+                        renderer.cullStats.instancesVisible, renderer.cullStats.instancesTested,
+                        renderer.cullStats.milliseconds);
+            ImGui::Text("Model matrices rebuilt: %zu", renderer.lastTransformsRebuilt);
+            ImGui::Text("Shadows: %zu/%zu/%zu moving casters, %d cached cascades redrawn",
+                        renderer.shadowStats.dynamicCasters[0], renderer.shadowStats.dynamicCasters[1],
+                        renderer.shadowStats.dynamicCasters[2], renderer.shadowStats.staticRedraws);
+            const StreamStats& streamStats = renderer.streamStats();
+            ImGui::Text("Stream buffer: %.1f KB last frame, %d stalls, %d overflows, %d grows",
+                        streamStats.lastFrameBytes / 1024.0, streamStats.stalls, streamStats.overflows,
+                        streamStats.grows);
+            ImGui::Text("Draws: %d sorted, %d programs, %d materials, %d VAOs, %d texture binds, %d state changes skipped",
+                        renderer.commandStats.draws, renderer.commandStats.programChanges,
+                        renderer.commandStats.materialChanges, renderer.commandStats.vaoChanges,
+                        renderer.commandStats.textureBinds, renderer.commandStats.avoided);
+            const ClusterStats &clusterStats = renderer.clusterStats();
+            ImGui::Text("Point lights: %zu/%zu in view, %zu cluster entries, %zu in the busiest, %zu dropped, %f ms",
+                        clusterStats.lightsBinned, clusterStats.lights, clusterStats.indices,
+                        clusterStats.busiestCluster, clusterStats.dropped, clusterStats.milliseconds);
+            ImGui::SliderInt("Ghost lights", &ghostLights, 0, 1024);
+            ImGui::Text("Particles: %zu rain, %zu sparks, %zu wisps, %f ms", rain.size(), sparks.size(),
+                        wisps.size(), rain.stats().milliseconds + sparks.stats().milliseconds +
+                                      wisps.stats().milliseconds);
+            ImGui::SliderInt("Rain drops", &rainDrops, 0, 1000000);
 
             if (position) {
                 ImGui::Begin("Model Position Controls");
@@ -646,51 +1127,77 @@ int main() {
                 ImGui::Render();
             }
         }
+        renderer.pointLights.resize(lampLights + ghostLights);
+        for (int i = 0; i < ghostLights; i++) {
+            // the same stream every frame, so each ghost keeps its orbit
+            rng::Stream ghostStream = rng::stream(rng::Subsystem::Lights, static_cast<uint64_t>(i));
+            float orbit = ghostStream.range(10.0f, 150.0f);
+            float angle = ghostStream.range(0.0f, 6.2831853f) + ghostStream.range(-0.5f, 0.5f) * currentFrameTime;
+            PointLight &ghost = renderer.pointLights[lampLights + i];
+            ghost.position = house->position + glm::vec3(std::cos(angle) * orbit, ghostStream.range(2.0f, 30.0f),
+                                                         std::sin(angle) * orbit);
+            ghost.colour = glm::vec3(ghostStream.range(0.2f, 0.5f), ghostStream.range(0.7f, 1.0f),
+                                     ghostStream.range(0.6f, 1.0f));
+            ghost.ambient = 0.0f;
+            ghost.diffuse = 1.0f;
+            ghost.specular = 0.5f;
+            ghost.linear = 0.35f;
+            ghost.quadratic = 0.44f;
+        }
+        // the simulation job has finished with the impacts by now
+        for (const auto &point: world.impacts) {
+            impact.position = point;
+            sparks.emit(impact, 24);
+        }
+        world.impacts.clear();
+        for (const auto &point: world.groundImpacts) {
+            terrain->crater(point.x - terrain->terposition.x, point.z - terrain->terposition.z, BULLET_CRATER_RADIUS,
+                            BULLET_CRATER_DEPTH);
+        }
+        world.groundImpacts.clear();
+        followRain(rain, camera->position, rainDrops);
+        wisps.emitters[0].position = slidey->position;
+        wisps.emitters[1].position = heady->position;
+        for (ParticleSystem *system: {&rain, &sparks, &wisps}) {
+            system->update(deltaTime);
+        }
+        terrain->applyEdits();
+        renderer.prepareFrame(depth);
+        glm::mat4 view = renderer.frameView();
+
+        // Everything below only reads what prepareFrame recorded, so the
+        // physics, cart and hands can move on for the next frame meanwhile.
+        simulation = jobs().submit([&cart, &cSpline, dt = deltaTime, time = currentFrameTime] {
+            world.tick(dt, *terrain);
+            if (insideCart) {
+                auto newPos = cSpline.ConstVelocitySplineAtTime(time * 60);
+                auto pitch = calculateYawPitch(cart->position, newPos);
+                cart->position = newPos;
+                cart->pitch = pitch.pitch;
+                cart->yaw = pitch.yaw;
+                world.updateAll(3, cart->position, cart->pitch, cart->yaw, 0.0f);
+                camera->position = cart->position;
+                camera->position.y += 5.0f;
+                world.updatePosition(camera->id, camera->position);
+            }
+            player.tick(dt, camera);
+        });
+
+        renderer.beginSubmit();
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // 1. render depth of scene to texture (from light's perspective)
+        // 1. render depth of scene to the shadow cascades (from light's perspective)
         // --------------------------------------------------------------
 
-        depth.use();
-        depth.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        glActiveTexture(GL_TEXTURE4);
-
         glCullFace(GL_FRONT);
-
         renderer.renderShadowMap(depth);
-        depth.setMat4("model", glm::mat4(1.0f));
-        terrain->renderShadow();
-        if (renderer.torch) {
-            lightView = glm::lookAt(camera->position, glm::vec3(0.0f, 0.0f, 0.0f),
-                                    glm::vec3(0.0f, 1.0f, 0.0f));
-            renderer.renderShadowMap(depth);
-        }
         glCullFace(GL_BACK); //
-        glBindTexture(GL_TEXTURE_2D, depthMap);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glViewport(0, 0, width, height);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         renderer.renderAll();
 
-        world.tick(deltaTime, *terrain);
-        if (insideCart) {
-            auto newPos = cSpline.ConstVelocitySplineAtTime(currentFrameTime * 60);
-            auto pitch = calculateYawPitch(cart->position, newPos);
-            auto pitchDif = cart->pitch - pitch.pitch;
-            auto yawDif = cart->yaw - pitch.yaw;
-            cart->position = newPos;
-            cart->pitch = pitch.pitch;
-            cart->yaw = pitch.yaw;
-            world.updateAll(3, cart->position, cart->pitch, cart->yaw, 0.0f);
-            camera->position = cart->position;
-            camera->position.y += 5.0f;
-            world.updatePosition(camera->id, camera->position);
-        }
         GLenum err;
         while ((err = glGetError()) != GL_NO_ERROR) {
             std::cerr << "OpenGL error: " << err << std::endl;
@@ -704,32 +1211,28 @@ int main() {
 
         terrain->terrainShader.use();
         terrain->terrainShader.setMat4("projection", projection);
-        terrain->terrainShader.setMat4("view", camera->getCameraView());
+        terrain->terrainShader.setMat4("view", view);
         terrain->terrainShader.setMat4("model", glm::translate(glm::mat4(1.0), terrain->terposition));
-        terrain->terrainShader.setInt("shadowMap", 4);
-        renderer.lightingShader(terrain->terrainShader);
+        terrain->terrainShader.setInt("shadowMap", SHADOW_TEXTURE_UNIT);
         terrain->render();
         basic.use();
         basic.setMat4("projection", projection);
-        basic.setMat4("view", camera->getCameraView());
+        basic.setMat4("view", view);
         basic.setMat4("model", glm::mat4(1.0));
         basic.setVec4("color", glm::vec4(1.0, 1.0, 1.0, 1.0));
         glBindVertexArray(splineVAO);
         glDrawArrays(GL_LINE_STRIP, 0, sizeof(splinearray));
         glBindVertexArray(0);
-        processInput(window, terrain);
+        renderer.renderParticles(particleShader);
         if (debug) {
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         }
+        renderer.endSubmit();
         glfwSwapBuffers(window);
-        player.tick(deltaTime, camera);
     }
-
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (simulation.valid()) {
+        simulation.get();
+    }
     return 0;
 }
 
@@ -5,20 +5,11 @@ in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
 } fs_in;
 
 
-struct PointLight {
-    vec3 position;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    float constant;
-    float linear;
-    float quadratic;
-};
-
+// Each float fills the fourth slot of the vec3 before it; Lighting.h
+// mirrors this layout.
 struct DirLight {
     vec3 direction;
     vec3 ambient;
@@ -27,35 +18,53 @@ struct DirLight {
 };
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-  
+    vec3 ambient;
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
-  
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;       
 };
-float ShadowCalculation(vec4 fragPosLightSpace);
+// uploaded once a frame, shared with every lit program
+layout(std140) uniform Lighting {
+    DirLight dirLight;
+    SpotLight spotLight;
+    vec3 viewPos;
+    float shininess;
+    vec3 lightPos;
+    bool torch;
+    bool lightning;
+    vec2 clusterScale;
+};
+#define SHADOW_CASCADES 3
+// cascade matrices and far view depths; ShadowCascades.h mirrors this
+layout(std140) uniform Shadows {
+    mat4 cascadeMatrices[SHADOW_CASCADES];
+    vec4 cascadeSplits;
+    vec4 cameraForward;
+};
+// froxel grid; ClusteredLights.h mirrors these
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_NEAR 2.0
+#define CLUSTER_FAR 400.0
+// three texels a light, see ClusterBinner::lightTexels
+uniform samplerBuffer lightData;
+// offset and count of each cluster's run in lightIndices
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer lightIndices;
+float ShadowCalculation(vec3 fragPos);
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcClusteredLights(vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcPointLight(int light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-#define NR_POINT_LIGHTS 3
-uniform sampler2D shadowMap;
-uniform float shininess;
+uniform sampler2DArray shadowMap;
 uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_specular1;
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform bool lightning;
-uniform SpotLight spotLight;
-uniform bool torch;
-
-uniform DirLight dirLight;
 
 void main()
 {
@@ -64,8 +73,7 @@ void main()
     vec3 viewDir = normalize(viewPos - fs_in.FragPos);
     vec3 result = CalcDirLight(dirLight, normal, viewDir);
 
-    for (int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], normal, fs_in.FragPos, viewDir);
+    result += CalcClusteredLights(normal, fs_in.FragPos, viewDir);
     if (torch) {
         result += CalcSpotLight(spotLight, fs_in.Normal, fs_in.FragPos, viewDir);
     }
@@ -74,23 +82,29 @@ void main()
 
 
 
-float ShadowCalculation(vec4 fragPosLightSpace)
+float ShadowCalculation(vec3 fragPos)
 {
+    float viewDepth = dot(fragPos - viewPos, cameraForward.xyz);
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADES && viewDepth > cascadeSplits[cascade])
+        cascade++;
+    if (cascade == SHADOW_CASCADES)
+        return 0.0;
+    vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fragPos, 1.0);
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5;
-    float closestDepth = texture(shadowMap, projCoords.xy).r;
     float currentDepth = projCoords.z;
     vec3 normal = normalize(fs_in.Normal);
-    vec3 lightDir = normalize(lightPos - fs_in.FragPos);
+    vec3 lightDir = normalize(lightPos - fragPos);
     float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
     float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
     const int halfkernelWidth = 3;
     for(int x = -halfkernelWidth; x <= halfkernelWidth; ++x)
     {
         for(int y = -halfkernelWidth; y <= halfkernelWidth; ++y)
         {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
+            float pcfDepth = texture(shadowMap, vec3(projCoords.xy + vec2(x, y) * texelSize, cascade)).r;
             shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.5;
         }
     }
@@ -115,23 +129,46 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 ambient = light.ambient * ambient_scale * vec3(texture(texture_diffuse1, fs_in.TexCoords));
     vec3 diffuse = light.diffuse * diff * vec3(texture(texture_diffuse1, fs_in.TexCoords));
     vec3 specular = light.specular * spec * vec3(texture(texture_specular1, fs_in.TexCoords));
-    float shadow = ShadowCalculation(fs_in.FragPosLightSpace);
+    float shadow = ShadowCalculation(fs_in.FragPos);
     return (ambient + (1.0 - shadow) * (diffuse + specular));
 }
 
 
 
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcClusteredLights(vec3 normal, vec3 fragPos, vec3 viewDir)
 {
-    vec3 lightDir = normalize(light.position - fragPos);
+    float viewDepth = dot(fragPos - viewPos, cameraForward.xyz);
+    int slice = 0;
+    if (viewDepth >= CLUSTER_NEAR)
+        slice = 1 + int(log(viewDepth / CLUSTER_NEAR) * (float(CLUSTER_Z - 1) / log(CLUSTER_FAR / CLUSTER_NEAR)));
+    if (slice >= CLUSTER_Z)
+        return vec3(0.0);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterScale), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    int cluster = (slice * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x;
+    uvec2 range = texelFetch(clusterRanges, cluster).xy;
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; i++)
+        result += CalcPointLight(int(texelFetch(lightIndices, int(range.x + i)).r), normal, fragPos, viewDir);
+    return result;
+}
+
+vec3 CalcPointLight(int light, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec4 positionRadius = texelFetch(lightData, light * 3);
+    vec4 colourLinear = texelFetch(lightData, light * 3 + 1);
+    vec4 terms = texelFetch(lightData, light * 3 + 2);
+    vec3 lightDir = normalize(positionRadius.xyz - fragPos);
     float diff = max(dot(normal, lightDir), 0.0);
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
-    vec3 ambient = light.ambient* vec3(texture(texture_diffuse1, fs_in.TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(texture_diffuse1, fs_in.TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(texture_specular1, fs_in.TexCoords));
+    float distance = length(positionRadius.xyz - fragPos);
+    float attenuation = 1.0 / (1.0 + colourLinear.w * distance + terms.w * (distance * distance));
+    // fades out by the radius the light was binned with
+    float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+    attenuation *= window * window;
+    vec3 ambient = colourLinear.rgb * terms.x * vec3(texture(texture_diffuse1, fs_in.TexCoords));
+    vec3 diffuse = colourLinear.rgb * terms.y * diff * vec3(texture(texture_diffuse1, fs_in.TexCoords));
+    vec3 specular = colourLinear.rgb * terms.z * spec * vec3(texture(texture_specular1, fs_in.TexCoords));
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -0,0 +1,20 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 Corner;
+in float Life;
+
+uniform vec4 colour;
+uniform vec3 streak;
+// seconds of life over which a particle fades out
+uniform float fade;
+
+void main()
+{
+    // round sprites are soft discs, streaks soft along their width
+    float shape = dot(streak, streak) > 0.0 ? 1.0 - abs(Corner.x) : 1.0 - dot(Corner, Corner);
+    if (shape <= 0.0)
+        discard;
+    float alpha = colour.a * shape * clamp(Life / max(fade, 1e-4), 0.0, 1.0);
+    FragColor = vec4(colour.rgb, alpha);
+}
@@ -0,0 +1,30 @@
+#version 330 core
+// corner of the unit quad, -1 to 1 on each axis
+layout (location = 0) in vec2 aCorner;
+// per instance: position and remaining life
+layout (location = 1) in vec4 aParticle;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform float size;
+// head to tail in world space; zero draws round sprites
+uniform vec3 streak;
+
+out vec2 Corner;
+out float Life;
+
+void main()
+{
+    Corner = aCorner;
+    Life = aParticle.w;
+    vec4 head = view * vec4(aParticle.xyz, 1.0);
+    vec4 position = head + vec4(aCorner * size, 0.0, 0.0);
+    if (dot(streak, streak) > 0.0) {
+        // a thin quad from tail to head, widened across the screen
+        vec4 tail = view * vec4(aParticle.xyz + streak, 1.0);
+        vec2 axis = head.xy - tail.xy;
+        vec2 side = dot(axis, axis) > 1e-8 ? normalize(vec2(-axis.y, axis.x)) : vec2(1.0, 0.0);
+        position = mix(tail, head, aCorner.y * 0.5 + 0.5) + vec4(side * aCorner.x * size, 0.0, 0.0);
+    }
+    gl_Position = projection * position;
+}
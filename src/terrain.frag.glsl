@@ -5,24 +5,21 @@ in vec3 FragPos;
 in vec3 Normal;
 in vec2 Tex;
 in vec4 Color;
-in vec4 FragPosLightSpace;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
 out vec4 FragColor;
 uniform sampler2D gTextureHeight0;
 uniform sampler2D gTextureHeight1;
 uniform sampler2D gTextureHeight2;
 uniform sampler2D gTextureHeight3;
-uniform sampler2D shadowMap;
-uniform float shininess;
-uniform bool torch;
+uniform sampler2DArray shadowMap;
 
 uniform float gHeight0 = 20.0;
 uniform float gHeight1 = 30.0;
 uniform float gHeight2 = 60.0;
 uniform float gHeight3 = 80.0;
 
+// Each float fills the fourth slot of the vec3 before it; Lighting.h
+// mirrors this layout.
 struct DirLight {
     vec3 direction;
     vec3 ambient;
@@ -31,40 +28,62 @@ struct DirLight {
 };
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float constant;
     vec3 diffuse;
+    float linear;
     vec3 specular;
+    float quadratic;
+};
+// uploaded once a frame, shared with every lit program
+layout(std140) uniform Lighting {
+    DirLight dirLight;
+    SpotLight spotLight;
+    vec3 viewPos;
+    float shininess;
+    vec3 lightPos;
+    bool torch;
+    bool lightning;
+    vec2 clusterScale;
+};
+#define SHADOW_CASCADES 3
+// cascade matrices and far view depths; ShadowCascades.h mirrors this
+layout(std140) uniform Shadows {
+    mat4 cascadeMatrices[SHADOW_CASCADES];
+    vec4 cascadeSplits;
+    vec4 cameraForward;
 };
-float ShadowCalculation(vec4 fragPosLightSpace);
+float ShadowCalculation(vec3 fragPos);
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec4 CalcTexColor();
 
-float ShadowCalculation(vec4 fragPosLightSpace)
+float ShadowCalculation(vec3 fragPos)
 {
+    float viewDepth = dot(fragPos - viewPos, cameraForward.xyz);
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADES && viewDepth > cascadeSplits[cascade])
+        cascade++;
+    if (cascade == SHADOW_CASCADES)
+        return 0.0;
+    vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fragPos, 1.0);
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5;
-    float closestDepth = texture(shadowMap, projCoords.xy).r;
     float currentDepth = projCoords.z;
     vec3 normal = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - FragPos);
+    vec3 lightDir = normalize(lightPos - fragPos);
     float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
     float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
     const int halfkernelWidth = 3;
     for(int x = -halfkernelWidth; x <= halfkernelWidth; ++x)
     {
         for(int y = -halfkernelWidth; y <= halfkernelWidth; ++y)
         {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
+            float pcfDepth = texture(shadowMap, vec3(projCoords.xy + vec2(x, y) * texelSize, cascade)).r;
             shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.5;
         }
     }
@@ -76,8 +95,6 @@ float ShadowCalculation(vec4 fragPosLightSpace)
     return shadow;
 }
 
-uniform DirLight dirLight;
-uniform SpotLight spotLight;
 void main() {
    vec3 normal = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
@@ -133,7 +150,7 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 ambient = light.ambient * ambient_scale;
     vec3 diffuse = light.diffuse * diff;
     vec3 specular = light.specular * spec;
-    float shadow = ShadowCalculation(FragPosLightSpace);
+    float shadow = ShadowCalculation(FragPos);
     return (ambient + (1.0 - shadow) * (diffuse + specular));
 }
 
@@ -0,0 +1,251 @@
+// Headless checks for RenderQueue: render_queue_test
+//
+// The radix sort must order draws exactly as a stable sort on the keys does,
+// and a submitted queue must reach the backend with every redundant program,
+// texture and VAO change filtered out. Shaders and meshes are built against
+// stand-ins for the GLEW entry points they call, so no context is needed;
+// the queue itself only ever talks to RecordingRenderBackend.
+
+#include "RenderQueue.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+namespace {
+int failures = 0;
+
+void check(bool condition, const char* what)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+GLuint nextName = 1;
+
+void GLAPIENTRY fakeGenNames(GLsizei n, GLuint* names)
+{
+    for (GLsizei i = 0; i < n; i++) {
+        names[i] = nextName++;
+    }
+}
+
+GLuint GLAPIENTRY fakeCreateProgram()
+{
+    return nextName++;
+}
+
+GLuint GLAPIENTRY fakeCreateShader(GLenum)
+{
+    return nextName++;
+}
+
+void GLAPIENTRY fakeDeleteNames(GLsizei, const GLuint*) { }
+void GLAPIENTRY fakeBind(GLenum, GLuint) { }
+void GLAPIENTRY fakeBindVertexArray(GLuint) { }
+void GLAPIENTRY fakeBufferData(GLenum, GLsizeiptr, const void*, GLenum) { }
+void GLAPIENTRY fakeEnableVertexAttribArray(GLuint) { }
+void GLAPIENTRY fakeVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) { }
+void GLAPIENTRY fakeVertexAttribIPointer(GLuint, GLint, GLenum, GLsizei, const void*) { }
+void GLAPIENTRY fakeShaderSource(GLuint, GLsizei, const GLchar* const*, const GLint*) { }
+void GLAPIENTRY fakeCompileShader(GLuint) { }
+void GLAPIENTRY fakeAttachShader(GLuint, GLuint) { }
+void GLAPIENTRY fakeLinkProgram(GLuint) { }
+
+// Everything a Shader or Mesh constructor and destructor reach, as long as
+// no program is used or checked.
+void installFakeGL()
+{
+    glGenBuffers = fakeGenNames;
+    glGenVertexArrays = fakeGenNames;
+    glDeleteBuffers = fakeDeleteNames;
+    glDeleteVertexArrays = fakeDeleteNames;
+    glBindBuffer = fakeBind;
+    glBindVertexArray = fakeBindVertexArray;
+    glBufferData = fakeBufferData;
+    glEnableVertexAttribArray = fakeEnableVertexAttribArray;
+    glVertexAttribPointer = fakeVertexAttribPointer;
+    glVertexAttribIPointer = fakeVertexAttribIPointer;
+    glCreateProgram = fakeCreateProgram;
+    glCreateShader = fakeCreateShader;
+    glShaderSource = fakeShaderSource;
+    glCompileShader = fakeCompileShader;
+    glAttachShader = fakeAttachShader;
+    glLinkProgram = fakeLinkProgram;
+}
+
+Mesh makeMesh(std::vector<unsigned int> textureIds)
+{
+    std::vector<vertex> vertices(3, vertex {});
+    vertices[1].position = glm::vec3(1.0f, 0.0f, 0.0f);
+    vertices[2].position = glm::vec3(0.0f, 1.0f, 0.0f);
+    std::vector<texture> textures;
+    for (size_t i = 0; i < textureIds.size(); i++) {
+        textures.push_back({ textureIds[i], i == 0 ? "texture_diffuse" : "texture_specular", "", nullptr });
+    }
+    return Mesh(vertices, { 0, 1, 2 }, textures, aiAABB(), glm::vec3(0.0f), 0.0f, 0.0f, 0.0f);
+}
+
+void testRadixOrder()
+{
+    std::mt19937_64 random(42);
+    for (size_t count : { 0, 1, 2, 255, 1000, 20000 }) {
+        std::vector<DrawCommand> commands(count);
+        for (size_t i = 0; i < count; i++) {
+            commands[i] = {};
+            // few programs and VAOs, so keys tie and whole bytes match
+            commands[i].key = makeDrawKey((unsigned int)(random() % 3), (unsigned int)(random() % 40),
+                (unsigned int)(random() % 500), (float)(random() % 1000) * 0.25f);
+            commands[i].transform = (unsigned int)i;
+        }
+        std::vector<DrawCommand> expected = commands;
+        std::stable_sort(expected.begin(), expected.end(),
+            [](const DrawCommand& a, const DrawCommand& b) { return a.key < b.key; });
+        std::vector<DrawCommand> scratch;
+        radixSortDraws(commands, scratch);
+        bool same = commands.size() == expected.size();
+        for (size_t i = 0; same && i < commands.size(); i++) {
+            same = commands[i].key == expected[i].key && commands[i].transform == expected[i].transform;
+        }
+        check(same, "radix order matches a stable sort on the keys");
+    }
+
+    // random 64-bit keys leave no byte shared, so every pass runs
+    std::vector<DrawCommand> commands(5000);
+    for (size_t i = 0; i < commands.size(); i++) {
+        commands[i] = {};
+        commands[i].key = random();
+        commands[i].transform = (unsigned int)i;
+    }
+    std::vector<DrawCommand> expected = commands;
+    std::stable_sort(expected.begin(), expected.end(),
+        [](const DrawCommand& a, const DrawCommand& b) { return a.key < b.key; });
+    std::vector<DrawCommand> scratch;
+    radixSortDraws(commands, scratch);
+    bool same = true;
+    for (size_t i = 0; i < commands.size(); i++) {
+        same = same && commands[i].transform == expected[i].transform;
+    }
+    check(same, "radix order matches a stable sort on full 64-bit keys");
+
+    check(makeDrawKey(0, 0, 0, 1.0f) < makeDrawKey(0, 0, 0, 2.0f), "nearer draws sort first");
+    check(makeDrawKey(0, 1, 0, 0.0f) < makeDrawKey(1, 0, 0, 0.0f), "program outranks material");
+    check(makeDrawKey(0, 0, 1, 0.0f) < makeDrawKey(0, 1, 0, 0.0f), "material outranks VAO");
+    check(makeDrawKey(0, 0, 0, -3.0f) == makeDrawKey(0, 0, 0, 0.0f), "depth behind the eye clamps to zero");
+}
+
+void testRecordedCalls()
+{
+    Shader lit("../src/modelLoading.vert.glsl", "../src/modelLoading.frag.glsl");
+    Shader flat("../src/basic.vert.glsl", "../src/basic.frag.glsl");
+    // a and b share a material, c has its own
+    Mesh a = makeMesh({ 100, 101 });
+    Mesh b = makeMesh({ 100, 101 });
+    Mesh c = makeMesh({ 102 });
+
+    RenderQueue queue;
+    struct Draw {
+        const Shader* shader;
+        const Mesh* mesh;
+        float depth;
+    };
+    const Draw draws[] = {
+        { &flat, &c, 4.0f },
+        { &lit, &a, 9.0f },
+        { &lit, &b, 2.0f },
+        { &flat, &a, 1.0f },
+        { &lit, &a, 3.0f },
+        { &lit, &c, 5.0f },
+        { &flat, &c, 0.5f },
+        { &lit, &b, 7.0f },
+    };
+    for (const Draw& draw : draws) {
+        unsigned int transform = queue.addTransform(glm::mat4(draw.depth));
+        queue.add(*draw.shader, *draw.mesh, 0, transform, draw.depth);
+    }
+    queue.sort();
+    const std::vector<DrawCommand>& commands = queue.commands();
+    check(commands.size() == std::size(draws), "every added draw is queued");
+    for (size_t i = 1; i < commands.size(); i++) {
+        check(commands[i - 1].key <= commands[i].key, "queue is in key order after sort");
+    }
+
+    RecordingRenderBackend backend;
+    FrameUniforms frame { glm::mat4(1.0f), glm::mat4(1.0f), glm::mat4(1.0f) };
+    RenderQueueStats stats = queue.submit(backend, frame);
+
+    // replay the calls, failing on any that would not have changed anything
+    unsigned int program = 0;
+    unsigned int vao = 0;
+    unsigned int textures[4] = {};
+    int model = -1;
+    size_t draw = 0;
+    int programChanges = 0;
+    int redundant = 0;
+    for (const auto& call : backend.calls) {
+        switch (call.op) {
+        case RecordingRenderBackend::Op::UseProgram:
+            redundant += call.a == program;
+            program = call.a;
+            programChanges++;
+            break;
+        case RecordingRenderBackend::Op::BindVertexArray:
+            redundant += call.a == vao && call.a != 0;
+            vao = call.a;
+            break;
+        case RecordingRenderBackend::Op::BindTexture:
+            redundant += call.a < 4 && textures[call.a] == call.b && draw < commands.size();
+            if (call.a < 4) {
+                textures[call.a] = call.b;
+            }
+            break;
+        case RecordingRenderBackend::Op::SetMat4:
+            model = (int)call.a;
+            break;
+        case RecordingRenderBackend::Op::DrawElements: {
+            check(draw < commands.size(), "no more draws than commands");
+            if (draw >= commands.size()) {
+                break;
+            }
+            const DrawCommand& command = commands[draw++];
+            check(program == command.shader->id(), "draw sees its own program");
+            check(vao == command.mesh->VAO.id(), "draw sees its own VAO");
+            for (size_t unit = 0; unit < command.mesh->textures.size(); unit++) {
+                check(textures[unit] == command.mesh->textures[unit].id, "draw sees its own textures");
+            }
+            check(call.a == command.indexCount && call.b == command.firstIndex, "draw takes the command's range");
+            check(model != -1, "a model matrix is set before the first draw");
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    check(draw == commands.size(), "every command is drawn");
+    check(redundant == 0, "no redundant program, VAO or texture change reaches the backend");
+    check(programChanges == 2, "one program change per program");
+    check(stats.programChanges == 2 && stats.draws == (int)commands.size(), "stats count what was submitted");
+    check(stats.avoided > 0, "shared state is counted as avoided");
+    check(!backend.calls.empty() && backend.calls.back().op != RecordingRenderBackend::Op::DrawElements,
+        "the VAO is unbound after the last draw");
+    check(stats.streamedBytes == 0, "nothing is streamed without a stream buffer");
+}
+}
+
+int main()
+{
+    installFakeGL();
+    testRadixOrder();
+    testRecordedCalls();
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "render_queue_test: all checks passed" << std::endl;
+    return 0;
+}
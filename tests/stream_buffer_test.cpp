@@ -0,0 +1,162 @@
+// Headless checks for the stream ring: stream_buffer_test
+//
+// StreamRing's alignment and overflow, and StreamBuffer's fence handling
+// against RecordingStreamBackend: a region is only written again once the
+// frame that last used it has been waited on, an overflow grows the buffer
+// at the next beginFrame, and destruction waits for everything in flight.
+
+#include "StreamBuffer.h"
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+int failures = 0;
+
+void check(bool condition, const char* what)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// What the backend saw when it was last mapped and when it was destroyed,
+// kept outside it since StreamBuffer owns and destroys it.
+struct BackendLog {
+    std::vector<std::vector<uintptr_t>> pendingAtMap;
+    std::vector<uintptr_t> pendingAtDestroy;
+    bool mappedAtDestroy = false;
+    bool destroyed = false;
+};
+
+class LoggingBackend : public RecordingStreamBackend {
+public:
+    explicit LoggingBackend(BackendLog& log)
+        : m_log(log)
+    {
+    }
+    ~LoggingBackend() override
+    {
+        m_log.pendingAtDestroy = pending;
+        m_log.mappedAtDestroy = mapped;
+        m_log.destroyed = true;
+    }
+    unsigned char* map(size_t offset, size_t bytes) override
+    {
+        m_log.pendingAtMap.push_back(pending);
+        return RecordingStreamBackend::map(offset, bytes);
+    }
+
+private:
+    BackendLog& m_log;
+};
+
+void testRingAllocation()
+{
+    StreamRing ring(1000, 3);
+    check(ring.regionSize() == 1024, "regions are rounded up to 256 bytes");
+    ring.beginFrame();
+    check(ring.region() == 0 && ring.regionOffset() == 0, "the first frame lands on region 0");
+    check(ring.allocate(10, 4) == 0, "the first allocation starts the region");
+    check(ring.allocate(16, 16) == 16, "allocations are aligned up");
+    check(ring.allocate(4, 256) == 256, "large alignments are honoured");
+    check(ring.used() == 260, "used counts padding and bytes");
+    check(ring.allocate(800, 4) == StreamRing::NO_SPACE, "an allocation past the region end fails");
+    check(ring.used() == 260, "a failed allocation takes nothing");
+    check(ring.allocate(764, 4) == 260, "the rest of the region can still be taken exactly");
+    check(ring.allocate(1, 1) == StreamRing::NO_SPACE, "a full region fails even one byte");
+
+    ring.beginFrame();
+    check(ring.region() == 1 && ring.used() == 0, "the next frame starts empty in the next region");
+    size_t offset = ring.allocate(64, 256);
+    check(offset == 1024, "offsets are from the start of the whole buffer");
+    ring.beginFrame();
+    ring.beginFrame();
+    check(ring.region() == 0, "regions wrap around");
+}
+
+void testWaitBeforeReuse()
+{
+    BackendLog log;
+    auto backend = std::make_unique<LoggingBackend>(log);
+    LoggingBackend& recorded = *backend;
+    {
+        StreamBuffer stream(std::move(backend), 1024, 3);
+        size_t offsets[4];
+        for (int frame = 0; frame < 4; frame++) {
+            stream.beginFrame();
+            StreamAllocation allocation = stream.allocate(16, 16);
+            check(allocation.data != nullptr, "a frame's allocation is mapped");
+            offsets[frame] = allocation.offset;
+            if (allocation.data) {
+                memset(allocation.data, frame + 1, allocation.size);
+            }
+            stream.finishWrites();
+            check(!recorded.mapped, "finishWrites unmaps the region");
+            check(stream.allocate(16, 16).data == nullptr, "nothing is handed out after finishWrites");
+            stream.endFrame();
+        }
+        check(offsets[0] == 0 && offsets[1] == 1024 && offsets[2] == 2048, "each frame takes its own region");
+        check(offsets[3] == 0, "the fourth frame reuses the first region");
+        check(recorded.memory[0] == 4 && recorded.memory[1024] == 2, "writes land at their offsets");
+
+        check(log.pendingAtMap.size() == 4, "one map per frame");
+        check(log.pendingAtMap[0].empty(), "the first frame waits on nothing");
+        check(log.pendingAtMap[2] == std::vector<uintptr_t>({ 1, 2 }), "frames in flight are left alone");
+        check(log.pendingAtMap[3] == std::vector<uintptr_t>({ 2, 3 }),
+            "the first frame's fence is waited on before its region is mapped again");
+        check(recorded.waits == 1 && stream.stats().stalls == 1, "only the reused region is waited on");
+        check(recorded.creates == 1 && stream.stats().grows == 0, "a frame that fits never regrows");
+
+        // left mid-frame, so destruction has to unmap as well as wait
+        stream.beginFrame();
+    }
+    check(log.destroyed, "the backend goes with the stream buffer");
+    check(!log.mappedAtDestroy, "destruction unmaps an open frame");
+    check(log.pendingAtDestroy.empty(), "destruction waits on every fence in flight");
+}
+
+void testOverflowGrows()
+{
+    BackendLog log;
+    auto backend = std::make_unique<LoggingBackend>(log);
+    LoggingBackend& recorded = *backend;
+    StreamBuffer stream(std::move(backend), 1024, 3);
+
+    stream.beginFrame();
+    stream.endFrame();
+    stream.beginFrame();
+    check(stream.allocate(2000, 16).data == nullptr, "an allocation larger than the region fails");
+    check(stream.allocate(512, 16).data != nullptr, "the region is still usable after an overflow");
+    check(stream.stats().overflows == 1, "the overflow is counted");
+    stream.endFrame();
+    check(stream.regionSize() == 1024, "the buffer is not regrown mid-frame");
+
+    stream.beginFrame();
+    check(stream.stats().grows == 1 && recorded.creates == 2, "the next beginFrame regrows the buffer");
+    check(stream.regionSize() >= 2048, "the new region is larger");
+    check(log.pendingAtMap.back().empty(), "every frame in flight is waited on before the old buffer goes");
+    StreamAllocation allocation = stream.allocate(2000, 16);
+    check(allocation.data != nullptr && allocation.offset == 0, "the allocation fits after the grow");
+    stream.endFrame();
+
+    stream.beginFrame(stream.regionSize() * 3);
+    check(stream.stats().grows == 2, "an estimate over the region grows it too");
+    stream.beginFrame();
+    check(stream.stats().grows == 2, "a frame after the grow keeps the size");
+}
+}
+
+int main()
+{
+    testRingAllocation();
+    testWaitBeforeReuse();
+    testOverflowGrows();
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "stream_buffer_test: all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,140 @@
+// Offline texture baker: bake_textures [--force] [--check] <image or directory>...
+//
+// Writes a .spktex next to every image with its mip chain built and block
+// compressed, which the game then uploads as-is instead of decoding the
+// source and calling glGenerateMipmap. Files whose source has not changed
+// since the last bake are skipped unless --force is given. --check decodes
+// the result again and prints the error of level 0. Needs no GL context.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "utils/BakedTexture.h"
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+bool isImage(const std::filesystem::path& path)
+{
+    std::string extension = path.extension().string();
+    for (auto& c : extension) {
+        c = (char)std::tolower((unsigned char)c);
+    }
+    return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga"
+        || extension == ".bmp";
+}
+
+double psnr(const std::vector<unsigned char>& a, const unsigned char* b, size_t size)
+{
+    double error = 0.0;
+    for (size_t i = 0; i < size; i++) {
+        double d = (double)a[i] - (double)b[i];
+        error += d * d;
+    }
+    error /= (double)size;
+    return error > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / error) : 99.0;
+}
+
+struct Totals {
+    int baked = 0;
+    int skipped = 0;
+    int failed = 0;
+    size_t rawBytes = 0;
+    size_t bakedBytes = 0;
+};
+
+void bake(const std::string& path, bool force, bool check, Totals& totals)
+{
+    uint64_t hash = hashTextureSource(path);
+    std::string outPath = bakedTexturePath(path);
+    BakedTexture existing;
+    if (!force && !check && readBakedTexture(outPath, hash, existing)) {
+        totals.skipped++;
+        return;
+    }
+
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    unsigned char* rgba = stbi_load(path.c_str(), &width, &height, &channels, 4);
+    if (rgba == nullptr) {
+        std::cerr << path << ": " << stbi_failure_reason() << std::endl;
+        totals.failed++;
+        return;
+    }
+    BlockFormat format = chooseBlockFormat(path, rgba, width, height);
+    BakedTexture texture = compressTexture(rgba, width, height, format, format != BlockFormat::BC5);
+    if (!writeBakedTexture(outPath, hash, texture)) {
+        std::cerr << "Could not write " << outPath << std::endl;
+        stbi_image_free(rgba);
+        totals.failed++;
+        return;
+    }
+
+    // what the runtime used to upload: source channels plus a generated mip chain
+    size_t raw = (size_t)width * height * channels;
+    raw += raw / 3;
+    totals.baked++;
+    totals.rawBytes += raw;
+    totals.bakedBytes += texture.bytes();
+    std::cout << path << ": " << width << "x" << height << " " << blockFormatName(format) << ", "
+              << texture.levels.size() << " levels, " << raw / 1024 << " KB -> " << texture.bytes() / 1024 << " KB";
+    if (check) {
+        std::vector<unsigned char> decoded = decompressLevel(texture.levels[0], format);
+        if (format == BlockFormat::BC5) {
+            // only red and green survive; compare those
+            std::vector<unsigned char> source(rgba, rgba + decoded.size());
+            for (size_t i = 0; i < decoded.size(); i += 4) {
+                decoded[i + 2] = source[i + 2];
+                decoded[i + 3] = source[i + 3];
+            }
+        }
+        std::cout << ", level 0 PSNR " << psnr(decoded, rgba, decoded.size()) << " dB";
+    }
+    std::cout << std::endl;
+    stbi_image_free(rgba);
+}
+}
+
+int main(int argc, char** argv)
+{
+    bool force = false;
+    bool check = false;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--force") {
+            force = true;
+        } else if (arg == "--check") {
+            check = true;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty()) {
+        std::cerr << "usage: bake_textures [--force] [--check] <image or directory>..." << std::endl;
+        return 1;
+    }
+
+    Totals totals;
+    for (const auto& input : inputs) {
+        std::error_code error;
+        if (std::filesystem::is_directory(input, error)) {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(input, error)) {
+                if (entry.is_regular_file() && isImage(entry.path())) {
+                    bake(entry.path().string(), force, check, totals);
+                }
+            }
+        } else {
+            bake(input, force, check, totals);
+        }
+    }
+    std::cout << totals.baked << " baked, " << totals.skipped << " up to date, " << totals.failed << " failed";
+    if (totals.baked > 0) {
+        std::cout << "; " << totals.rawBytes / 1048576.0 << " MB -> " << totals.bakedBytes / 1048576.0 << " MB";
+    }
+    std::cout << std::endl;
+    return totals.failed > 0 ? 1 : 0;
+}